@@ -0,0 +1,85 @@
+/*
+ * bench.h
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_BENCH_BENCH_H_
+#define SRC_BENCH_BENCH_H_
+
+#include <chrono>
+#include <string>
+#include "../couchit/json.h"
+
+namespace couchit {
+
+///Runs benchmarks and collects results as JSON
+/**
+ * Each benchmark is function void(std::size_t ops), which must perform given count of operations.
+ * The function is called once with small count to warm up caches, then the measured
+ * run follows.
+ */
+class BenchRunner {
+public:
+
+	///Constructor
+	/**
+	 * @param filter only benchmarks which names contain this string are executed. Empty
+	 * string executes all benchmarks
+	 */
+	BenchRunner(const std::string &filter):filter(filter) {}
+
+	///Runs the benchmark
+	/**
+	 * @param name name of the benchmark
+	 * @param ops count of operations
+	 * @param fn benchmark function
+	 */
+	template<typename Fn>
+	void run(StrViewA name, std::size_t ops, Fn &&fn);
+
+	///Returns true, if the benchmark will be executed
+	bool enabled(StrViewA name) const {
+		return filter.empty() || name.indexOf(StrViewA(filter),0) != name.npos;
+	}
+
+	///Retrieves collected results
+	Value getResults() const {return results;}
+
+protected:
+	std::string filter;
+	Array results;
+};
+
+template<typename Fn>
+void BenchRunner::run(StrViewA name, std::size_t ops, Fn &&fn) {
+	if (!enabled(name)) return;
+	fn(ops / 10 + 1);
+	auto start = std::chrono::steady_clock::now();
+	fn(ops);
+	auto stop = std::chrono::steady_clock::now();
+	double secs = std::chrono::duration<double>(stop - start).count();
+	results.push_back(Object("name",name)
+			("ops",ops)
+			("seconds",secs)
+			("ns_per_op",ops?secs * 1e9 / ops:0.0)
+			("ops_per_sec",secs > 0?ops / secs:0.0));
+}
+
+void runCoreBenchmarks(BenchRunner &runner);
+void runViewBenchmarks(BenchRunner &runner);
+void runCacheBenchmarks(BenchRunner &runner);
+void runBatchBenchmarks(BenchRunner &runner);
+
+///Prevents the compiler to optimize out a calculated value
+template<typename T>
+inline void doNotOptimize(const T &val) {
+	asm volatile("" : : "g"(&val) : "memory");
+}
+
+}
+
+
+
+#endif /* SRC_BENCH_BENCH_H_ */
@@ -0,0 +1,138 @@
+/*
+ * bench_core.cpp
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#include <unistd.h>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "../couchit/collation.h"
+#include "../couchit/checkpointFile.h"
+#include "../couchit/defaultUIDGen.h"
+#include "../couchit/minihttp/chunkstream.h"
+#include "../couchit/minihttp/stringstreams.h"
+
+namespace couchit {
+
+///Generates keys similar to keys used in views - strings, numbers and composed keys
+static std::vector<Value> generateKeys(std::size_t count) {
+	std::mt19937 rnd(12345);
+	std::uniform_int_distribution<int> kind(0,3);
+	std::uniform_int_distribution<int> num(0,100000);
+	std::vector<Value> keys;
+	keys.reserve(count);
+	for (std::size_t i = 0; i < count; i++) {
+		switch (kind(rnd)) {
+		case 0: keys.push_back(num(rnd));break;
+		case 1: keys.push_back(Value(StrViewA("key" + std::to_string(num(rnd)))));break;
+		case 2: keys.push_back({num(rnd) % 100, StrViewA("sub" + std::to_string(num(rnd)))});break;
+		default: keys.push_back({StrViewA("grp" + std::to_string(num(rnd) % 50)), num(rnd), nullptr});break;
+		}
+	}
+	return keys;
+}
+
+static void benchCompareJson(BenchRunner &runner) {
+	std::vector<Value> keys = generateKeys(4096);
+	runner.run("collation.compareJson", 2000000, [&](std::size_t ops) {
+		int acc = 0;
+		for (std::size_t i = 0; i < ops; i++) {
+			acc += compareJson(keys[i & 4095], keys[(i * 7 + 1) & 4095]);
+		}
+		doNotOptimize(acc);
+	});
+}
+
+template<typename Gen>
+static void benchUIDGen(BenchRunner &runner, StrViewA name, Gen &gen) {
+	runner.run(String({name,".single"}), 1000000, [&](std::size_t ops) {
+		IIDGen::Buffer buffer;
+		for (std::size_t i = 0; i < ops; i++) {
+			StrViewA id = gen(buffer, "");
+			doNotOptimize(id);
+		}
+	});
+	runner.run(String({name,".threads4"}), 1000000, [&](std::size_t ops) {
+		std::vector<std::thread> thrs;
+		for (int t = 0; t < 4; t++) {
+			thrs.push_back(std::thread([&]{
+				IIDGen::Buffer buffer;
+				for (std::size_t i = 0; i < ops / 4; i++) {
+					StrViewA id = gen(buffer, "");
+					doNotOptimize(id);
+				}
+			}));
+		}
+		for (auto &&t : thrs) t.join();
+	});
+}
+
+static void benchCheckpoint(BenchRunner &runner) {
+	Array rows;
+	std::vector<Value> keys = generateKeys(10000);
+	for (std::size_t i = 0; i < keys.size(); i++) {
+		rows.push_back({keys[i], Object("id",StrViewA("doc" + std::to_string(i)))("n",i)});
+	}
+	Value data = Object("seq",10000)("rows",rows);
+	std::string fname = "/tmp/couchit_bench_chkpt_" + std::to_string(getpid());
+	PCheckpoint chkpt = checkpointFile(fname);
+
+	runner.run("checkpoint.store", 50, [&](std::size_t ops) {
+		for (std::size_t i = 0; i < ops; i++) chkpt->store(data);
+	});
+	runner.run("checkpoint.load", 50, [&](std::size_t ops) {
+		for (std::size_t i = 0; i < ops; i++) {
+			Value v = chkpt->load();
+			doNotOptimize(v);
+		}
+	});
+	unlink(fname.c_str());
+}
+
+static void benchChunkedStream(BenchRunner &runner) {
+	//approx. 1MB of data split into chunks of various sizes
+	std::mt19937 rnd(4321);
+	std::uniform_int_distribution<int> chunkSize(1,8192);
+	std::string payload;
+	std::size_t total = 0;
+	char hex[32];
+	while (total < 1024*1024) {
+		int sz = chunkSize(rnd);
+		snprintf(hex, sizeof(hex), "%x\r\n", sz);
+		payload.append(hex);
+		payload.append(sz, 'x');
+		payload.append("\r\n");
+		total += sz;
+	}
+	payload.append("0\r\n\r\n");
+
+	runner.run("minihttp.chunkedRead", 200, [&](std::size_t ops) {
+		for (std::size_t i = 0; i < ops; i++) {
+			std::size_t rd = 0;
+			InputStream stream(new ChunkedInputStream(new StringInputStream(BinaryView(StrViewA(payload)))));
+			BinaryView b = stream.read();
+			while (!b.empty()) {
+				rd += b.length;
+				b = stream.read();
+			}
+			doNotOptimize(rd);
+		}
+	});
+}
+
+void runCoreBenchmarks(BenchRunner &runner) {
+	benchCompareJson(runner);
+	benchUIDGen(runner, "uidgen.default", DefaultUIDGen::getInstance());
+	benchUIDGen(runner, "uidgen.fast", FastUIDGen::getInstance());
+	benchCheckpoint(runner);
+	benchChunkedStream(runner);
+}
+
+}
@@ -0,0 +1,121 @@
+/*
+ * bench_db.cpp
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ *
+ * Benchmarks of the components which communicate with the database. The database is
+ * replaced by the MockCouchDB, so the results contain cost of the local HTTP roundtrip, but
+ * not the cost of the CouchDB itself
+ */
+
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "bench.h"
+#include "../couchit/batch.h"
+#include "../couchit/couchDB.h"
+#include "../couchit/doccache.h"
+#include "../tests/mockCouchDB.h"
+#include "../couchit/queryCache.h"
+
+namespace couchit {
+
+static std::vector<String> generateIds(std::size_t count) {
+	std::vector<String> ids;
+	ids.reserve(count);
+	for (std::size_t i = 0; i < count; i++) ids.push_back(String({"doc",StrViewA(std::to_string(i))}));
+	return ids;
+}
+
+template<typename Fn>
+static void runThreads(unsigned int count, Fn &&fn) {
+	std::vector<std::thread> thrs;
+	for (unsigned int t = 0; t < count; t++) thrs.push_back(std::thread([&fn,t]{fn(t);}));
+	for (auto &&t : thrs) t.join();
+}
+
+void runCacheBenchmarks(BenchRunner &runner) {
+	MockCouchDB server;
+	server.createDB("bench");
+	CouchDB db(server.getConfig("bench"));
+	std::vector<String> ids = generateIds(10000);
+	{
+		Array docs;
+		for (auto &&id : ids) docs.push_back(Object("_id",id)("value",1));
+		db.bulkUpload(docs);
+	}
+
+	runner.run("doccache.miss", 2000, [&](std::size_t ops) {
+		DocCache cache(db, DocCache::Config());
+		for (std::size_t i = 0; i < ops; i++) {
+			Value v = cache.get(ids[i % ids.size()]);
+			doNotOptimize(v);
+		}
+	});
+
+	DocCache cache(db, DocCache::Config());
+	for (auto &&id : ids) cache.put(Object("_id",id)("_rev","1-0")("value",1));
+
+	runner.run("doccache.hit.threads4", 2000000, [&](std::size_t ops) {
+		runThreads(4, [&](unsigned int t) {
+			for (std::size_t i = 0; i < ops / 4; i++) {
+				Value v = cache.get(ids[(i * 4 + t) % ids.size()]);
+				doNotOptimize(v);
+			}
+		});
+	});
+	runner.run("doccache.put.threads4", 1000000, [&](std::size_t ops) {
+		runThreads(4, [&](unsigned int t) {
+			for (std::size_t i = 0; i < ops / 4; i++) {
+				cache.put(Object("_id",ids[(i * 4 + t) % ids.size()])("_rev","2-0")("value",2));
+			}
+		});
+	});
+
+	QueryCache qcache(ids.size());
+	std::vector<String> urls;
+	urls.reserve(ids.size());
+	for (auto &&id : ids) urls.push_back(String({"/bench/_design/v/_view/by_id?key=",id}));
+	for (auto &&u : urls) qcache.set(QueryCache::CachedItem(u, "\"etag\"", Object("rows",Array())));
+
+	runner.run("querycache.find.threads4", 2000000, [&](std::size_t ops) {
+		runThreads(4, [&](unsigned int t) {
+			for (std::size_t i = 0; i < ops / 4; i++) {
+				QueryCache::CachedItem itm = qcache.find(urls[(i * 4 + t) % urls.size()]);
+				doNotOptimize(itm);
+			}
+		});
+	});
+	runner.run("querycache.set.threads4", 1000000, [&](std::size_t ops) {
+		runThreads(4, [&](unsigned int t) {
+			for (std::size_t i = 0; i < ops / 4; i++) {
+				const String &u = urls[(i * 4 + t) % urls.size()];
+				qcache.set(QueryCache::CachedItem(u, "\"etag2\"", Object("rows",Array())));
+			}
+		});
+	});
+}
+
+void runBatchBenchmarks(BenchRunner &runner) {
+	MockCouchDB server;
+	server.createDB("bench");
+	CouchDB db(server.getConfig("bench"));
+
+	runner.run("batchwrite.put", 100000, [&](std::size_t ops) {
+		std::atomic<std::size_t> done(0);
+		{
+			BatchWrite batch(db);
+			for (std::size_t i = 0; i < ops; i++) {
+				batch.put(Object("value",i), [&](bool ok, Value) {
+					if (ok) ++done;
+				});
+			}
+		}
+		doNotOptimize(done);
+	});
+}
+
+}
@@ -0,0 +1,34 @@
+/*
+ * bench_main.cpp
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ *
+ * Micro and macro benchmarks of the couchit library
+ *
+ * usage: couchit_bench [filter]
+ *
+ * Only benchmarks which names contain the filter are executed. Results are printed as JSON
+ * to the standard output. All data are generated from a fixed seed, so results are
+ * comparable between runs.
+ */
+
+#include <iostream>
+#include "bench.h"
+
+using namespace couchit;
+
+int main(int argc, char **argv) {
+
+	BenchRunner runner(argc > 1?argv[1]:"");
+
+	runCoreBenchmarks(runner);
+	runViewBenchmarks(runner);
+	runCacheBenchmarks(runner);
+	runBatchBenchmarks(runner);
+
+	Value result = Object("benchmarks",runner.getResults());
+	result.toStream(std::cout);
+	std::cout << std::endl;
+	return 0;
+}
@@ -0,0 +1,116 @@
+/*
+ * bench_views.cpp
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "bench.h"
+#include "../couchit/document.h"
+#include "../couchit/localView.h"
+#include "../couchit/memview.h"
+#include "../couchit/query.h"
+#include "../couchit/queryServerIfc.h"
+
+namespace couchit {
+
+static std::vector<Value> generateDocs(std::size_t count) {
+	std::mt19937 rnd(777);
+	std::uniform_int_distribution<int> age(18,90);
+	std::uniform_int_distribution<int> height(140,200);
+	std::vector<Value> docs;
+	docs.reserve(count);
+	for (std::size_t i = 0; i < count; i++) {
+		docs.push_back(Object("_id",StrViewA("person" + std::to_string(i)))
+				("_rev","1-0")
+				("name",StrViewA("Name " + std::to_string(i)))
+				("age",age(rnd))
+				("height",height(rnd)));
+	}
+	return docs;
+}
+
+class BenchViewStats: public AbstractViewBuildin<1, AbstractViewBase::rmStats> {
+public:
+	virtual void map(const Document &doc, IEmitFn &emit) override {
+		emit({doc["age"].getUInt()/10 * 10 ,doc["age"]},doc["height"]);
+	}
+};
+
+class BenchViewSum: public AbstractViewBuildin<1, AbstractViewBase::rmSum> {
+public:
+	virtual void map(const Document &doc, IEmitFn &emit) override {
+		emit(doc["age"],doc["height"]);
+	}
+};
+
+static void benchMemView(BenchRunner &runner, const std::vector<Value> &docs) {
+	runner.run("memview.insert", docs.size(), [&](std::size_t ops) {
+		MemView view;
+		for (std::size_t i = 0; i < ops; i++) {
+			const Value &d = docs[i % docs.size()];
+			view.addDoc(d["_id"].toString(), d, d["age"], d["height"]);
+		}
+	});
+
+	MemView view;
+	for (auto &&d : docs) view.addDoc(d["_id"].toString(), d, d["age"], d["height"]);
+
+	runner.run("memview.rangeScan", 10000, [&](std::size_t ops) {
+		std::size_t rows = 0;
+		for (std::size_t i = 0; i < ops; i++) {
+			int from = 18 + static_cast<int>(i % 60);
+			Result res = view.createQuery(0).range(from, from + 5).exec();
+			rows += res.size();
+		}
+		doNotOptimize(rows);
+	});
+}
+
+static void benchLocalView(BenchRunner &runner, const std::vector<Value> &docs) {
+	runner.run("localview.insert", docs.size(), [&](std::size_t ops) {
+		LocalView view(new BenchViewStats, 0);
+		for (std::size_t i = 0; i < ops; i++) view.updateDoc(docs[i % docs.size()]);
+	});
+
+	LocalView statView(new BenchViewStats, 0);
+	LocalView sumView(new BenchViewSum, 0);
+	for (auto &&d : docs) {
+		statView.updateDoc(d);
+		sumView.updateDoc(d);
+	}
+
+	runner.run("localview.rangeScan", 10000, [&](std::size_t ops) {
+		std::size_t rows = 0;
+		for (std::size_t i = 0; i < ops; i++) {
+			int from = 18 + static_cast<int>(i % 60);
+			Result res = sumView.createQuery(0).range(from, from + 5).noreduce().exec();
+			rows += res.size();
+		}
+		doNotOptimize(rows);
+	});
+	runner.run("localview.reduceSum", 1000, [&](std::size_t ops) {
+		for (std::size_t i = 0; i < ops; i++) {
+			Result res = sumView.createQuery(0).reduceAll().exec();
+			doNotOptimize(res);
+		}
+	});
+	runner.run("localview.reduceStatsGroup", 1000, [&](std::size_t ops) {
+		for (std::size_t i = 0; i < ops; i++) {
+			Result res = statView.createQuery(0).groupLevel(1).exec();
+			doNotOptimize(res);
+		}
+	});
+}
+
+void runViewBenchmarks(BenchRunner &runner) {
+	std::vector<Value> docs = generateDocs(50000);
+	benchMemView(runner, docs);
+	benchLocalView(runner, docs);
+}
+
+}
@@ -0,0 +1,159 @@
+/*
+ * qserver_replay.cpp
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ *
+ * Replays recorded session of the CouchDB query server protocol and measures
+ * throughput of the dispatcher. The session is a file containing requests, one per line, as
+ * they were sent by the CouchDB (it can be captured by the tee command placed
+ * in front of the query server). If the file is not given, synthetic session is generated
+ *
+ * usage: couchit_qserver_replay [session_file] [repeat]
+ *
+ * Result is printed as JSON to the standard output
+ */
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <set>
+#include <string>
+#include <vector>
+
+#include <imtjson/value.h>
+#include <imtjson/object.h>
+#include "../couchit/queryServer.h"
+
+using namespace couchit;
+
+///View registered for every function found in the session
+class ReplayView: public AbstractViewBase {
+public:
+	ReplayView(std::size_t ver):ver(ver) {}
+	virtual std::size_t version() const override {return ver;}
+	virtual void map(const Document &doc, IEmitFn &emit) override {
+		emit(doc["_id"], doc["_rev"]);
+	}
+	virtual ReduceMode reduceMode() const override {return rmCount;}
+	virtual Value reduce(const RowsWithKeys &) override {return Value();}
+	virtual Value rereduce(const ReducedRows &) override {return Value();}
+protected:
+	std::size_t ver;
+};
+
+static std::vector<std::string> loadSession(const char *fname) {
+	std::vector<std::string> lines;
+	std::ifstream in(fname);
+	if (!in) {
+		std::cerr << "Unable to open session file: " << fname << std::endl;
+		std::exit(1);
+	}
+	std::string ln;
+	while (std::getline(in, ln)) {
+		if (!ln.empty()) lines.push_back(ln);
+	}
+	return lines;
+}
+
+static Value str(const std::string &s) {
+	return Value(StrViewA(s));
+}
+
+static std::vector<std::string> generateSession() {
+	std::vector<std::string> lines;
+	lines.push_back(Value({"reset",Object("reduce_limit",true)("timeout",5000)}).stringify().c_str());
+	lines.push_back(Value({"add_fun","replay/by_id@1"}).stringify().c_str());
+	lines.push_back(Value({"add_fun","replay/by_rev@1"}).stringify().c_str());
+	for (unsigned int i = 0; i < 10000; i++) {
+		std::string id = "doc" + std::to_string(i);
+		Value doc = Object("_id",str(id))
+				("_rev",str("1-" + std::to_string(i * 7919)))
+				("name",str("Name " + std::to_string(i)))
+				("age",i % 90)
+				("tags",{"a","b","c"});
+		lines.push_back(Value({"map_doc",doc}).stringify().c_str());
+	}
+	return lines;
+}
+
+static void registerViews(QueryServer &qserver, const std::vector<std::string> &lines) {
+	std::set<std::string> known;
+	for (auto &&ln : lines) {
+		Value req = Value::fromString(ln);
+		if (req[0].getString() != "add_fun") continue;
+		StrViewA name = req[1].getString();
+		std::size_t sep = name.indexOf("@",0);
+		if (sep == ((std::size_t)-1)) continue;
+		StrViewA fname = name.substr(0,sep);
+		if (!known.insert(std::string(fname.data, fname.length)).second) continue;
+		qserver.regView(String(fname), new ReplayView(Value::fromString(name.substr(sep+1)).getUInt()));
+	}
+}
+
+static std::string createSessionFile(const std::vector<std::string> &lines, unsigned int repeat, std::size_t &count) {
+	char name[] = "/tmp/couchit_replay_XXXXXX";
+	int fd = mkstemp(name);
+	if (fd < 0) {
+		std::cerr << "Unable to create temporary file" << std::endl;
+		std::exit(1);
+	}
+	close(fd);
+	std::ofstream out(name, std::ios::out|std::ios::trunc);
+	count = 0;
+	for (unsigned int i = 0; i < repeat; i++) {
+		for (auto &&ln : lines) {
+			out << ln << '\n';
+			count++;
+		}
+	}
+	return name;
+}
+
+template<typename Fn>
+static Value measure(std::size_t count, Fn &&fn) {
+	auto start = std::chrono::steady_clock::now();
+	fn();
+	auto stop = std::chrono::steady_clock::now();
+	double secs = std::chrono::duration<double>(stop - start).count();
+	return Object("seconds",secs)("requests_per_sec",secs > 0?count/secs:0.0);
+}
+
+int main(int argc, char **argv) {
+
+	std::vector<std::string> lines = argc > 1?loadSession(argv[1]):generateSession();
+	unsigned int repeat = argc > 2?std::atoi(argv[2]):10;
+
+	QueryServer qserver("replay");
+	registerViews(qserver, lines);
+
+	std::size_t count;
+	std::string fname = createSessionFile(lines, repeat, count);
+
+	Value fdres = measure(count, [&]{
+		int fdin = open(fname.c_str(), O_RDONLY);
+		int fdout = open("/dev/null", O_WRONLY);
+		qserver.runDispatch(fdin, fdout);
+		close(fdin);
+		close(fdout);
+	});
+
+	Value streamres = measure(count, [&]{
+		std::ifstream in(fname);
+		std::ofstream out("/dev/null");
+		qserver.runDispatch(in, out);
+	});
+
+	unlink(fname.c_str());
+
+	Value result = Object("benchmark","qserver_replay")
+		("requests",count)
+		("fd",fdres)
+		("stream",streamres);
+	result.toStream(std::cout);
+	std::cout << std::endl;
+	return 0;
+}
@@ -31,22 +31,62 @@
  *			 "encoding":"text/url/base64/base64url",
  *			 "prefix":"text...",
  *			 "suffix":"text..."
- *			 }, ... ]
+ *			 }, ... ],
+ *  "format":"lines/ndjson",
+ *  "batch_size":<events written before the output is flushed, default 1000>,
+ *  "buffer_size":<size of the output buffer in bytes, default 1MB>,
+ *  "flush_interval":<milliseconds without events, or age of the oldest unflushed event, after which the output is flushed, default 100>,
+ *  "databases":["db1","db2",...] or {"prefix":"<prefix of names>", "follow":true/false},
+ *  "journal":"<journal file, replaces the statfile>",
+ *  "journal_sync_events":<count of checkpoints after which the journal is synced, default 0 - not used>,
+ *  "journal_sync_interval":<milliseconds after which the journal is synced, default 1000>
  *  }
+ *
+ *  In the "lines" format (default), every output item is written on its own line. In
+ *  the "ndjson" format, every event is written as single line. It contains a JSON array of
+ *  the output items (prefix and suffix are ignored), or the whole event if there is no output.
+ *
+ *  When "databases" is specified, the tool runs in the multi-database mode and "dbname" is
+ *  ignored. It monitors all listed databases, or all databases whose names start with the prefix.
+ *  With "follow", the tool also follows _db_updates, so it starts to monitor newly created
+ *  databases. Each event has the field "db" with the name of its database. The statfile
+ *  contains checkpoints of all databases.
+ *
+ *  The output is buffered. It is flushed after batch_size events, when the buffer is full, or
+ *  when the feed is idle. The statfile is updated after every flush, so it never refers
+ *  to events which were not written yet.
+ *
+ *  The statfile is rewritten and synced on every update. With "journal", the checkpoints
+ *  are appended to the journal instead, and the journal is synced as a group after
+ *  journal_sync_events checkpoints, or after journal_sync_interval milliseconds (or both),
+ *  and always on exit. Events written after the last sync can be repeated after a crash.
+ *  The checkpoints are stored under names of the databases.
  */
 #include <fcntl.h>
 #include <unistd.h>
+#include <cerrno>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <csignal>
 #include <exception>
 #include <fstream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <set>
 #include <thread>
+#include <vector>
 #include <sys/file.h>
 
 #include <imtjson/value.h>
 #include <imtjson/object.h>
 #include "../couchit/changeevent.h"
 #include "../couchit/changes.h"
+#include "../couchit/checkpointJournal.h"
 #include "../couchit/couchDB.h"
+#include "../couchit/exception.h"
 #include "../couchit/view.h"
 #include "../imtjson/src/imtjson/object.h"
 #include "../shared/stringview.h"
@@ -110,43 +150,325 @@ static couchit::Config loadDBConfig(Value js) {
 	return cfg;
 }
 
-static void processChange(Value ev, Value cfg) {
+enum class Encoding {
+	json, text, url, base64, base64url
+};
+
+///Output item with pre-resolved path and encoding
+struct OutputItem {
+	std::optional<json::PPath> path;
+	Encoding encoding = Encoding::json;
+	std::string prefix;
+	std::string suffix;
+};
+
+///Output specification compiled from the configuration
+struct OutputPlan {
+	std::vector<OutputItem> items;
+	bool hasOutput = false;
+	bool ndjson = false;
+};
+
+static OutputPlan compileOutput(Value cfg) {
+	OutputPlan plan;
 	Value output = cfg["output"];
-	if (output.type() == json::array) {
-		for (Value item: output) {
-			Value path = item["path"];
-			Value root = ev;
-			if (path.hasValue()) {
-				auto ppath = json::PPath::fromValue(path);
-				root = root[ppath];
-			}
-			StrViewA encoding = item["encoding"].getValueOrDefault("json");
-			StrViewA prefix = item["prefix"].getString();
-			StrViewA suffix = item["suffix"].getString();
-			std::cout<<prefix;
-			if (encoding == "text") std::cout << root.toString();
-			else if (encoding == "url") std::cout << json::urlEncoding->encodeBinaryValue(
-					BinaryView(root.toString().str())).toString();
-			else if (encoding == "base64") std::cout << json::base64->encodeBinaryValue(
-					BinaryView(root.toString().str())).toString();
-			else if (encoding == "base64url") std::cout << json::base64url->encodeBinaryValue(
-					BinaryView(root.toString().str())).toString();
-			else {
-				root.toStream(std::cout);
+	plan.hasOutput = output.type() == json::array;
+	plan.ndjson = cfg["format"].getString() == "ndjson";
+	for (Value item: output) {
+		OutputItem itm;
+		Value path = item["path"];
+		if (path.hasValue()) itm.path.emplace(json::PPath::fromValue(path));
+		StrViewA encoding = item["encoding"].getValueOrDefault("json");
+		if (encoding == "text") itm.encoding = Encoding::text;
+		else if (encoding == "url") itm.encoding = Encoding::url;
+		else if (encoding == "base64") itm.encoding = Encoding::base64;
+		else if (encoding == "base64url") itm.encoding = Encoding::base64url;
+		itm.prefix = item["prefix"].getString();
+		itm.suffix = item["suffix"].getString();
+		plan.items.push_back(std::move(itm));
+	}
+	return plan;
+}
+
+///Buffered writer to a file descriptor
+/** Data are written to the descriptor only by the function flush() */
+class FdWriter {
+public:
+	FdWriter(int fd, std::size_t capacity):fd(fd),capacity(capacity) {
+		buffer.reserve(capacity+4096);
+	}
+
+	void put(char c) {buffer.push_back(c);}
+	void write(StrViewA text) {buffer.insert(buffer.end(), text.data, text.data+text.length);}
+	bool empty() const {return buffer.empty();}
+	bool full() const {return buffer.size() >= capacity;}
+
+	void flush() {
+		const char *p = buffer.data();
+		std::size_t remain = buffer.size();
+		while (remain) {
+			ssize_t w = ::write(fd, p, remain);
+			if (w < 0) {
+				int e = errno;
+				if (e == EINTR) continue;
+				throw couchit::SystemException("Unable to write output", e);
 			}
-			std::cout << suffix;
-			std::cout << std::endl;
+			p += w;
+			remain -= w;
 		}
+		buffer.clear();
+	}
+
+protected:
+	int fd;
+	std::size_t capacity;
+	std::vector<char> buffer;
+};
+
+static Value resolve(const OutputItem &item, const Value &ev) {
+	if (item.path) return ev[*item.path];
+	return ev;
+}
+
+static Value encode(Encoding encoding, const Value &root) {
+	switch (encoding) {
+	case Encoding::text: return root.toString();
+	case Encoding::url: return json::urlEncoding->encodeBinaryValue(BinaryView(root.toString().str())).toString();
+	case Encoding::base64: return json::base64->encodeBinaryValue(BinaryView(root.toString().str())).toString();
+	case Encoding::base64url: return json::base64url->encodeBinaryValue(BinaryView(root.toString().str())).toString();
+	default: return root;
+	}
+}
+
+static void writeJson(FdWriter &out, const Value &v) {
+	v.serialize([&](char c){out.put(c);});
+}
+
+static void processChange(const Value &ev, const OutputPlan &plan, FdWriter &out) {
+	if (!plan.hasOutput) {
+		writeJson(out, ev);
+		out.put('\n');
+	} else if (plan.ndjson) {
+		out.put('[');
+		bool sep = false;
+		for (const OutputItem &item: plan.items) {
+			if (sep) out.put(',');
+			writeJson(out, encode(item.encoding, resolve(item, ev)));
+			sep = true;
+		}
+		out.write("]\n");
 	} else {
-		ev.toStream(std::cout);
-		std::cout << std::endl;
+		for (const OutputItem &item: plan.items) {
+			Value root = resolve(item, ev);
+			out.write(item.prefix);
+			if (item.encoding == Encoding::json) writeJson(out, root);
+			else out.write(encode(item.encoding, root).getString());
+			out.write(item.suffix);
+			out.put('\n');
+		}
+	}
+}
+
+///Writes events of all feeds to the output and maintains the statfile
+/**
+ * The output is flushed after batch_size events, when the buffer is full, when there
+ * were no events for flush_interval, or when the oldest unflushed event is older than
+ * flush_interval (so a steady trickle of events doesn't delay the output). The statfile (or the journal) is updated after every
+ * flush, so it is never ahead of the output.
+ */
+class FeedOutput {
+public:
+	///Constructs the output
+	/**
+	 * @param cfg configuration
+	 * @param statFd descriptor of the statfile (0 if not used)
+	 * @param stat content of the statfile. In the multi-database mode, it is an object
+	 * which contains checkpoint of each database
+	 * @param multiDb true for multi-database mode
+	 * @param journal journal which receives checkpoints instead of the statfile (can be nullptr)
+	 */
+	FeedOutput(Value cfg, int statFd, Value stat, bool multiDb, couchit::PCheckpointJournal journal)
+		:plan(compileOutput(cfg))
+		,out(1, cfg["buffer_size"].getValueOrDefault(std::size_t(1024*1024)))
+		,batchSize(cfg["batch_size"].getValueOrDefault(std::size_t(1000)))
+		,flushInterval(cfg["flush_interval"].getValueOrDefault(std::size_t(100)))
+		,statFd(statFd)
+		,multiDb(multiDb)
+		,journal(journal)
+	{
+		if (multiDb) {
+			for (Value v: stat) {
+				StrViewA k = v.getKey();
+				seqs[std::string(k.data, k.length)] = v;
+			}
+		}
+		flusher = std::thread([this]{flushWorker();});
+	}
+
+	~FeedOutput() {
+		{
+			std::unique_lock<std::mutex> _(lock);
+			running = false;
+			try {
+				flushOutput();
+			} catch (std::exception &e) {
+				std::cerr << "Output exception: " << e.what() << std::endl;
+			}
+		}
+		flushSignal.notify_all();
+		flusher.join();
+	}
+
+	///Writes the event
+	/**
+	 * @param ev change event
+	 * @param dbname name of the source database. In the multi-database mode, it is
+	 * put into the field "db" of the event
+	 */
+	void write(const Value &ev, const std::string &dbname) {
+		std::unique_lock<std::mutex> _(lock);
+		if (multiDb) {
+			processChange(ev.replace("db", StrViewA(dbname)), plan, out);
+			seqs[dbname] = ev["seq"];
+		} else {
+			processChange(ev, plan, out);
+			lastSeq = ev["seq"];
+			if (journal != nullptr) seqs[dbname] = lastSeq;
+		}
+		if (journal != nullptr) changed.insert(dbname);
+		++eventCounter;
+		if (pendingEvents == 0) firstPending = std::chrono::steady_clock::now();
+		if (++pendingEvents >= batchSize || out.full()) flushOutput();
+	}
+
+protected:
+	OutputPlan plan;
+	FdWriter out;
+	std::size_t batchSize;
+	std::chrono::milliseconds flushInterval;
+	int statFd;
+	bool multiDb;
+	couchit::PCheckpointJournal journal;
+
+	std::mutex lock;
+	std::condition_variable flushSignal;
+	std::size_t pendingEvents = 0;
+	std::size_t eventCounter = 0;
+	std::chrono::steady_clock::time_point firstPending;
+	Value lastSeq;
+	std::map<std::string, Value> seqs;
+	std::set<std::string> changed;
+	bool running = true;
+	std::thread flusher;
+
+	void flushOutput() {
+		out.flush();
+		if (pendingEvents) {
+			if (journal != nullptr) {
+				//the journal coalesces the checkpoints and syncs them by own policy
+				for (auto &&x: changed) journal->store(StrViewA(x), seqs[x]);
+				changed.clear();
+			} else if (multiDb) {
+				Object st;
+				for (auto &&x: seqs) st.set(x.first, x.second);
+				setStat(statFd, st);
+			} else if (lastSeq.defined()) {
+				setStat(statFd, lastSeq);
+			}
+		}
+		pendingEvents = 0;
+	}
+
+	void flushWorker() {
+		std::unique_lock<std::mutex> _(lock);
+		std::size_t lastCounter = eventCounter;
+		while (running) {
+			flushSignal.wait_for(_, flushInterval);
+			if (pendingEvents && (eventCounter == lastCounter
+					|| std::chrono::steady_clock::now() - firstPending >= flushInterval)) {
+				try {
+					flushOutput();
+				} catch (std::exception &e) {
+					std::cerr << "Output exception: " << e.what() << std::endl;
+				}
+			}
+			lastCounter = eventCounter;
+		}
+	}
+};
+
+static void configureFeed(couchit::ChangesFeed &feed, Value cfg, Value since) {
+	feed.since(since);
+	feed.includeDocs(cfg["include_docs"].getBool());
+	Value flt = cfg["filter"];
+	if (flt.hasValue()) {
+		feed.setFilter(couchit::Filter(flt.getString()));
+		Value query = cfg["query"];
+		if (query.type() == json::object) {
+			for (Value v: query) {
+				feed.arg(v.getKey(),v);
+			}
+		}
 	}
+	feed.setTimeout((std::size_t)-1);
 }
 
-std::function<void()> cancelFn;
+///Reads changes of single database in own thread
+class DBWatcher {
+public:
+	DBWatcher(const couchit::Config &dbcfg, Value cfg, Value since, FeedOutput &out)
+		:db(dbcfg)
+		,feed(db.createChangesFeed())
+		,name(dbcfg.databaseName)
+		,running(true)
+	{
+		configureFeed(feed, cfg, since);
+		thr = std::thread([this, &out]{run(out);});
+	}
+
+	void stop() {
+		running = false;
+		feed.cancelWait();
+	}
+
+	~DBWatcher() {
+		stop();
+		thr.join();
+	}
+
+protected:
+	CouchDB db;
+	couchit::ChangesFeed feed;
+	std::string name;
+	std::atomic<bool> running;
+	std::thread thr;
+
+	void run(FeedOutput &out) {
+		while (running) {
+			try {
+				feed >> [&](const Value &ev) {
+					out.write(ev, name);
+					return running.load();
+				};
+			} catch (std::exception &e) {
+				if (!running) break;
+				std::cerr << "Read feed exception: " << name << ": " << e.what() << std::endl;
+				for (int i = 0; i < 100 && running; i++) {
+					std::this_thread::sleep_for(std::chrono::milliseconds(100));
+				}
+			}
+		}
+	}
+};
+
+static std::atomic<bool> nosign(true);
 
 static void markSignal(int) {
-	if (cancelFn != nullptr) cancelFn();
+	nosign = false;
+}
+
+static bool isWatched(StrViewA dbname, StrViewA prefix) {
+	return !dbname.empty() && dbname[0] != '_' && dbname.substr(0, prefix.length) == prefix;
 }
 
 int main(int argc, char **argv) {
@@ -159,51 +481,99 @@ int main(int argc, char **argv) {
 
 		Value cfg = loadConfig(argv[1]);
 		std::string statfile = cfg["statfile"].getString();
-		Value since = getStat(statfile,cfg["since"]);
-		int fd = lockStatFile(statfile);
-
-
-		auto dbcfg = loadDBConfig(cfg);
-		CouchDB db(dbcfg);
-
-		auto feed = db.createChangesFeed();
-		feed.since(since);
-		feed.includeDocs(cfg["include_docs"].getBool());
-		Value flt = cfg["filter"];
-		if (flt.hasValue()) {
-			feed.setFilter(couchit::Filter(flt.getString()));
-			Value query = cfg["query"];
-			if (query.type() == json::object) {
-				for (Value v: query) {
-					feed.arg(v.getKey(),v);
-				}
-			}
+		std::string journalFile = cfg["journal"].getString();
+		Value databases = cfg["databases"];
+		bool multiDb = databases.defined();
+		couchit::PCheckpointJournal journal;
+		Value stat;
+		if (!journalFile.empty()) {
+			couchit::CheckpointJournal::Policy policy;
+			policy.records = cfg["journal_sync_events"].getValueOrDefault(std::size_t(0));
+			policy.interval = std::chrono::milliseconds(
+					cfg["journal_sync_interval"].getValueOrDefault(std::size_t(1000)));
+			journal = new couchit::CheckpointJournal(journalFile, policy);
+			stat = journal->loadAll();
+			statfile.clear();
+		} else {
+			stat = getStat(statfile,multiDb?Value(json::object):cfg["since"]);
 		}
-
-		bool nosign = true;
-		cancelFn = [&]{
-			nosign = false;
-			feed.cancelWait();
-		};
+		bool keyedStat = multiDb || journal != nullptr;
+		int fd = lockStatFile(statfile);
 
 		signal(SIGTERM, &markSignal);
 		signal(SIGHUP, &markSignal);
 		signal(SIGINT, &markSignal);
 
-		feed.setTimeout(50000);
-		while (nosign) {
-			try {
-				auto chg = feed.exec();
-				for (Value ev: chg) {
-					processChange(ev, cfg);
+		auto dbcfg = loadDBConfig(cfg);
+		{
+			FeedOutput out(cfg, fd, stat, multiDb, journal);
+			std::map<std::string, std::unique_ptr<DBWatcher> > watchers;
+
+			auto addWatcher = [&](StrViewA name) {
+				std::string n(name.data, name.length);
+				if (watchers.find(n) != watchers.end()) return;
+				couchit::Config c = dbcfg;
+				c.databaseName = n;
+				Value since = keyedStat?stat[name]:stat;
+				if (!since.defined()) since = cfg["since"];
+				watchers[n] = std::unique_ptr<DBWatcher>(new DBWatcher(c, cfg, since, out));
+			};
+
+			if (!multiDb) {
+				addWatcher(dbcfg.databaseName);
+				while (nosign) std::this_thread::sleep_for(std::chrono::milliseconds(200));
+			} else if (databases.type() == json::array) {
+				for (Value d: databases) addWatcher(d.getString());
+				while (nosign) std::this_thread::sleep_for(std::chrono::milliseconds(200));
+			} else {
+				//discover databases by the prefix and follow _db_updates
+				StrViewA prefix = databases["prefix"].getString();
+				bool follow = databases["follow"].getBool();
+				couchit::Config scfg = dbcfg;
+				scfg.databaseName.clear();
+				CouchDB server(scfg);
+				Value updSince = "now";
+				{
+					CouchDB::PConnection conn = server.getConnection("/_all_dbs");
+					for (Value d: server.requestGET(conn, nullptr, CouchDB::flgDisableCache)) {
+						if (isWatched(d.getString(), prefix)) addWatcher(d.getString());
+					}
+				}
+				while (nosign) {
+					if (!follow) {
+						std::this_thread::sleep_for(std::chrono::milliseconds(200));
+						continue;
+					}
+					try {
+						CouchDB::PConnection conn = server.getConnection("/_db_updates");
+						conn->add("feed","longpoll");
+						conn->add("timeout",std::size_t(5000));
+						conn->add("since",updSince.toString());
+						Value res = server.requestGET(conn, nullptr, CouchDB::flgDisableCache);
+						for (Value r: res["results"]) {
+							StrViewA name = r["db_name"].getString();
+							if (!isWatched(name, prefix)) continue;
+							StrViewA type = r["type"].getString();
+							if (type == "created") {
+								addWatcher(name);
+							} else if (type == "deleted") {
+								watchers.erase(std::string(name.data, name.length));
+							}
+						}
+						updSince = res["last_seq"];
+					} catch (std::exception &e) {
+						std::cerr << "Read _db_updates exception: " << e.what() << std::endl;
+						for (int i = 0; i < 100 && nosign; i++) {
+							std::this_thread::sleep_for(std::chrono::milliseconds(100));
+						}
+					}
 				}
-				setStat(fd,feed.getLastSeq());
-			} catch (std::exception &e) {
-				std::cerr << "Read feed exception: " << e.what() << std::endl;
-				std::this_thread::sleep_for(std::chrono::seconds(10));
 			}
-		}
 
+			for (auto &&w: watchers) w.second->stop();
+			watchers.clear();
+		}
+		if (journal != nullptr) journal->commit();
 
 		close(fd);
 		return 0;
@@ -216,5 +586,3 @@ int main(int argc, char **argv) {
 
 
 }
-
-
@@ -10,6 +10,7 @@
 #include <imtjson/binary.h>
 #include <imtjson/stringValue.h>
 #include <imtjson/parser.h>
+#include "minihttp/netio.h"
 
 namespace couchit {
 
@@ -24,15 +25,22 @@ String AttachmentDataRef::toBase64() const {
 
 Value AttachmentDataRef::toInline() const {
 	return Object("content_type",contentType)
-			   ("data",toBase64());
+			   ("data",Value(BinaryView(*this), json::base64));
 }
 
 AttachmentData::AttachmentData(const Value &attachment)
 	:AttachmentDataRef(BinaryView(nullptr, 0), attachment["content_type"].getString())
 {
 
-	AttachmentData x = fromBase64(attachment["data"].getString(),StrViewA());
-	bindata = x.bindata;
+	Value data = attachment["data"];
+	if (data.flags() & json::binaryString) {
+		bindata = String(data);
+	} else {
+		AttachmentData x = fromBase64(data.getString(),StrViewA());
+		bindata = x.bindata;
+	}
+	BinaryView &x = (*this);
+	x = BinaryView(bindata.str());
 }
 
 AttachmentData::AttachmentData(Download&& dwn):AttachmentDataRef(BinaryView(0,0),dwn.contentType.str())
@@ -72,6 +80,27 @@ String Upload::finish() {
 
 }
 
+std::size_t Download::Source::readTo(int fd) {
+	std::size_t done = 0;
+	if (!put_back_content.empty()) {
+		NetworkConnection::writeToFd(fd, put_back_content);
+		done = put_back_content.length;
+		put_back_content = BinaryView();
+	}
+	return done + impl_readTo(fd);
+}
+
+std::size_t Download::Source::impl_readTo(int fd) {
+	std::size_t done = 0;
+	BinaryView b = impl_read();
+	while (!b.empty()) {
+		NetworkConnection::writeToFd(fd, b);
+		done += b.length;
+		b = impl_read();
+	}
+	return done;
+}
+
 Value Download::json() {
 	BinaryView data;
 	std::size_t pos = 0;
@@ -33,6 +33,11 @@ public:
 	///Converts data to base64 string.
 	String toBase64() const;
 
+	///Converts data to inline attachment
+	/** Data are stored as binary value. They are encoded to base64 when the document
+	 * is serialized to JSON, however CouchDB::put() and CouchDB::bulkUpload() send
+	 * them as binary parts of multipart/related request without encoding
+	 */
 	Value toInline() const;
 
 };
@@ -139,6 +144,13 @@ public:
 			put_back_content = put_back;
 		};
 
+		///Writes rest of the content to the descriptor
+		/**
+		 * @param fd target descriptor (file or pipe)
+		 * @return count of bytes written
+		 */
+		std::size_t readTo(int fd);
+
 
 	protected:
 		BinaryView put_back_content;
@@ -153,6 +165,17 @@ public:
 		 * @note this function doesn't process putBack data.
 		 */
 		virtual BinaryView impl_read() = 0;
+
+		///Writes rest of the stream to the descriptor
+		/** Default implementation copies data read by impl_read(). Sources
+		 * connected to the network can transfer data without copying
+		 *
+		 * @param fd target descriptor
+		 * @return count of bytes written
+		 *
+		 * @note this function doesn't process putBack data.
+		 */
+		virtual std::size_t impl_readTo(int fd);
 };
 
 
@@ -188,6 +211,18 @@ public:
 		return sptr->read();
 	}
 
+	///Writes whole attachment to the descriptor
+	/**
+	 * Use this function to store large attachments. The memory usage is constant
+	 * and when it is possible, data are not copied through the user space.
+	 *
+	 * @param fd target descriptor (file or pipe)
+	 * @return count of bytes written
+	 */
+	std::size_t readTo(int fd) {
+		return sptr->readTo(fd);
+	}
+
 	///Load whole attachment into memory
 	std::vector<unsigned char> load() {
 		std::vector<unsigned char> buffer;
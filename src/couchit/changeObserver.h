@@ -1,5 +1,7 @@
 #pragma once
 
+#include <exception>
+#include <imtjson/stringview.h>
 #include "changeevent.h"
 
 
@@ -8,6 +10,9 @@ namespace couchit {
 
 class ChangeEvent;
 
+///Batch of change events delivered at once
+typedef json::StringView<ChangeEvent> ChangeEventBatch;
+
 
 class IChangeEventObserver {
 public:
@@ -23,6 +28,30 @@ public:
 	 */
 	virtual bool onEvent(const ChangeEvent &doc) = 0;
 
+	///Called on batch of changes
+	/**
+	 * The distributor delivers changes in batches as they are received from the database.
+	 * Default implementation calls onEvent() for every event in the batch. When onEvent()
+	 * throws an exception, the rest of the batch is still delivered and the first exception
+	 * is rethrown at the end. Override this function to process whole batch at once,
+	 * for example under a single lock
+	 *
+	 * @param events batch of change events
+	 * @retval true continue observing
+	 * @retval false stop observing, remove the observer
+	 */
+	virtual bool onEvents(const ChangeEventBatch &events) {
+		std::exception_ptr err;
+		for (std::size_t i = 0; i < events.length; i++) {
+			try {
+				if (!onEvent(events[i])) return false;
+			} catch (...) {
+				if (!err) err = std::current_exception();
+			}
+		}
+		if (err) std::rethrow_exception(err);
+		return true;
+	}
 
 	///Requests for last known seqID
 	/** It is called when the ChangesDistributor needs to know where to start reading
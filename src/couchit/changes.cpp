@@ -169,6 +169,13 @@ static void stdLeaveObserver(IChangeEventObserver *) {
 
 }
 
+static std::vector<ChangeEvent> collectEvents(const json::Value &chg) {
+	std::vector<ChangeEvent> out;
+	out.reserve(chg.size());
+	for (json::Value v: chg) out.push_back(ChangeEvent(v));
+	return out;
+}
+
 ChangesDistributor::RegistrationID ChangesDistributor::add(IChangeEventObserver &observer) {
 	return add(PObserver(&observer, &stdLeaveObserver), {});
 }
@@ -198,10 +205,9 @@ ChangesDistributor::RegistrationID ChangesDistributor::add(PObserver &&observer,
 			//read next changes before processing these onces
 			//because processing can generate additional changes
 			Changes ch2 = db.receiveChanges(feedState);
-			for (ChangeEvent ev: chg) {
-				if (!observer->onEvent(ev)) {
-					return nullptr;
-				}
+			auto batch = collectEvents(chg);
+			if (!observer->onEvents(ChangeEventBatch(batch.data(), batch.size()))) {
+				return nullptr;
 			}
 			chg = ch2;
 
@@ -210,10 +216,11 @@ ChangesDistributor::RegistrationID ChangesDistributor::add(PObserver &&observer,
 		chg = db.receiveChanges(feedState);
 		while (!chg.empty()) {
 			Changes ch2 = db.receiveChanges(feedState);
-			for (ChangeEvent ev: chg) {
-				if (!observer->onEvent(ev)) {
-					return nullptr;
-				}
+			auto batch = collectEvents(chg);
+			if (!observer->onEvents(ChangeEventBatch(batch.data(), batch.size()))) {
+				return nullptr;
+			}
+			for (const ChangeEvent &ev: batch) {
 				filterOut[json::Value({ev.id, ev.revisions})].push_back(observer.get());
 			}
 			chg = ch2;
@@ -283,6 +290,49 @@ void ChangesDistributor::broadcast(const ChangeEvent &doc) {
 	}
 }
 
+void ChangesDistributor::broadcast(const ChangeEventBatch &batch) {
+
+	std::vector<RegistrationID> toRemove;
+	std::unique_lock<std::recursive_mutex> _(lock);
+
+	//for each event, find list of observers, which already saw it
+	std::vector<const std::vector<const IChangeEventObserver *> *> flts;
+	if (!filterOut.empty()) {
+		flts.reserve(batch.length);
+		for (std::size_t i = 0; i < batch.length; i++) {
+			auto iter = filterOut.find(json::Value({batch[i].id, batch[i].revisions}));
+			flts.push_back(iter == filterOut.end()?nullptr:&iter->second);
+		}
+	}
+
+	std::vector<ChangeEvent> filtered;
+	for (auto &&x : observers) {
+		bool r;
+		try {
+			if (flts.empty()) {
+				r = x->onEvents(batch);
+			} else {
+				filtered.clear();
+				for (std::size_t i = 0; i < batch.length; i++) {
+					if (flts[i] == nullptr || std::find(flts[i]->begin(), flts[i]->end(), x.get()) == flts[i]->end())
+						filtered.push_back(batch[i]);
+				}
+				r = filtered.empty() || x->onEvents(ChangeEventBatch(filtered.data(), filtered.size()));
+			}
+		} catch (...) {
+			onException();
+			r = true;
+		}
+		if (!r) {
+			RegistrationID reg = x.get();
+			toRemove.push_back(reg);
+		}
+	}
+	for (auto &&x: toRemove) {
+		remove(x);
+	}
+}
+
 void ChangesDistributor::run() {
 
 	while (!feedState.canceled.load()) {
@@ -301,12 +351,11 @@ void ChangesDistributor::run() {
 					}
 				}
 			} else {
-				while (chg.hasItems()) {
-					try {
-						broadcast(chg.getNext());
-					} catch (...) {
-						onException();
-					}
+				try {
+					auto batch = collectEvents(chg);
+					broadcast(ChangeEventBatch(batch.data(), batch.size()));
+				} catch (...) {
+					onException();
 				}
 			}
 			filterOut.clear();
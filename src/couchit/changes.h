@@ -448,6 +448,7 @@ protected:
 	mutable std::recursive_mutex lock;
 
 	void broadcast(const ChangeEvent &doc);
+	void broadcast(const ChangeEventBatch &batch);
 
 
 	//class Distributor;
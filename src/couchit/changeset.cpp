@@ -5,7 +5,12 @@
  *      Author: ondra
  */
 
+#include <algorithm>
+#include <atomic>
 #include <ctime>
+#include <future>
+#include <memory>
+#include <mutex>
 #include "changeset.h"
 
 #include "document.h"
@@ -17,6 +22,9 @@
 //#include "validator.h"
 namespace couchit {
 
+///Commits smaller than this are always validated in the calling thread
+static const std::size_t parallelCommitThreshold = 256;
+
 Changeset::Changeset(CouchDB &db):db(&db) {
 }
 
@@ -41,26 +49,69 @@ Changeset& Changeset::commit(CouchDB& db) {
 
 	Value now = std::chrono::system_clock::to_time_t(std::chrono::system_clock::now());
 
-	Array docsToCommit;
-
 	const Validator *v  = db.getValidator();
-	for(auto &&item: scheduledDocs) {
-		Value doc = item;
+	std::size_t cnt = scheduledDocs.size();
+	std::vector<Value> prepared(cnt);
 
+	//the first failed document (in order of scheduling) is reported
+	std::mutex failLock;
+	std::size_t failIndex = cnt;
+	std::unique_ptr<Validator::Result> failResult;
+	std::atomic<std::size_t> failBound(cnt);
+
+	auto prepare = [&](std::size_t i) {
+		const Value &doc = scheduledDocs[i];
 		if (v) {
-			Validator::Result r = v->validateDoc(doc);;
-			if (!r) throw ValidationFailedException(r);
+			Validator::Result r = v->validateDoc(doc);
+			if (!r) {
+				std::lock_guard<std::mutex> _(failLock);
+				if (i < failIndex) {
+					failIndex = i;
+					failResult = std::make_unique<Validator::Result>(r);
+					failBound = i;
+				}
+				return;
+			}
 		}
-
-		Object adj(doc);
-
-		bool hasTm = doc[CouchDB::fldTimestamp].defined();
-		if (hasTm) {
-			adj.set(CouchDB::fldTimestamp,now);
+		//copy the document only when the timestamp is updated
+		if (doc[CouchDB::fldTimestamp].defined()) {
+			prepared[i] = doc.replace(CouchDB::fldTimestamp,now);
+		} else {
+			prepared[i] = doc;
+		}
+	};
+
+	std::size_t threads = db.getConfig().commitValidationThreads;
+	if (v == nullptr || threads < 2 || cnt < parallelCommitThreshold) {
+		for (std::size_t i = 0; i < cnt && failBound == cnt; i++) prepare(i);
+	} else {
+		//workers take blocks of documents. Documents after already failed document are skipped,
+		//but all documents before it are still validated, so the reported error is deterministic
+		static const std::size_t blockSize = 64;
+		std::atomic<std::size_t> nextBlock(0);
+		auto worker = [&] {
+			std::size_t b;
+			while ((b = nextBlock.fetch_add(blockSize)) < cnt) {
+				std::size_t e = std::min(b+blockSize, cnt);
+				for (std::size_t i = b; i < e && i < failBound; i++) prepare(i);
+			}
+		};
+		std::size_t workers = std::min<std::size_t>(threads, (cnt+blockSize-1)/blockSize);
+		std::vector<std::future<void> > helpers;
+		for (std::size_t i = 1; i < workers; i++) {
+			helpers.push_back(std::async(std::launch::async, worker));
 		}
+		worker();
+		for (auto &&f : helpers) f.get();
+	}
+	if (failResult) throw ValidationFailedException(*failResult);
 
-		docsToCommit.add(adj);
-		Value conflicts = adj["_conflicts"];
+	Array docsToCommit;
+	docsToCommit.reserve(cnt);
+	for (std::size_t i = 0; i < cnt; i++) {
+		const Value &doc = prepared[i];
+		docsToCommit.push_back(doc);
+		Value conflicts = doc["_conflicts"];
 		if (conflicts.defined()) {
 			for (Value s: conflicts) {
 				docsToCommit.push_back(Object("_id",doc["_id"])
@@ -89,6 +89,9 @@ public:
 	 * writes documents one-by-one and also rejects conflicts
 	 *
 	 * @return reference to the Changeset to create chains
+	 *
+	 * @note Large changesets can be validated by multiple threads, see
+	 * Config::commitValidationThreads
 	 */
 	Changeset &commit(CouchDB &db);
 
@@ -0,0 +1,302 @@
+/*
+ * checkpointJournal.cpp
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#include "checkpointJournal.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <cerrno>
+#include <cstdio>
+
+#include <imtjson/object.h>
+#include <imtjson/string.h>
+#include "checkpointFile.h"
+
+namespace couchit {
+
+using namespace json;
+
+static void appendRecord(std::string &out, const std::string &key, const Value &value) {
+	String ln = Value(Object("k",StrViewA(key))("v",value)).stringify();
+	out.append(ln.c_str(), ln.length());
+	out.push_back('\n');
+}
+
+static void syncDirectory(const std::string &fname) {
+	auto p = fname.rfind('/');
+	std::string dir = p == fname.npos?std::string("."):fname.substr(0,p+1);
+	int dfd = ::open(dir.c_str(), O_RDONLY|O_DIRECTORY|O_CLOEXEC);
+	if (dfd < 0) return;
+	fsync(dfd);
+	::close(dfd);
+}
+
+CheckpointJournal::CheckpointJournal(StrViewA fname):CheckpointJournal(fname, Policy()) {}
+
+CheckpointJournal::CheckpointJournal(StrViewA fname, const Policy &policy)
+	:fname(fname.data, fname.length)
+	,policy(policy)
+{
+	open();
+	if (policy.records || policy.interval.count()) {
+		writer = std::thread([this]{run();});
+	}
+}
+
+CheckpointJournal::~CheckpointJournal() {
+	{
+		std::unique_lock<std::mutex> _(lock);
+		finish = true;
+	}
+	wakeup.notify_all();
+	if (writer.joinable()) writer.join();
+	try {
+		flush();
+	} catch (...) {
+
+	}
+	::close(fd);
+}
+
+void CheckpointJournal::open() {
+	fd = ::open(fname.c_str(), O_RDWR|O_CREAT|O_APPEND|O_CLOEXEC, 0666);
+	if (fd < 0) {
+		int err = errno;
+		throw CheckpointIOException(String({"Failed to open the journal: ",fname}), err);
+	}
+	if (flock(fd, LOCK_EX|LOCK_NB)) {
+		int err = errno;
+		::close(fd);
+		throw CheckpointIOException(String({"The journal is locked by another process: ",fname}), err);
+	}
+
+	std::string data;
+	char buff[65536];
+	for(;;) {
+		ssize_t r = ::read(fd, buff, sizeof(buff));
+		if (r == 0) break;
+		if (r < 0) {
+			int err = errno;
+			if (err == EINTR) continue;
+			::close(fd);
+			throw CheckpointIOException(String({"Failed to read the journal: ",fname}), err);
+		}
+		data.append(buff, r);
+	}
+
+	//replay the journal, later records replace earlier. Damaged records (torn write) are skipped
+	std::size_t pos = 0;
+	for(;;) {
+		auto e = data.find('\n', pos);
+		if (e == data.npos) break;
+		StrViewA ln(data.data()+pos, e-pos);
+		pos = e+1;
+		try {
+			Value r = Value::fromString(ln);
+			StrViewA k = r["k"].getString();
+			Value v = r["v"];
+			if (v.defined()) state[std::string(k.data, k.length)] = v;
+			else state.erase(std::string(k.data, k.length));
+		} catch (...) {
+
+		}
+	}
+
+	try {
+		compactLk();
+	} catch (...) {
+		::close(fd);
+		throw;
+	}
+}
+
+Value CheckpointJournal::load(StrViewA key) const {
+	std::unique_lock<std::mutex> _(lock);
+	auto iter = state.find(std::string(key.data, key.length));
+	if (iter == state.end()) return json::undefined;
+	return iter->second;
+}
+
+Value CheckpointJournal::loadAll() const {
+	std::unique_lock<std::mutex> _(lock);
+	Object res;
+	for (auto &&x: state) res.set(StrViewA(x.first), x.second);
+	return res;
+}
+
+void CheckpointJournal::store(StrViewA key, const Value &value) {
+	std::unique_lock<std::mutex> _(lock);
+	std::string k(key.data, key.length);
+	if (value.defined()) state[k] = value;
+	else state.erase(k);
+	bool first = pending.empty();
+	pending[k] = value;
+	if (policy.records && ++unsynced >= policy.records) flushRequested = true;
+	if (first || flushRequested) wakeup.notify_all();
+	if (writeError) {
+		std::exception_ptr e = writeError;
+		writeError = nullptr;
+		std::rethrow_exception(e);
+	}
+}
+
+void CheckpointJournal::commit() {
+	flush();
+	std::unique_lock<std::mutex> _(lock);
+	writeError = nullptr;
+}
+
+void CheckpointJournal::flush() {
+	std::unique_lock<std::mutex> _(ioLock);
+	std::map<std::string, Value> batch;
+	bool compact;
+	{
+		std::unique_lock<std::mutex> __(lock);
+		std::swap(batch, pending);
+		flushRequested = false;
+		unsynced = 0;
+		compact = needCompact;
+	}
+	if (compact) {
+		//previous write failed, the tail of the journal can be damaged
+		//compaction writes the whole state including the batch
+		compactLk();
+		return;
+	}
+	if (batch.empty()) return;
+
+	std::string data;
+	for (auto &&x: batch) appendRecord(data, x.first, x.second);
+	try {
+		writeAll(fd, data);
+		syncFd(fd);
+	} catch (...) {
+		std::unique_lock<std::mutex> __(lock);
+		needCompact = true;
+		for (auto &&x: batch) pending.emplace(x.first, x.second);
+		throw;
+	}
+	fileSize += data.size();
+	if (fileSize > policy.compactSize) compactLk();
+}
+
+void CheckpointJournal::compactLk() {
+	std::string data;
+	{
+		std::unique_lock<std::mutex> _(lock);
+		for (auto &&x: state) appendRecord(data, x.first, x.second);
+		pending.clear();
+		unsynced = 0;
+	}
+
+	std::string tmpName = fname+".part";
+	int nfd = ::open(tmpName.c_str(), O_RDWR|O_CREAT|O_TRUNC|O_APPEND|O_CLOEXEC, 0666);
+	if (nfd < 0) {
+		int err = errno;
+		std::unique_lock<std::mutex> _(lock);
+		needCompact = true;
+		throw CheckpointIOException(String({"Failed to open the journal for writting: ",tmpName}), err);
+	}
+	try {
+		flock(nfd, LOCK_EX|LOCK_NB);
+		writeAll(nfd, data);
+		syncFd(nfd);
+		if (std::rename(tmpName.c_str(), fname.c_str())) {
+			int err = errno;
+			throw CheckpointIOException(String({"Failed to replace the journal: ",fname}), err);
+		}
+	} catch (...) {
+		::close(nfd);
+		::unlink(tmpName.c_str());
+		std::unique_lock<std::mutex> _(lock);
+		needCompact = true;
+		throw;
+	}
+	syncDirectory(fname);
+	::close(fd);
+	fd = nfd;
+	fileSize = data.size();
+	std::unique_lock<std::mutex> _(lock);
+	needCompact = false;
+}
+
+void CheckpointJournal::writeAll(int hfd, const std::string &data) {
+	const char *p = data.data();
+	std::size_t remain = data.size();
+	while (remain) {
+		ssize_t r = ::write(hfd, p, remain);
+		if (r < 0) {
+			int err = errno;
+			if (err == EINTR) continue;
+			throw CheckpointIOException(String({"Failed to write to the journal: ",fname}), err);
+		}
+		p += r;
+		remain -= r;
+	}
+}
+
+void CheckpointJournal::syncFd(int hfd) {
+	if (fdatasync(hfd)) {
+		int err = errno;
+		throw CheckpointIOException(String({"Failed to sync the journal: ",fname}), err);
+	}
+}
+
+void CheckpointJournal::run() {
+	std::unique_lock<std::mutex> _(lock);
+	while (!finish) {
+		if (pending.empty()) {
+			wakeup.wait(_, [&]{return finish || !pending.empty();});
+		} else if (flushRequested) {
+			//flush now
+		} else if (policy.interval.count()) {
+			wakeup.wait_for(_, policy.interval, [&]{return finish || flushRequested;});
+		} else {
+			wakeup.wait(_, [&]{return finish || flushRequested;});
+		}
+		if (finish) break;
+		if (pending.empty()) continue;
+		//the flush is requested or the interval elapsed
+		if (!flushRequested && policy.interval.count() == 0) continue;
+		_.unlock();
+		try {
+			flush();
+		} catch (...) {
+			_.lock();
+			writeError = std::current_exception();
+			//retry after interval, or after next requested flush
+			flushRequested = false;
+			continue;
+		}
+		_.lock();
+	}
+}
+
+
+class JournalCheckpoint: public AbstractCheckpoint {
+public:
+	JournalCheckpoint(PCheckpointJournal journal, StrViewA key)
+		:journal(journal),key(key.data, key.length) {}
+
+	virtual Value load() const override {
+		return journal->load(key);
+	}
+	virtual void store(const Value &res) override {
+		journal->store(key, res);
+	}
+
+protected:
+	PCheckpointJournal journal;
+	std::string key;
+};
+
+PCheckpoint journalCheckpoint(PCheckpointJournal journal, StrViewA key) {
+	return new JournalCheckpoint(journal, key);
+}
+
+}
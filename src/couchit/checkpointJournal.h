@@ -0,0 +1,129 @@
+/*
+ * checkpointJournal.h
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_COUCHIT_CHECKPOINTJOURNAL_H_
+#define SRC_COUCHIT_CHECKPOINTJOURNAL_H_
+
+#include <chrono>
+#include <condition_variable>
+#include <exception>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <imtjson/stringview.h>
+#include "abstractCheckpoint.h"
+
+namespace couchit {
+
+using json::StrViewA;
+
+///Stores checkpoints of many feeds into single append-only journal
+/**
+ * Each store() only updates the state in the memory. The changed records are appended
+ * to the journal and synced to the disk (fdatasync) by a background thread as a group, so
+ * many checkpoints cost single write and single sync. The caller chooses the trade-off
+ * between durability and latency through the Policy - the journal is synced after given
+ * count of stored records, after given time, or only by commit() and on shutdown.
+ *
+ * When the journal grows over the limit, it is compacted - the current state is written
+ * to a new file which replaces the journal. The journal is also compacted when it is opened.
+ *
+ * The journal is locked (flock) while it is opened, so two processes cannot write
+ * into the same journal.
+ *
+ * Use journalCheckpoint() to use the journal as the checkpoint of the MemView, or
+ * store the seq positions directly for the changes feeds.
+ */
+class CheckpointJournal: public RefCntObj {
+public:
+
+	struct Policy {
+		///Sync the journal after given count of stored records (0 - don't count)
+		std::size_t records = 0;
+		///Sync the journal after given time since the first unsynced record (0 - no timer)
+		std::chrono::milliseconds interval = std::chrono::milliseconds(1000);
+		///Compact the journal when it is larger than given size in bytes
+		std::size_t compactSize = 4*1024*1024;
+	};
+
+	///Opens the journal
+	/**
+	 * @param fname pathname of the journal. It is created when it doesn't exist
+	 * @param policy sync policy. If both records and interval are zero, the journal is synced
+	 *  only by the function commit() and when it is destroyed
+	 * @exception CheckpointIOException unable to open, lock or compact the journal
+	 */
+	CheckpointJournal(StrViewA fname, const Policy &policy);
+	CheckpointJournal(StrViewA fname);
+	///Destroys the journal, commits pending records
+	~CheckpointJournal();
+
+	///Returns the last stored value of the key (undefined if there is none)
+	Value load(StrViewA key) const;
+	///Returns all keys and their values as single object
+	Value loadAll() const;
+	///Stores value of the key
+	/**
+	 * The function doesn't wait for the I/O. The value is written according to the policy
+	 *
+	 * @exception CheckpointIOException the background writer failed to write the journal.
+	 */
+	void store(StrViewA key, const Value &value);
+	///Writes all pending records and syncs the journal
+	/**
+	 * When the function returns, all stored values are on the disk
+	 *
+	 * @exception CheckpointIOException failed to write the journal.
+	 */
+	void commit();
+
+	const std::string &getFileName() const {return fname;}
+
+protected:
+	std::string fname;
+	Policy policy;
+	int fd = -1;
+	std::size_t fileSize = 0;
+
+	mutable std::mutex lock;
+	///serializes writes of the journal, always locked before the 'lock'
+	std::mutex ioLock;
+	std::condition_variable wakeup;
+	std::map<std::string, Value> state;
+	std::map<std::string, Value> pending;
+	std::size_t unsynced = 0;
+	bool flushRequested = false;
+	bool needCompact = false;
+	bool finish = false;
+	std::exception_ptr writeError;
+	std::thread writer;
+
+	void open();
+	void compactLk();
+	void flush();
+	void writeAll(int hfd, const std::string &data);
+	void syncFd(int hfd);
+	void run();
+};
+
+typedef RefCntPtr<CheckpointJournal> PCheckpointJournal;
+
+///Creates checkpoint which stores its data into the journal under the given key
+/**
+ * @param journal the journal
+ * @param key key of the checkpoint
+ * @return checkpoint object
+ */
+PCheckpoint journalCheckpoint(PCheckpointJournal journal, StrViewA key);
+
+}
+
+
+
+#endif /* SRC_COUCHIT_CHECKPOINTJOURNAL_H_ */
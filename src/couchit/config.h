@@ -20,6 +20,7 @@ namespace couchit {
 class QueryCache;
 class Validator;
 class IIDGen;
+class IRequestObserver;
 
 
 struct AuthInfo {
@@ -75,9 +76,17 @@ struct Config {
 	Validator *validator = nullptr;
 
 	///Pointer to function that is responsible toUID generation
-	/** Pointer can be NULL, then default UID generator is used - See: DefaultUIDGen; */
+	/** Pointer can be NULL, then default UID generator is used - See: FastUIDGen; */
 	IIDGen *uidgen = nullptr;
 
+	///Pointer to request observer
+	/** The observer receives method, path template, traffic and timing of every request. It
+	 * can be NULL to disable instrumentation, which is default. See RequestStats for an
+	 * observer which aggregates requests into histograms. You have to keep pointer valid until
+	 * the CouchDB object is destroyed
+	 */
+	IRequestObserver *requestObserver = nullptr;
+
 	///Defines I/O timeout. Default value is 30 seconds.
 	/** I/O timeout is applied only for standard requests. It is not applied on pooling through
 	 * function CouchDB::listenChanges(). That function defines temporarily own timeout.
@@ -119,6 +128,25 @@ struct Config {
 	 */
 	std::size_t maxBulkSizeDocs = 1000;
 
+	///Maximum estimated size of single _bulk_docs request in bytes
+	/** Large documents split the request sooner than maxBulkSizeDocs is reached. The request
+	 * contains always at least one document. Set 0 to disable
+	 */
+	std::size_t maxBulkSizeBytes = 8*1024*1024;
+
+	///Maximum count of concurrent _bulk_docs requests of single split upload
+	unsigned int bulkUploadParallel = 4;
+
+	///Upload documents with binary attachments by multipart/related requests in bulkUpload
+	/** The _bulk_docs request cannot carry binary parts, so by default these documents are
+	 * sent by _bulk_docs and their attachments are encoded to base64. When this option is
+	 * enabled, each such document is uploaded by its own multipart/related PUT request
+	 * (up to bulkUploadParallel requests at once) and the rest by _bulk_docs. It saves
+	 * the base64 overhead for large attachments, but it costs a request per document.
+	 * Documents without _id receive an id generated by the client
+	 */
+	bool multipartBulkAttachments = false;
+
 	///Minimum count of documents sned by the _bulkd_doc request
 	/** There is no reason to set this value other than zero, unless you need to debug updates through
 	 * the couchdb's log. Bulk updates of size less then this value are send as standalone PUT requests, so they
@@ -135,6 +163,40 @@ struct Config {
 
 	///Specifies minimal poll interval for reading changes through receiveChanges
 	unsigned int minChangesPollInterval = 500;
+
+	///Requests compressed responses (gzip, deflate)
+	/** Compression reduces amount of transfered data, which helps on slow links, but it costs
+	 * some CPU time. Requires the library compiled with zlib, otherwise it is ignored.
+	 */
+	bool compressResponses = false;
+
+	///Compresses bodies of _bulk_docs requests larger than 4KB (gzip)
+	/** Requires the library compiled with zlib, otherwise it is ignored.
+	 */
+	bool compressBulkDocs = false;
+
+	///Minimal count of keys which activates the planner of keys() queries
+	/** Key lists of this size or larger are sorted, deduplicated and split into chunks small
+	 * enough to be sent as GET requests, so they can be served from the QueryCache. Missing
+	 * chunks are downloaded in parallel and the rows are returned in the requested order.
+	 * The planner is not used when the query has offset, limit, postprocessing or reduce
+	 * without grouping. Default value is 0, which disables the planner.
+	 *
+	 * @note The planner trades one large POST request for many small GET requests, which is
+	 * faster only when the chunks are likely served from the QueryCache.
+	 */
+	std::size_t keysPlannerThreshold = 0;
+
+	///Maximum count of concurrent requests issued by the planner of keys() queries
+	unsigned int keysPlannerParallel = 4;
+
+	///Count of threads which validate and prepare documents in Changeset::commit
+	/** Values 0 or 1 validate documents in the calling thread (default). When more threads
+	 * are used, the validation functions must be thread safe. Small commits are always
+	 * validated in the calling thread. When more documents fail the validation, the first
+	 * of them (in order of scheduling) is reported.
+	 */
+	unsigned int commitValidationThreads = 1;
 };
 
 
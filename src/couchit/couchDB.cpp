@@ -8,7 +8,11 @@
 #include <fstream>
 #include <assert.h>
 #include <couchit/validator.h>
+#include <algorithm>
+#include <atomic>
+#include <future>
 #include <mutex>
+#include <unordered_map>
 
 
 #include "changeset.h"
@@ -24,12 +28,17 @@
 #include "query.h"
 
 #include "changes.h"
+#include "collation.h"
 
 
 #include "defaultUIDGen.h"
 #include "queryCache.h"
+#include "requestObserver.h"
 
 #include "document.h"
+#include "jsonWriter.h"
+#include "lazyResult.h"
+#include "minihttp/compression.h"
 #include "showProc.h"
 #include "updateProc.h"
 
@@ -51,7 +60,7 @@ std::size_t CouchDB::maxSerializedKeysSizeForGETRequest = 1024;
 CouchDB::CouchDB(const Config& cfg)
 	:cfg(cfg)
 	,curConnections(0)
-	,uidGen(cfg.uidgen == nullptr?DefaultUIDGen::getInstance():*cfg.uidgen)
+	,uidGen(cfg.uidgen == nullptr?FastUIDGen::getInstance():*cfg.uidgen)
 	,queryable(*this)
 
 {
@@ -305,8 +314,11 @@ Upload CouchDB::putAttachment(const Value &document, const StrViewA &attachmentN
 
 	class UploadClass: public Upload::Target {
 	public:
-		UploadClass( PConnection &&urlline)
-			:http(urlline->http)
+		UploadClass( CouchDB &owner, PConnection &&urlline)
+			:owner(owner)
+			,http(urlline->http)
+			,observed(owner.cfg.requestObserver != nullptr)
+			,mark(observed?owner.markRequest(*urlline):RequestMark())
 			,out(http.beginBody())
 			,urlline(std::move(urlline))
 			,finished(false)
@@ -328,6 +340,10 @@ Upload CouchDB::putAttachment(const Value &document, const StrViewA &attachmentN
 
 				out(nullptr);
 				int status = http.send();
+				if (observed) {
+					urlline->responseTime = SteadyClock::now();
+					owner.reportRequest(*urlline, "PUT", status, mark);
+				}
 				if (status != 201) {
 
 
@@ -349,7 +365,10 @@ Upload CouchDB::putAttachment(const Value &document, const StrViewA &attachmentN
 		}
 
 	protected:
+		CouchDB &owner;
 		HttpClient &http;
+		bool observed;
+		RequestMark mark;
 		OutputStream out;
 		Value response;
 		PConnection urlline;
@@ -362,7 +381,7 @@ Upload CouchDB::putAttachment(const Value &document, const StrViewA &attachmentN
 		//send header
 		conn->http.setHeaders(Object("Content-Type",contentType)("Cookie",getToken()));
 		//create upload object
-		return Upload(new UploadClass(std::move(conn)));
+		return Upload(new UploadClass(*this, std::move(conn)));
 
 
 }
@@ -374,6 +393,40 @@ String CouchDB::putAttachment(const Value &document, const StrViewA &attachmentN
 	return upld.finish();
 }
 
+String CouchDB::putAttachment(const Value &document, const StrViewA &attachmentName, const StrViewA &contentType, int fd, std::uint64_t offset, std::size_t length) {
+
+	StrViewA documentId = document["_id"].getString();
+	StrViewA revId = document["_rev"].getString();
+	PConnection conn = getConnection();
+	conn->add(documentId);
+	conn->add(attachmentName);
+	if (!revId.empty()) conn->add("rev",revId);
+
+	lksqid.markOld();
+	return observeRequest(conn, "PUT", [&]{
+		HttpClient &http = conn->http;
+		http.open(conn->getUrl(),"PUT",true);
+		http.setHeaders(Object("Content-Type",contentType)("Cookie",getToken()));
+		int status = http.sendFile(fd, offset, length);
+		markResponse(conn);
+		if (status != 201) {
+			Value errorVal;
+			try{
+				errorVal = Value::parse(http.getResponse());
+			} catch (...) {
+
+			}
+			http.close();
+			StrViewA url(*conn);
+			throw RequestError(url,status, http.getStatusMessage(), errorVal);
+		} else {
+			Value v = Value::parse(http.getResponse());
+			http.close();
+			return String(v["rev"]);
+		}
+	});
+}
+
 
 Value CouchDB::genUIDValue() const {
 	LockGuard _(lock);
@@ -699,43 +752,47 @@ Changes CouchDB::receiveChanges(ChangesFeed& feed) {
 		}
 	}
 
-	int status = initChangesFeed(conn, feed);
-	if (feed.state.canceled) {
-		feed.state.cancelEpilog();
-		return Value(json::undefined);
-	}
+	StrViewA method = !feed.filterInUse && feed.docFilter.defined()?"POST":"GET";
+	return observeRequest(conn, method, [&]() -> Changes {
+		int status = initChangesFeed(conn, feed);
+		markResponse(conn);
+		if (feed.state.canceled) {
+			feed.state.cancelEpilog();
+			return Value(json::undefined);
+		}
 
-	try {
-		Value v;
-		if (status/100 != 2) {
-			handleUnexpectedStatus(conn);
-		} else {
-			InputStream stream = conn->http.getResponse();
-			try {
-				v = Value::parse(stream);
-			} catch (...) {
-				feed.state.errorEpilog();
-				return Value(json::undefined);
+		try {
+			Value v;
+			if (status/100 != 2) {
+				handleUnexpectedStatus(conn);
+			} else {
+				InputStream stream = conn->http.getResponse();
+				try {
+					v = Value::parse(stream);
+				} catch (...) {
+					feed.state.errorEpilog();
+					return Value(json::undefined);
+				}
+				conn->http.close();
+				feed.state.finishEpilog();
 			}
-			conn->http.close();
-			feed.state.finishEpilog();
-		}
 
-		Value results=v["results"];
-		feed.seqNumber = v["last_seq"];
-		{
-			SeqNumber l (feed.seqNumber);
-			LockGuard _(lock);
-			if (l > lksqid) lksqid = l;
-		}
+			Value results=v["results"];
+			feed.seqNumber = v["last_seq"];
+			{
+				SeqNumber l (feed.seqNumber);
+				LockGuard _(lock);
+				if (l > lksqid) lksqid = l;
+			}
 
-		return results;
+			return results;
 
 
-	} catch (...) {
-		feed.state.errorEpilog();
-		throw;
-	}
+		} catch (...) {
+			feed.state.errorEpilog();
+			throw;
+		}
+	});
 
 }
 
@@ -766,49 +823,56 @@ void CouchDB::receiveChangesContinuous(ChangesFeed& feed, ChangesFeedHandler &fn
 		}
 
 
-		int status = initChangesFeed(conn, feed);
-		if (feed.state.canceled) {
-			feed.state.cancelEpilog();
-			return;
-		}
+		//every connection of the feed is reported when it is finished
+		StrViewA method = !feed.filterInUse && feed.docFilter.defined()?"POST":"GET";
+		bool canceled = observeRequest(conn, method, [&]{
+			int status = initChangesFeed(conn, feed);
+			markResponse(conn);
+			if (feed.state.canceled) {
+				feed.state.cancelEpilog();
+				return true;
+			}
 
-		try {
+			try {
 
-			Value v;
-			if (status/100 != 2) {
-				handleUnexpectedStatus(conn);
-			} else {
+				Value v;
+				if (status/100 != 2) {
+					handleUnexpectedStatus(conn);
+				} else {
 
-				InputStream stream = conn->http.getResponse();
-				bool rep = true;
-				do {
-					v = Value::parse(stream);
-					Value lastSeq = v["last_seq"];
-					if (lastSeq.defined()) {
-						feed.seqNumber = lastSeq;
-						updateSeqNum(feed.seqNumber);
-						conn->http.close();
-						rep = false;
-					} else {
-						ChangeEvent chdoc(v);
-						feed.seqNumber = v["seq"];
-						if (!fn(chdoc)) {
-							conn->http.abort();
-							restartable = false;
-							rep = false;
-						}
-						if (restartable && std::chrono::steady_clock::now() > stop_time) {
-							conn->http.abort();
+					InputStream stream = conn->http.getResponse();
+					bool rep = true;
+					do {
+						v = Value::parse(stream);
+						Value lastSeq = v["last_seq"];
+						if (lastSeq.defined()) {
+							feed.seqNumber = lastSeq;
+							updateSeqNum(feed.seqNumber);
+							conn->http.close();
 							rep = false;
+						} else {
+							ChangeEvent chdoc(v);
+							feed.seqNumber = v["seq"];
+							if (!fn(chdoc)) {
+								conn->http.abort();
+								restartable = false;
+								rep = false;
+							}
+							if (restartable && std::chrono::steady_clock::now() > stop_time) {
+								conn->http.abort();
+								rep = false;
+							}
 						}
-					}
-				} while (rep);
-				feed.state.finishEpilog();
+					} while (rep);
+					feed.state.finishEpilog();
 
+				}
+			} catch (...) {
+				feed.state.errorEpilog();
 			}
-		} catch (...) {
-			feed.state.errorEpilog();
-		}
+			return false;
+		});
+		if (canceled) return;
 		updateSeqNum(feed.seqNumber);
 	} while (restartable && !feed.state.wasCanceledState);
 }
@@ -832,6 +896,10 @@ public:
 		return stream.read();
 	}
 
+	virtual std::size_t impl_readTo(int fd) override {
+		return conn->http.readResponseTo(fd);
+	}
+
 	~StreamDownload() {
 		conn->http.close();
 	}
@@ -844,13 +912,17 @@ protected:
 
 Download CouchDB::downloadAttachmentCont(PConnection &conn, const StrViewA &etag) {
 
-	return retry([&]{
+	//the observer measures the time to the headers, the body is read by the caller
+	return observeRequest(conn, "GET", [&]{return retry([&]{
 		conn->http.open(conn->getUrl(), "GET", true);
 		Object hdr;
 		hdr("Cookie", getToken());
+		//Content-Length is reported as length of the attachment, so it must not be compressed
+		hdr("Accept-Encoding","identity");
 		if (!etag.empty()) hdr("If-None-Match",etag);
 		conn->http.setHeaders(hdr);
 		int status = conn->http.send();
+		markResponse(conn);
 
 		if (status != 200 && status != 304) {
 
@@ -866,7 +938,7 @@ Download CouchDB::downloadAttachmentCont(PConnection &conn, const StrViewA &etag
 			if (status == 304) return Download(new EmptyDownload,ctx.getString(),etag.getString(),llen,true);
 			else return Download(new StreamDownload(conn->http.getResponse(),std::move(conn)),ctx.getString(),etag.getString(),llen,false);
 		}
-	});
+	});});
 
 }
 
@@ -894,6 +966,114 @@ CouchDB::Queryable::Queryable(CouchDB& owner):owner(owner) {
 
 
 Value CouchDB::Queryable::executeQuery(const QueryRequest& r) {
+	if (canPlanKeys(r)) return executeKeysPlan(r);
+	else return executeDirect(r);
+}
+
+bool CouchDB::Queryable::canPlanKeys(const QueryRequest &r) const {
+	std::size_t threshold = owner.cfg.keysPlannerThreshold;
+	if (threshold == 0 || r.mode != qmKeyList || r.keys.size() < threshold) return false;
+	//these options cannot be applied per chunk
+	if (r.postData.defined() || r.offset != 0 || r.limit != ((std::size_t)-1) || r.view.postprocess) return false;
+	//rows must be grouped by the keys
+	switch (r.reduceMode) {
+		case rmDefault:
+		case rmGroup:
+		case rmNoReduce: return true;
+		default: return false;
+	}
+}
+
+Value CouchDB::Queryable::executeKeysPlan(const QueryRequest &r) {
+
+	//sort and deduplicate keys, so similar requests are split to the same chunks
+	std::vector<Value> sorted;
+	sorted.reserve(r.keys.size());
+	for (Value k : Value(r.keys)) sorted.push_back(k);
+	std::sort(sorted.begin(), sorted.end(), [](const Value &a, const Value &b) {
+		return compareJson(a,b) < 0;
+	});
+	sorted.erase(std::unique(sorted.begin(), sorted.end(), [](const Value &a, const Value &b) {
+		return compareJson(a,b) == 0;
+	}), sorted.end());
+
+	//each chunk must fit to the GET request, because only GET requests are cached
+	std::vector<Array> chunks;
+	std::size_t chunkLen = 0;
+	for (auto &&k : sorted) {
+		std::size_t len = k.stringify().length()+1;
+		if (chunks.empty() || (chunkLen + len > maxSerializedKeysSizeForGETRequest && !chunks.back().empty())) {
+			chunks.push_back(Array());
+			chunkLen = 1;
+		}
+		chunks.back().push_back(k);
+		chunkLen += len;
+	}
+
+	//chunks served from the cache are resolved quickly, so workers continue with the next chunk
+	std::vector<Value> results(chunks.size());
+	std::atomic<std::size_t> nextChunk(0);
+	auto worker = [&] {
+		std::size_t i;
+		while ((i = nextChunk.fetch_add(1)) < chunks.size()) {
+			QueryRequest sub(r);
+			sub.keys = chunks[i];
+			sub.view.flags &= ~View::lazyRows;
+			results[i] = executeDirect(sub);
+		}
+	};
+
+	std::size_t workers = std::min<std::size_t>(std::max(owner.cfg.keysPlannerParallel,1U), chunks.size());
+	std::vector<std::future<void> > helpers;
+	for (std::size_t i = 1; i < workers; i++) {
+		helpers.push_back(std::async(std::launch::async, worker));
+	}
+	std::exception_ptr err;
+	try {
+		worker();
+	} catch (...) {
+		err = std::current_exception();
+	}
+	for (auto &&f : helpers) {
+		try {
+			f.get();
+		} catch (...) {
+			if (err == nullptr) err = std::current_exception();
+		}
+	}
+	if (err != nullptr) std::rethrow_exception(err);
+
+	//collect rows of each key - each key is in one chunk only, but its rows
+	//don't need to be consecutive in the chunk
+	std::unordered_map<Value, Array> index;
+	Value seq;
+	for (auto &&res : results) {
+		for (Value row : res["rows"]) {
+			index[row["key"]].push_back(row);
+		}
+		//report the oldest update_seq, because the result cannot be newer
+		Value s = res["update_seq"];
+		if (s.defined() && (!seq.defined() || SeqNumber(seq) > SeqNumber(s))) seq = s;
+	}
+
+	//stitch rows in requested order (duplicated keys are repeated as the server does)
+	Array rows;
+	for (Value k : Value(r.keys)) {
+		auto iter = index.find(k);
+		if (iter != index.end()) {
+			for (Value row : iter->second) rows.push_back(row);
+		}
+	}
+
+	Object out;
+	out("total_rows",results[0]["total_rows"])
+		("offset",0)
+		("rows",rows);
+	if (seq.defined()) out("update_seq",seq);
+	return out;
+}
+
+Value CouchDB::Queryable::executeDirect(const QueryRequest& r) {
 
 	SeqNumber lastSeq = owner.getLastKnownSeqNumber();
 	if (lastSeq.getRevId() == 0 || (lastSeq.isOld() && r.needUpdateSeq))
@@ -1021,20 +1201,37 @@ Value CouchDB::Queryable::executeQuery(const QueryRequest& r) {
 	}
 
 	Value result;
+	//postprocessing needs parsed result
+	CouchDB::Flags reqFlags = (r.view.flags & View::lazyRows) && !r.view.postprocess?CouchDB::flgRawJson:0;
 	if (!postBody.defined()) {
-		result = owner.requestGET(conn,0,0);
+		result = owner.requestGET(conn,0,reqFlags);
 	} else {
-		result = owner.requestPOST(conn,postBody,0,0);
+		result = owner.requestPOST(conn,postBody,0,reqFlags);
 	}
 	if (r.view.postprocess) result = r.view.postprocess(&owner, r.ppargs, result);
-	Value sq = result["update_seq"];
+	Value sq;
+	StrViewA rawSeq;
+	if (result.type() == json::string) {
+		//unparsed result, only update_seq is extracted from the text
+		rawSeq = LazyResult::findMember(result.getString(), "update_seq");
+		if (!rawSeq.empty()) sq = Value::fromString(rawSeq);
+	} else {
+		sq = result["update_seq"];
+	}
 	if (sq.defined()) {
 		SeqNumber l(sq);
 
 		if (l.getRevId() == 0) {
 			//HACK: https://github.com/apache/couchdb/issues/984
 			l = lastSeq;
-			result = result.replace("update_seq", l.toValue());
+			if (rawSeq.empty()) {
+				result = result.replace("update_seq", l.toValue());
+			} else {
+				StrViewA text = result.getString();
+				std::size_t ofs = rawSeq.data - text.data;
+				String newSeq = l.toValue().stringify();
+				result = String({text.substr(0, ofs), newSeq.str(), text.substr(ofs + rawSeq.length)});
+			}
 		}
 
 		LockGuard _(owner.lock);
@@ -1047,15 +1244,127 @@ Value CouchDB::Queryable::executeQuery(const QueryRequest& r) {
 
 
 
+///Estimates length of the serialized JSON without serializing it (escaping is ignored)
+static std::size_t estimateJsonSize(const Value &v) {
+	switch (v.type()) {
+	case json::string: return v.getString().length+2;
+	case json::number: return 24;
+	case json::boolean: return 5;
+	case json::array: {
+		std::size_t sz = 2;
+		for (Value x : v) sz += estimateJsonSize(x)+1;
+		return sz;
+	}
+	case json::object: {
+		std::size_t sz = 2;
+		for (Value x : v) sz += x.getKey().length+4+estimateJsonSize(x);
+		return sz;
+	}
+	default: return 4;
+	}
+}
+
+///Calls the function for all indexes from 0 to count-1 using given count of threads
+/**
+ * Indexes are taken in ascending order. When the function returns false or throws an exception,
+ * no other index is taken and the calls which are already running are finished. The exception
+ * is rethrown after all threads are finished
+ */
+template<typename Fn>
+static void forEachParallel(std::size_t count, unsigned int threads, Fn &&fn) {
+	std::atomic<std::size_t> next(0);
+	std::atomic<bool> stop(false);
+	auto worker = [&] {
+		std::size_t i;
+		while (!stop.load() && (i = next.fetch_add(1)) < count) {
+			bool cont;
+			try {
+				cont = fn(i);
+			} catch (...) {
+				stop = true;
+				throw;
+			}
+			if (!cont) stop = true;
+		}
+	};
+
+	std::size_t workers = std::min<std::size_t>(std::max(threads,1U), count);
+	std::vector<std::future<void> > helpers;
+	for (std::size_t i = 1; i < workers; i++) {
+		helpers.push_back(std::async(std::launch::async, worker));
+	}
+	std::exception_ptr err;
+	try {
+		worker();
+	} catch (...) {
+		err = std::current_exception();
+	}
+	for (auto &&f : helpers) {
+		try {
+			f.get();
+		} catch (...) {
+			if (err == nullptr) err = std::current_exception();
+		}
+	}
+	if (err != nullptr) std::rethrow_exception(err);
+}
+
 Value CouchDB::bulkUpload(const Value docs, bool replication ) {
 
-	if (docs.size() > cfg.maxBulkSizeDocs) {
+	std::vector<std::size_t> multipartIndex;
+	if (cfg.multipartBulkAttachments) {
+		for (std::size_t i = 0, cnt = docs.size(); i < cnt; i++) {
+			if (hasBinaryAttachments(docs[i])) multipartIndex.push_back(i);
+		}
+	}
+
+	if (!multipartIndex.empty()) {
+
+		//documents with binary attachments are uploaded by multipart/related PUT requests
+		//other documents are uploaded through the standard way
+		std::vector<Value> results(docs.size());
+		std::vector<std::size_t> plainIndex;
+		Array plain;
+
+		for (std::size_t i = 0, j = 0, cnt = docs.size(); i < cnt; i++) {
+			if (j < multipartIndex.size() && multipartIndex[j] == i) {
+				j++;
+			} else {
+				plainIndex.push_back(i);
+				plain.push_back(docs[i]);
+			}
+		}
+		if (!plain.empty()) {
+			Value r = bulkUpload(plain, replication);
+			for (std::size_t i = 0, cnt = plainIndex.size(); i < cnt; i++) {
+				results[plainIndex[i]] = r[i];
+			}
+		}
+
+		forEachParallel(multipartIndex.size(), cfg.bulkUploadParallel, [&](std::size_t k) {
+			std::size_t i = multipartIndex[k];
+			Value v = docs[i];
+			Value id = v["_id"];
+			if (id.type() != json::string) {
+				//PUT needs the id, generate it as the server does for POST
+				id = genUIDValue();
+				v = v.replace("_id", id);
+			}
+			try {
+				PConnection b = getConnection("");
+				if (replication) b->add("new_edits","false");
+				b->add(id.getString());
+				results[i] = requestMultipartPUT(b,v);
+			} catch (RequestError &e) {
+				results[i] = Object(e.getExtraInfo())("id",id);
+			}
+			return true;
+		});
 
-		auto splt = docs.splitAt(cfg.maxBulkSizeDocs);
-		Value res1 = bulkUpload(splt.first);
-		Value res2 = bulkUpload(splt.second);
-		Array res(res1);
-		res.addSet(res2);
+		lksqid.markOld();
+		Array res;
+		res.reserve(results.size());
+		for (auto &&x : results) res.push_back(x);
 		return res;
 
 	} else if (docs.size() < cfg.minBulkSizeDocs) {
@@ -1085,18 +1394,53 @@ Value CouchDB::bulkUpload(const Value docs, bool replication ) {
 
 	} else {
 
-		PConnection b = getConnection("_bulk_docs");
-		if (replication) b->add("new_edits","false");
+		//split documents to chunks limited by count and by estimated size
+		std::size_t maxDocs = std::max<std::size_t>(cfg.maxBulkSizeDocs,1);
+		std::vector<Array> chunks;
+		std::size_t chunkBytes = 0;
+		for (Value v : docs) {
+			std::size_t sz = cfg.maxBulkSizeBytes?estimateJsonSize(v):0;
+			if (chunks.empty() || chunks.back().size() >= maxDocs
+					|| (cfg.maxBulkSizeBytes && chunkBytes + sz > cfg.maxBulkSizeBytes && !chunks.back().empty())) {
+				chunks.push_back(Array());
+				chunkBytes = 0;
+			}
+			chunks.back().push_back(v);
+			chunkBytes += sz;
+		}
+
+		if (chunks.size() < 2) return bulkUploadChunk(docs, replication);
 
-		Object wholeRequest;
-		wholeRequest.set("docs", docs);
+		//chunks are uploaded in parallel through own connections. After a failure,
+		//no more chunks are started, the chunks in progress are finished and the first
+		//exception is thrown
+		std::vector<Value> results(chunks.size());
+		forEachParallel(chunks.size(), cfg.bulkUploadParallel, [&](std::size_t i) {
+			results[i] = bulkUploadChunk(chunks[i], replication);
+			return true;
+		});
 
-		Value r = requestPOST(b,wholeRequest,0,0);
-		lksqid.markOld();
-		return r;
+		Array res;
+		res.reserve(docs.size());
+		for (auto &&r : results) {
+			for (Value x : r) res.push_back(x);
+		}
+		return res;
 	}
 }
 
+Value CouchDB::bulkUploadChunk(const Value &docs, bool replication) {
+	PConnection b = getConnection("_bulk_docs");
+	if (replication) b->add("new_edits","false");
+
+	Object wholeRequest;
+	wholeRequest.set("docs", docs);
+
+	Value r = requestPOST(b,wholeRequest,0,cfg.compressBulkDocs?flgCompressBody:0);
+	lksqid.markOld();
+	return r;
+}
+
 void CouchDB::put(Document& doc) {
 	Value rev = put(Value(doc));
 	doc.setRev(rev);
@@ -1136,8 +1480,11 @@ CouchDB::PConnection CouchDB::getConnection(StrViewA resourcePath, bool fresh) {
 	if (cfg.databaseName.empty() && resourcePath.substr(0,1) != StrViewA("/"))
 		throw std::runtime_error("No database selected");
 
+	SteadyClock::duration queueWait = SteadyClock::duration::zero();
 	if (curConnections >= cfg.maxConnections) {
+		auto waitStart = SteadyClock::now();
 		connRelease.wait(_,[&]{return curConnections<cfg.maxConnections;});
+		queueWait = SteadyClock::now() - waitStart;
 	}
 
 	PConnection b(nullptr);
@@ -1162,7 +1509,9 @@ CouchDB::PConnection CouchDB::getConnection(StrViewA resourcePath, bool fresh) {
 		}
 
 	}
+	b->queueWait = queueWait;
 	b->http.setTimeout(cfg.iotimeout);
+	b->http.setCompression(cfg.compressResponses);
 	setUrl(b,resourcePath);
 	curConnections++;
 	return b;
@@ -1200,6 +1549,27 @@ Value CouchDB::parseResponseBin(PConnection& conn) {
 	return Value::parseBinary(conn->http.getResponse());
 }
 
+static Value readRawResponse(HttpClient &http) {
+	std::vector<char> data;
+	Value len = http.getHeaders()["Content-Length"];
+	if (len.defined()) data.reserve(len.getUInt());
+	InputStream rd = http.getResponse();
+	BinaryView b = rd.read();
+	while (!b.empty()) {
+		data.insert(data.end(), b.data, b.data+b.length);
+		b = rd.read();
+	}
+	return String(StrViewA(data.data(), data.size()));
+}
+
+///Converts value from the cache to the form requested by the flags
+static Value cachedForm(const Value &v, std::size_t flags) {
+	bool raw = (flags & CouchDB::flgRawJson) != 0;
+	if (raw && v.type() != json::string) return v.stringify();
+	if (!raw && v.type() == json::string) return Value::fromString(v.getString());
+	return v;
+}
+
 
 Value CouchDB::postRequest(PConnection& conn, const StrViewA &cacheKey, Value *headers, std::size_t flags) {
 	HttpClient &http = conn->http;
@@ -1219,7 +1589,7 @@ Value CouchDB::postRequest(PConnection& conn, const StrViewA &cacheKey, Value *h
 				}
 			}
 		} else if (ctt.getString() == "application/json") {
-			v = parseResponse(conn);
+			v = (flags & flgRawJson)?readRawResponse(http):parseResponse(conn);
 			if (!cacheKey.empty()) {
 				Value fld = http.getHeaders()["ETag"];
 				if (fld.defined()) {
@@ -1249,7 +1619,7 @@ Value CouchDB::postRequest(PConnection& conn, const StrViewA &cacheKey, Value *h
 
 Value CouchDB::requestGET(PConnection& conn, Value* headers, std::size_t flags) {
 
-	return retry([&]{
+	return observeRequest(conn, "GET", [&]{return retry([&]{
 		bool usecache = (flags & flgDisableCache) == 0 && cfg.cache != nullptr;
 
 		StrViewA path = conn->getUrl();
@@ -1286,7 +1656,7 @@ Value CouchDB::requestGET(PConnection& conn, Value* headers, std::size_t flags)
 			redirectRetry = false;
 			Object hdr(headers?*headers:Value());
 			if (!hdr["Accept"].defined()) {
-				hdr("Accept","application/binjson, application/json");
+				hdr("Accept",(flags & flgRawJson)?"application/json":"application/binjson, application/json");
 			}
 			if (cachedItem.isDefined()) {
 				hdr("If-None-Match", cachedItem.etag);
@@ -1294,9 +1664,11 @@ Value CouchDB::requestGET(PConnection& conn, Value* headers, std::size_t flags)
 			if ((flags & flgNoAuth) == 0) hdr("Cookie", getToken());
 
 			status = http.setHeaders(hdr).send();
+			markResponse(conn);
 			if (status == 304 && cachedItem.isDefined()) {
 				http.close();
-				return cachedItem.value;
+				conn->fromCache = true;
+				return cachedForm(cachedItem.value, flags);
 			}
 			if (status == 301 || status == 302 || status == 303 || status == 307) {
 				json::Value val = http.getHeaders()["Location"];
@@ -1311,7 +1683,7 @@ Value CouchDB::requestGET(PConnection& conn, Value* headers, std::size_t flags)
 		}
 		while (redirectRetry);
 		return postRequest(conn,cacheKey,headers,flags);
-	});
+	});});
 
 }
 
@@ -1333,25 +1705,77 @@ auto CouchDB::retry(Fn &&fn) -> decltype(std::declval<Fn>()()) {
 	}
 }
 
+CouchDB::RequestMark CouchDB::markRequest(Connection &conn) {
+	const IOStats::ThreadCounters &traffic = IOStats::thisThread();
+	RequestMark mark;
+	mark.start = SteadyClock::now();
+	mark.bytesSent = traffic.sendBytes;
+	mark.bytesReceived = traffic.recvBytes;
+	conn.responseTime = mark.start;
+	conn.fromCache = false;
+	return mark;
+}
+
+void CouchDB::reportRequest(Connection &conn, StrViewA method, int status, const RequestMark &mark) {
+	IRequestObserver *observer = cfg.requestObserver;
+	if (observer == nullptr) return;
+
+	const IOStats::ThreadCounters &traffic = IOStats::thisThread();
+	auto end = SteadyClock::now();
+	RequestInfo info;
+	info.method = method;
+	info.url = conn.getUrl();
+	info.pathTemplate = RequestInfo::makePathTemplate(info.url, cfg.baseUrl);
+	info.status = status;
+	info.bytesSent = traffic.sendBytes - mark.bytesSent;
+	info.bytesReceived = traffic.recvBytes - mark.bytesReceived;
+	info.queueWait = conn.queueWait;
+	info.timeToFirstByte = conn.responseTime - mark.start;
+	info.totalTime = end - mark.start;
+	info.notModified = info.status == 304;
+	info.fromCache = conn.fromCache;
+	observer->onRequest(info);
+}
+
+template<typename Fn>
+auto CouchDB::observeRequest(PConnection &conn, StrViewA method, Fn &&fn) -> decltype(std::declval<Fn>()()) {
+	if (cfg.requestObserver == nullptr) return fn();
+
+	//the function can move the connection away (for example to the Download)
+	Connection &c = *conn;
+	RequestMark mark = markRequest(c);
+	try {
+		auto res = fn();
+		reportRequest(c, method, c.http.getStatus(), mark);
+		return res;
+	} catch (const RequestError &e) {
+		reportRequest(c, method, e.getCode(), mark);
+		throw;
+	} catch (...) {
+		reportRequest(c, method, 0, mark);
+		throw;
+	}
+}
+
 
 Value CouchDB::requestPOST(PConnection& conn,
 		const Value& postData, Value* headers, std::size_t flags) {
-	return retry([&]{
+	return observeRequest(conn, "POST", [&]{return retry([&]{
 		return jsonPUTPOST(conn,true,postData,headers,flags);
-	});
+	});});
 }
 
 Value CouchDB::requestPUT(PConnection& conn, const Value& postData,
 		Value* headers, std::size_t flags) {
-	return retry([&]{
+	return observeRequest(conn, "PUT", [&]{return retry([&]{
 		return jsonPUTPOST(conn,false,postData,headers,flags);
-	});
+	});});
 }
 
 Value CouchDB::requestDELETE(PConnection& conn, Value* headers,
 		std::size_t flags) {
 
-	return retry([&]{
+	return observeRequest(conn, "DELETE", [&]{return retry([&]{
 		HttpClient &http = conn->http;
 		StrViewA path = conn->getUrl();
 
@@ -1363,13 +1787,60 @@ Value CouchDB::requestDELETE(PConnection& conn, Value* headers,
 		if ((flags & flgNoAuth) == 0) hdr("Cookie", getToken());
 
 		http.setHeaders(hdr).send();
+		markResponse(conn);
 		return postRequest(conn,StrViewA(),headers,flags);
-	});
+	});});
+}
+
+namespace {
+
+///Serializes the request body
+/** The body is serialized to the local buffer first. If it fits, it is sent with Content-Length.
+ * Otherwise the body stream is opened (chunked), content of the local buffer is sent as first part
+ * and the rest is serialized directly to the buffers of the body stream
+ */
+class BodyWriter: public JsonBlockWriter {
+public:
+	BodyWriter(std::function<OutputStream()> &&openBody):openBody(std::move(openBody)) {
+		wrpos = local;
+		wrend = local+sizeof(local);
+	}
+
+	bool isLocal() const {return bufBegin == nullptr;}
+	BinaryView getLocal() const {return BinaryView(local, wrpos-local);}
+
+	///Finishes and closes the body stream
+	void finish() {
+		if (bufBegin) {
+			out->commit(wrpos - bufBegin);
+			out(nullptr);
+			out = OutputStream(nullptr);
+		}
+	}
+
+protected:
+	std::function<OutputStream()> openBody;
+	OutputStream out = OutputStream(nullptr);
+	unsigned char *bufBegin = nullptr;
+	unsigned char local[4096];
+
+	virtual void nextBuffer(std::size_t reqSize) override {
+		if (bufBegin == nullptr) {
+			out = openBody();
+			out(BinaryView(local, wrpos-local));
+		} else {
+			out->commit(wrpos - bufBegin);
+		}
+		AbstractOutputStream::Buffer b = out->getBuffer(std::max<std::size_t>(reqSize, 32));
+		bufBegin = wrpos = b.buff;
+		wrend = b.buff + b.size;
+	}
+};
+
 }
 
 Value CouchDB::jsonPUTPOST(PConnection& conn, bool methodPost,
 		Value data, Value* headers, std::size_t flags) {
-	typedef std::uint8_t byte;
 
 	HttpClient &http = conn->http;
 	StrViewA path = conn->getUrl();
@@ -1378,43 +1849,107 @@ Value CouchDB::jsonPUTPOST(PConnection& conn, bool methodPost,
 	http.open(path,methodPost?"POST":"PUT",true);
 	Object hdr(headers?*headers:Value());
 	if (!hdr["Accept"].defined())
-		hdr("Accept","application/binjson, application/json");
+		hdr("Accept",(flags & flgRawJson)?"application/json":"application/binjson, application/json");
 	hdr("Content-Type","application/json");
 	if ((flags & flgNoAuth) == 0) hdr("Cookie", getToken());
 	http.setHeaders(hdr);
 
 	if (data.type() == json::undefined) {
 		http.send(StrViewA());
+		markResponse(conn);
 	} else {
-		bool hdrSent = false;
-		byte buffer[4096];
-		int bpos = 0;
-		OutputStream outstr(nullptr);
-
-
-		data.serialize([&](int i) {
-			buffer[bpos++] = (byte)i;
-			if (bpos == sizeof(buffer)) {
-				if (!hdrSent) {
-					outstr = http.beginBody();
-					hdrSent = true;
-				}
-				outstr(BinaryView(buffer,bpos));
-				bpos = 0;
+		BodyWriter wr([&] {
+			if ((flags & flgCompressBody) && isCompressionSupported()) {
+				hdr("Content-Encoding","gzip");
+				http.setHeaders(hdr);
+				return OutputStream(new DeflateOutputStream(http.beginBody()));
+			} else {
+				return http.beginBody();
 			}
 		});
-		if (hdrSent) {
-			if (bpos) {
-				outstr(BinaryView(buffer,bpos));
-			}
-			outstr(nullptr);
+		wr.write(data);
+		if (wr.isLocal()) {
+			BinaryView b = wr.getLocal();
+			http.send(b.data, b.length);
+		} else {
+			wr.finish();
+			http.send();
 		}
-		outstr = nullptr;
-		http.send(buffer,bpos);
+		markResponse(conn);
 	}
     return postRequest(conn,StrViewA(),headers,flags);
 }
 
+bool CouchDB::hasBinaryAttachments(const Value &doc) {
+	for (Value a : doc["_attachments"]) {
+		if (a["data"].flags() & json::binaryString) return true;
+	}
+	return false;
+}
+
+Value CouchDB::requestMultipartPUT(PConnection& conn, const Value& doc) {
+	return observeRequest(conn, "PUT", [&]{return retry([&]{
+		return multipartPUT(conn, doc);
+	});});
+}
+
+Value CouchDB::multipartPUT(PConnection& conn, const Value &doc) {
+
+	HttpClient &http = conn->http;
+	StrViewA path = conn->getUrl();
+
+	//replace binary attachments by stubs, which follows the document
+	//parts must be sent in the same order as attachments appear in the document
+	std::vector<BinaryView> parts;
+	Object atts;
+	for (Value a : doc["_attachments"]) {
+		Value data = a["data"];
+		if (data.flags() & json::binaryString) {
+			BinaryView bin = data.getBinary(json::base64);
+			Object stub(a);
+			stub.unset("data");
+			stub.set("follows",true);
+			stub.set("length",bin.length);
+			atts.set(a.getKey(), stub);
+			parts.push_back(bin);
+		} else {
+			atts.set(a.getKey(), a);
+		}
+	}
+
+	String boundary({"couchit-",genUIDValue().getString()});
+	String jsonPart = doc.replace("_attachments", atts).stringify();
+	String header({"--",boundary,"\r\nContent-Type: application/json\r\n\r\n"});
+	String separator({"\r\n--",boundary,"\r\n\r\n"});
+	String trailer({"\r\n--",boundary,"--"});
+
+	std::size_t contentLength = header.length() + jsonPart.length() + trailer.length();
+	for (auto &&p : parts) contentLength += separator.length() + p.length;
+
+	http.open(path,"PUT",true);
+	Object hdr;
+	hdr("Accept","application/binjson, application/json");
+	hdr("Content-Type",String({"multipart/related;boundary=\"",boundary,"\""}));
+	hdr("Cookie", getToken());
+	http.setHeaders(hdr);
+
+	OutputStream out = http.beginBody(contentLength);
+	out(BinaryView(header.str()));
+	out(BinaryView(jsonPart.str()));
+	for (auto &&p : parts) {
+		out(BinaryView(separator.str()));
+		out(p);
+	}
+	out(BinaryView(trailer.str()));
+	int status = http.send();
+	markResponse(conn);
+	if (status <= 0) {
+		//the request was not sent or the connection has been lost (retry() repeats it)
+		throw RequestError(path, 0, "Failed to send the multipart request", Value());
+	}
+	return postRequest(conn,StrViewA(),nullptr,0);
+}
+
 Value CouchDB::getToken() {
 	if (!authObj.defined()) return json::undefined;
 	time_t now;
@@ -1722,7 +2257,9 @@ Value CouchDB::put(const Value &doc, const WriteOptions &opts, bool no_exception
 		if (opts.replication) b->add("new_edits","false");
 		if (opts.quorum) b->add("w",opts.quorum);
 		try {
-			Value resp = requestPUT(b,wdoc,nullptr,0);
+			Value resp = hasBinaryAttachments(wdoc)
+					?requestMultipartPUT(b,wdoc)
+					:requestPUT(b,wdoc,nullptr,0);
 			return resp["rev"];
 		} catch (const RequestError &e) {
 			if (e.getCode() == 409) {
@@ -123,6 +123,10 @@ public:
 	 *  nodeLocal documents has prefix/suffix cointaining node's unique ID
 	 */
 	static const Flags flgNodeLocal = 0x10000;
+	///compress body of the request (gzip), if it is larger than 4KB (used with requestPOST and requestPUT)
+	static const Flags flgCompressBody = 0x20000;
+	///Download flag - return JSON response as string without parsing it (used by LazyResult)
+	static const Flags flgRawJson = 0x40000;
 
 
 	CouchDB(const Config &cfg);
@@ -196,6 +200,23 @@ public:
 
 
 	///Bulk upload
+	/**
+	 * Large uploads are split into more requests limited by Config::maxBulkSizeDocs and
+	 * Config::maxBulkSizeBytes. These requests are sent in parallel
+	 * (see Config::bulkUploadParallel). The result contains one item for each document
+	 * in the order of the documents regardless on splitting.
+	 *
+	 * When a request of a split upload fails, no further requests are started and the
+	 * exception is thrown after the running requests are finished. Documents of the finished
+	 * requests are stored.
+	 *
+	 * Binary attachments are encoded to base64, unless Config::multipartBulkAttachments
+	 * is enabled.
+	 *
+	 * @param docs array of documents
+	 * @param replication set true to upload with new_edits=false
+	 * @return array of results
+	 */
 	Value bulkUpload(const Value docs, bool replication = false);
 
 
@@ -402,6 +423,23 @@ public:
 	 */
 	String putAttachment(const Value &document, const StrViewA &attachmentName, const AttachmentDataRef &attachmentData);
 
+	///Uploads attachment from a file
+	/**
+	 * Content is transfered from the file directly to the connection by sendfile(). The data
+	 * are not copied through the user space and memory usage doesn't depend on size of the attachment.
+	 *
+	 * @param document document object. The document don't need to be complete, only _id and _rev must be there.
+	 * @param attachmentName name of attachment
+	 * @param contentType content type of the attachment
+	 * @param fd file descriptor of the source file
+	 * @param offset offset of the content in the file
+	 * @param length length of the content in bytes
+	 * @return Funtcion returns new revision of the document, if successful.
+	 *
+	 * @note to download attachment to a file, use Download::readTo()
+	 */
+	String putAttachment(const Value &document, const StrViewA &attachmentName, const StrViewA &contentType, int fd, std::uint64_t offset, std::size_t length);
+
 	///Downloads attachment
 	/**
 	 * @param document document. The document don't need to be complete, only _id and _rev must be there.
@@ -702,6 +740,10 @@ protected:
 	protected:
 		CouchDB &owner;
 
+		Value executeDirect(const QueryRequest &r);
+		Value executeKeysPlan(const QueryRequest &r);
+		bool canPlanKeys(const QueryRequest &r) const;
+
 	};
 
 
@@ -715,6 +757,7 @@ public:
 
 	typedef std::chrono::system_clock SysClock;
 	typedef std::chrono::time_point<SysClock> SysTime;
+	typedef std::chrono::steady_clock SteadyClock;
 
 
 
@@ -730,6 +773,12 @@ public:
 	protected:
 		friend class CouchDB;
 		SysTime lastUse, firstUse;
+		///time spent in getConnection() waiting for a free connection
+		SteadyClock::duration queueWait;
+		///time when the response's headers arrived (collected only with the request observer)
+		SteadyClock::time_point responseTime;
+		///the last request has been served from the QueryCache
+		bool fromCache = false;
 	};
 
 	class ConnectionDeleter {
@@ -928,6 +977,21 @@ protected:
 	SysTime lastPoolCheck;
 
 	Value jsonPUTPOST(PConnection &conn, bool methodPost, Value data, Value *headers, Flags flags);
+	///Uploads documents through single _bulk_docs request
+	Value bulkUploadChunk(const Value &docs, bool replication);
+
+	///Performs PUT of the document with binary attachments as multipart/related request
+	/** Attachments which are stored as binary values are sent as binary parts, so they are not
+	 * inflated by base64 encoding
+	 *
+	 * @param conn connection (path to the document)
+	 * @param doc document to put
+	 * @return parsed response
+	 */
+	Value requestMultipartPUT(PConnection &conn, const Value &doc);
+	Value multipartPUT(PConnection &conn, const Value &doc);
+	///Returns true, when document has attachments stored as binary values
+	static bool hasBinaryAttachments(const Value &doc);
 
 	void handleUnexpectedStatus(PConnection& conn);
 	Download downloadAttachmentCont(PConnection &conn, const StrViewA &etag);
@@ -968,6 +1032,25 @@ private:
 	template<typename Fn>
 	auto retry(Fn &&fn) -> decltype(std::declval<Fn>()());
 
+	template<typename Fn>
+	auto observeRequest(PConnection &conn, StrViewA method, Fn &&fn) -> decltype(std::declval<Fn>()());
+
+	///State of the observed request captured before the request is sent
+	struct RequestMark {
+		SteadyClock::time_point start;
+		std::uint64_t bytesSent;
+		std::uint64_t bytesReceived;
+	};
+
+	///Starts to observe the request (use only when the request observer is installed)
+	RequestMark markRequest(Connection &conn);
+	///Reports the finished request to the request observer
+	void reportRequest(Connection &conn, StrViewA method, int status, const RequestMark &mark);
+
+	void markResponse(PConnection &conn) {
+		if (cfg.requestObserver) conn->responseTime = SteadyClock::now();
+	}
+
 };
 
 
@@ -9,6 +9,9 @@
 
 #include "defaultUIDGen.h"
 
+#include <cstdint>
+#include <ctime>
+
 namespace couchit {
 
 
@@ -24,13 +27,16 @@ namespace couchit {
 		return generateUID(buffer, prefix, (std::size_t)now, counter, &rgn, 20);
 }
 
-static void writeBaseX(IIDGen::Buffer &buffer, std::size_t val, unsigned int digits, unsigned int base) {
-	if (digits) {
-		writeBaseX(buffer, val/base, digits-1, base);
-		std::size_t d = val%base;
-		if (d < 10) buffer.push_back('0'+d);
-		else if (d < 36) buffer.push_back('A'+(d-10));
-		else buffer.push_back('a'+(d-36));
+static const char base62chars[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+
+///Writes number in base 62, most significant digit first
+static void writeBase62(IIDGen::Buffer &buffer, std::uint64_t val, unsigned int digits) {
+	std::size_t pos = buffer.size();
+	buffer.resize(pos + digits);
+	char *c = buffer.data() + pos + digits;
+	for (unsigned int i = 0; i < digits; i++) {
+		*--c = base62chars[val % 62];
+		val /= 62;
 	}
 }
 
@@ -41,11 +47,11 @@ StrViewA DefaultUIDGen::generateUID(Buffer& buffer, StrViewA prefix,
 	buffer.clear();
 	buffer.reserve(totalCount);
 	for (auto &&x: prefix) buffer.push_back(x);
-	writeBaseX(buffer,  timeparam, 6, 62);
-	writeBaseX(buffer,  counterparam, 4, 62);
+	writeBase62(buffer,  timeparam, 6);
+	writeBase62(buffer,  counterparam, 4);
 	if (randomGen) {
 		while (buffer.size() < totalCount+prefix.length) {
-			writeBaseX(buffer, (*randomGen)() % 62, 1, 62);
+			buffer.push_back(base62chars[(*randomGen)() % 62]);
 		}
 	}
 
@@ -66,5 +72,49 @@ DefaultUIDGen::DefaultUIDGen() {
 	counter = rgn();
 }
 
+namespace {
+
+struct FastUIDGenState {
+	std::mt19937_64 rnd;
+	std::size_t counter;
+
+	FastUIDGenState() {
+		std::random_device rd;
+		std::seed_seq seed{rd(),rd(),rd(),rd()};
+		rnd.seed(seed);
+		counter = static_cast<std::size_t>(rnd());
+	}
+};
+
+}
+
+///62^10 - range of the random padding, single random number is enough for the whole padding
+static const std::uint64_t randomPaddingRange = 839299365868340224ULL;
+
+StrViewA FastUIDGen::operator()(Buffer &buffer, const StrViewA &prefix) {
+	static thread_local FastUIDGenState state;
+
+	state.counter = (state.counter + 1) & 0x7FFFFF;
+	std::size_t now = static_cast<std::size_t>(time(nullptr));
+
+	buffer.clear();
+	buffer.reserve(prefix.length+20);
+	for (auto &&x: prefix) buffer.push_back(x);
+	writeBase62(buffer, now, 6);
+	writeBase62(buffer, state.counter, 4);
+	writeBase62(buffer, state.rnd() % randomPaddingRange, 10);
+	return StrViewA(buffer.data(), buffer.size());
+}
+
+String FastUIDGen::operator()(const StrViewA &prefix) {
+	Buffer buff;
+	return operator()(buff, prefix);
+}
+
+FastUIDGen &FastUIDGen::getInstance() {
+	static FastUIDGen instance;
+	return instance;
+}
+
 } /* namespace couchit */
 
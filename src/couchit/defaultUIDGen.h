@@ -75,6 +75,25 @@ protected:
 
 };
 
+///Lock-free UID generator
+/** Generates UIDs in the same format as the DefaultUIDGen (timestamp, counter, random padding), so
+ * the IDs are still ordered by the time of creation. However, every thread has own counter and
+ * own random generator (seeded from the random_device), so the generator doesn't need any lock.
+ *
+ * The counter of each thread starts at random position. Two threads can generate the same
+ * timestamp and counter, however such IDs are still distinguished by the random padding
+ *
+ * This generator is used by the CouchDB client when no other generator is configured.
+ */
+class FastUIDGen: public IIDGen {
+public:
+
+	virtual StrViewA operator()(Buffer &buffer, const StrViewA &prefix) override;
+	virtual String operator()(const StrViewA &prefix) override;
+
+	static FastUIDGen &getInstance();
+};
+
 } /* namespace couchit */
 
 #endif /* LIGHTCOUCH_DEFAULTUIDGEN_H_ */
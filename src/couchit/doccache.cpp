@@ -31,6 +31,11 @@ public:
 		return true;
 	}
 
+	virtual bool onEvents(const ChangeEventBatch &events) {
+		owner.update(events);
+		return true;
+	}
+
 	virtual json::Value getLastKnownSeqID() const {
 		return Value();
 	}
@@ -85,6 +90,17 @@ Value DocCache::get(StrViewA name) {
 void DocCache::update(const ChangeEvent &ev) {
 	if (ev.idle) return;
 	Sync _(lock);
+	update_lk(ev);
+}
+
+void DocCache::update(const ChangeEventBatch &evs) {
+	Sync _(lock);
+	for (std::size_t i = 0; i < evs.length; i++) {
+		if (!evs[i].idle) update_lk(evs[i]);
+	}
+}
+
+void DocCache::update_lk(const ChangeEvent &ev) {
 	auto f = dataMap.find(ev.id);
 	if (config.precache || f != dataMap.end()) {
 		put_lk(ev.doc, f);
@@ -107,6 +107,9 @@ public:
 	///Manually update from changes stream
 	void update(const ChangeEvent &ev);
 
+	///Manually update from batch of changes (under single lock)
+	void update(const ChangeEventBatch &evs);
+
 
 protected:
 	std::recursive_mutex lock;
@@ -141,6 +144,7 @@ protected:
 	class Update;
 
 	void put_lk(Value doc, DataMap::iterator &iter);
+	void update_lk(const ChangeEvent &ev);
 
 };
 
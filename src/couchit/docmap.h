@@ -8,12 +8,21 @@
 #ifndef SRC_COUCHIT_SRC_COUCHIT_DOCMAP_H_
 #define SRC_COUCHIT_SRC_COUCHIT_DOCMAP_H_
 #include "shared/refcnt.h"
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
 #include <mutex>
 #include <functional>
+#include <future>
+#include <thread>
+#include <vector>
+#include <imtjson/fnv.h>
 #include <imtjson/string.h>
 #include <imtjson/value.h>
 #include <unordered_map>
 
+#include "changeObserver.h"
 
 
 namespace couchit {
@@ -27,6 +36,24 @@ namespace couchit {
  * can speedup operation
  *
  * The result is stored to refcounted immutable object
+ *
+ * The cache is split to shards, each shard has own lock, so threads working with different
+ * documents don't block each other. The map function runs outside of the lock. When more
+ * threads need the same revision of the document which is being transformed, they wait for
+ * the result of the first thread, so the transformation is performed only once. The cache can be limited (see Config). When the limit
+ * is reached, the least recently used items are evicted (CLOCK algorithm, similar to DocCache).
+ * Expired items can be removed by the background sweeper. The cache can be also invalidated
+ * by a ChangesDistributor
+ *
+ * @code
+ * DocMap<MyType>::Config cfg;
+ * cfg.capacity = 100000;
+ * cfg.sweepInterval = std::chrono::seconds(10);
+ * DocMap<MyType> map(&transformFn, cfg);
+ * auto regid = distributor.add(map.getObserver());
+ * ...
+ * distributor.remove(regid);
+ * @endcode
  */
 template<typename T>
 class DocMap {
@@ -47,7 +74,21 @@ public:
 
 	using Ref = ondra_shared::RefCntPtr<Item>;
 
-	DocMap(MapFn &&fn):mapfn(std::move(fn)) {}
+	struct Config {
+		///maximum count of cached items. Zero means no limit
+		/** The limit is divided between shards, so the cache can start to evict items
+		 * sooner, when the documents are not spread evenly
+		 */
+		std::size_t capacity = 0;
+		///count of shards
+		unsigned int shards = 16;
+		///interval of the background sweeper, which removes expired items. Zero disables the sweeper
+		std::chrono::milliseconds sweepInterval = std::chrono::milliseconds(0);
+	};
+
+	DocMap(MapFn &&fn):DocMap(std::move(fn), Config()) {}
+	DocMap(MapFn &&fn, const Config &cfg);
+	~DocMap();
 
 	///Perform document tranform with caching
 	/**
@@ -55,42 +96,302 @@ public:
 	 * @param ttl optional time to live in seconds. Default value stores document for infinite time. If ttl is specified, transformed document
 	 * is discarded when ttl expires. To rerun transformation, use 0, which invalidates the cache immediately.
 	 *
+	 * @note If the map function throws an exception, the exception is also thrown to all threads
+	 * waiting for the same document. Nothing is cached in this case.
 	 */
-	Ref operator()(json::Value doc, int ttl = -1) const {
-		Sync _(lock);
-		auto id = doc["_id"].toString();
-		auto rev = doc["_rev"].toString();
-		auto iter = map.find(id);
-		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
-		bool hasExp = ttl >= 0;
-		if (iter == map.end() || iter->second->rev != rev || (hasExp && iter->second->store_time+std::chrono::seconds(ttl) <= now)) {
-			Ref newValue(new Item(std::move(rev), mapfn(doc), std::chrono::steady_clock::now()));
-			auto r = map.insert(std::make_pair(id, newValue));
-			if (!r.second) r.first->second = newValue;
-			return newValue;
-		} else {
-			return iter->second;
-		}
-	}
+	Ref operator()(json::Value doc, int ttl = -1) const;
+
+	///Retrieves cached item without transformation
+	/**
+	 * @param id id of the document
+	 * @return cached item or nullptr, if the document is not cached
+	 */
+	Ref find(json::StrViewA id) const;
+
+	///Removes document from the cache
+	void invalidate(json::StrViewA id) const;
+
+	///Removes all items
+	void clear() const;
 
+	///Removes all expired items (the sweeper calls this function periodically)
+	void sweep() const;
+
+	///Returns count of cached items
+	std::size_t size() const;
+
+	///Returns observer which invalidates changed documents
+	/**
+	 * Register the observer to the ChangesDistributor by the function add(IChangeEventObserver &).
+	 * The observer must be removed before the DocMap is destroyed
+	 */
+	IChangeEventObserver &getObserver() {return observer;}
 
 
 protected:
-	struct StrHash {
-		auto operator()(const String &a) const {
-			return std::hash<Value>()(Value(a));
+	using Sync = std::unique_lock<std::mutex>;
+	using TimePoint = std::chrono::steady_clock::time_point;
+
+	struct Hash {
+		std::size_t operator()(json::StrViewA data) const {
+			std::size_t val = 0;
+			FNV1a<sizeof(std::size_t)> fnv(val);
+			for (auto &&k: data) fnv(k);
+			return val;
 		}
 	};
-	using Sync = std::unique_lock<std::recursive_mutex>;
-	using Map = std::unordered_map<json::String, Ref, StrHash>;
 
-	mutable std::recursive_mutex lock;
-	mutable Map map;
+	struct Entry {
+		///owns the memory referenced by the key
+		json::String id;
+		Ref item;
+		TimePoint expires;
+		bool accessed;
+	};
+
+	using Map = std::unordered_map<json::StrViewA, Entry, Hash>;
+
+	///Transformation in progress
+	struct InFlight {
+		///owns the memory referenced by the key
+		json::String id;
+		json::String rev;
+		std::shared_future<Ref> result;
+		///thread which performs the transformation
+		std::thread::id worker;
+		std::size_t serial;
+	};
+
+	using InFlightMap = std::unordered_map<json::StrViewA, InFlight, Hash>;
+
+	struct Shard {
+		std::mutex lock;
+		Map map;
+		InFlightMap inflight;
+		std::size_t nextSerial = 0;
+		///CLOCK queue, contains ids of the items
+		std::vector<json::String> clock;
+		std::size_t clockIndex = 0;
+	};
+
+	class Observer: public IChangeEventObserver {
+	public:
+		Observer(DocMap &owner):owner(owner) {}
+		virtual bool onEvent(const ChangeEvent &doc) override {
+			if (!doc.idle) owner.invalidate(doc.id);
+			return true;
+		}
+		virtual json::Value getLastKnownSeqID() const override {
+			return json::Value();
+		}
+	protected:
+		DocMap &owner;
+	};
+
+	std::unique_ptr<Shard[]> shards;
+	unsigned int shardCount;
 	MapFn mapfn;
+	Observer observer;
+
+	std::mutex sweepLock;
+	std::condition_variable sweepSignal;
+	bool sweepExit = false;
+	std::thread sweeper;
+
+	Shard &getShard(json::StrViewA id) const {
+		return shards[Hash()(id) % shardCount];
+	}
+
+	static void allocSlot(Shard &sh, const json::String &id);
+	static void store(Shard &sh, const json::String &id, const Ref &item, TimePoint expires);
+	void runSweeper(std::chrono::milliseconds interval);
 
 
 };
 
+template<typename T>
+inline DocMap<T>::DocMap(MapFn &&fn, const Config &cfg)
+	:shards(new Shard[std::max(cfg.shards,1U)])
+	,shardCount(std::max(cfg.shards,1U))
+	,mapfn(std::move(fn))
+	,observer(*this)
+{
+	if (cfg.capacity) {
+		std::size_t cap = (cfg.capacity + shardCount - 1) / shardCount;
+		for (unsigned int i = 0; i < shardCount; i++) shards[i].clock.resize(cap);
+	}
+	if (cfg.sweepInterval.count()) {
+		sweeper = std::thread([this, i = cfg.sweepInterval]{runSweeper(i);});
+	}
+}
+
+template<typename T>
+inline DocMap<T>::~DocMap() {
+	if (sweeper.joinable()) {
+		{
+			std::unique_lock<std::mutex> _(sweepLock);
+			sweepExit = true;
+		}
+		sweepSignal.notify_all();
+		sweeper.join();
+	}
+}
+
+template<typename T>
+inline typename DocMap<T>::Ref DocMap<T>::operator()(json::Value doc, int ttl) const {
+	Value vid = doc["_id"];
+	json::StrViewA id = vid.getString();
+	json::StrViewA rev = doc["_rev"].getString();
+	Shard &sh = getShard(id);
+	Sync _(sh.lock);
+	auto iter = sh.map.find(id);
+	TimePoint now = std::chrono::steady_clock::now();
+	bool hasExp = ttl >= 0;
+	if (iter != sh.map.end() && iter->second.item->rev.str() == rev
+			&& (!hasExp || iter->second.item->store_time+std::chrono::seconds(ttl) > now)) {
+		iter->second.accessed = true;
+		return iter->second.item;
+	}
+
+	auto fl = sh.inflight.find(id);
+	if (fl != sh.inflight.end() && fl->second.rev.str() == rev) {
+		if (fl->second.worker != std::this_thread::get_id()) {
+			std::shared_future<Ref> f = fl->second.result;
+			_.unlock();
+			return f.get();
+		}
+		//recursive request from the map function - transform without caching
+		_.unlock();
+		return Ref(new Item(json::String(doc["_rev"]), mapfn(doc), std::chrono::steady_clock::now()));
+	}
+
+	//this thread performs the transformation, other threads will wait for the result
+	std::promise<Ref> prom;
+	json::String sid(vid);
+	std::size_t serial = sh.nextSerial++;
+	sh.inflight.erase(id);
+	sh.inflight.emplace(sid.str(), InFlight{sid, json::String(doc["_rev"]), prom.get_future().share(),
+			std::this_thread::get_id(), serial});
+	_.unlock();
+
+	Ref newValue;
+	try {
+		newValue = Ref(new Item(json::String(doc["_rev"]), mapfn(doc), std::chrono::steady_clock::now()));
+	} catch (...) {
+		_.lock();
+		fl = sh.inflight.find(id);
+		if (fl != sh.inflight.end() && fl->second.serial == serial) sh.inflight.erase(fl);
+		_.unlock();
+		prom.set_exception(std::current_exception());
+		throw;
+	}
+
+	_.lock();
+	fl = sh.inflight.find(id);
+	//the result is not stored, when the document has been invalidated meanwhile
+	if (fl != sh.inflight.end() && fl->second.serial == serial) {
+		sh.inflight.erase(fl);
+		TimePoint expires = hasExp?newValue->store_time+std::chrono::seconds(ttl):TimePoint::max();
+		store(sh, sid, newValue, expires);
+	}
+	_.unlock();
+	prom.set_value(newValue);
+	return newValue;
+}
+
+template<typename T>
+inline void DocMap<T>::store(Shard &sh, const json::String &id, const Ref &item, TimePoint expires) {
+	auto iter = sh.map.find(id.str());
+	if (iter == sh.map.end()) {
+		allocSlot(sh, id);
+		sh.map.emplace(id.str(), Entry{id, item, expires, false});
+	} else {
+		iter->second.item = item;
+		iter->second.expires = expires;
+		iter->second.accessed = true;
+	}
+}
+
+template<typename T>
+inline typename DocMap<T>::Ref DocMap<T>::find(json::StrViewA id) const {
+	Shard &sh = getShard(id);
+	Sync _(sh.lock);
+	auto iter = sh.map.find(id);
+	if (iter == sh.map.end()) return Ref();
+	iter->second.accessed = true;
+	return iter->second.item;
+}
+
+template<typename T>
+inline void DocMap<T>::invalidate(json::StrViewA id) const {
+	Shard &sh = getShard(id);
+	Sync _(sh.lock);
+	sh.map.erase(id);
+	sh.inflight.erase(id);
+}
+
+template<typename T>
+inline void DocMap<T>::clear() const {
+	for (unsigned int i = 0; i < shardCount; i++) {
+		Sync _(shards[i].lock);
+		shards[i].map.clear();
+		shards[i].inflight.clear();
+	}
+}
+
+template<typename T>
+inline void DocMap<T>::sweep() const {
+	TimePoint now = std::chrono::steady_clock::now();
+	for (unsigned int i = 0; i < shardCount; i++) {
+		Sync _(shards[i].lock);
+		Map &map = shards[i].map;
+		for (auto iter = map.begin(); iter != map.end();) {
+			if (iter->second.expires <= now) iter = map.erase(iter);
+			else ++iter;
+		}
+	}
+}
+
+template<typename T>
+inline std::size_t DocMap<T>::size() const {
+	std::size_t cnt = 0;
+	for (unsigned int i = 0; i < shardCount; i++) {
+		Sync _(shards[i].lock);
+		cnt += shards[i].map.size();
+	}
+	return cnt;
+}
+
+template<typename T>
+inline void DocMap<T>::allocSlot(Shard &sh, const json::String &id) {
+	if (sh.clock.empty()) return;
+	while (true) {
+		auto pos = sh.clockIndex;
+		sh.clockIndex = (sh.clockIndex+1) % sh.clock.size();
+		auto iter = sh.map.find(sh.clock[pos].str());
+		if (iter == sh.map.end()) {
+			sh.clock[pos] = id;
+			return;
+		} else if (iter->second.accessed) {
+			iter->second.accessed = false;
+		} else {
+			sh.map.erase(iter);
+			sh.clock[pos] = id;
+			return;
+		}
+	}
+}
+
+template<typename T>
+inline void DocMap<T>::runSweeper(std::chrono::milliseconds interval) {
+	std::unique_lock<std::mutex> _(sweepLock);
+	while (!sweepSignal.wait_for(_, interval, [&]{return sweepExit;})) {
+		_.unlock();
+		sweep();
+		_.lock();
+	}
+}
+
 
 }
 
@@ -0,0 +1,142 @@
+/*
+ * hdrHistogram.cpp
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#include "hdrHistogram.h"
+
+#include <algorithm>
+#include <cmath>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+namespace couchit {
+
+static unsigned int highestBit(std::uint64_t v) {
+#ifdef _MSC_VER
+	unsigned long idx;
+	_BitScanReverse64(&idx, v);
+	return idx;
+#else
+	return 63 - __builtin_clzll(v);
+#endif
+}
+
+HdrHistogram::HdrHistogram(unsigned int maxBits, unsigned int subBucketBits)
+	:subBucketBits(subBucketBits)
+	,maxValue(maxBits >= 64?~std::uint64_t(0):(std::uint64_t(1) << maxBits) - 1)
+	,bucketCount((std::size_t(maxBits) - subBucketBits + 2) << (subBucketBits - 1))
+	,counts(new std::atomic<std::uint64_t>[bucketCount])
+	,total(0)
+	,sum(0)
+	,minValue(~std::uint64_t(0))
+	,maxRecorded(0)
+{
+	for (std::size_t i = 0; i < bucketCount; i++) counts[i].store(0, std::memory_order_relaxed);
+}
+
+std::size_t HdrHistogram::indexOf(std::uint64_t value) const {
+	if (value < (std::uint64_t(1) << subBucketBits)) return static_cast<std::size_t>(value);
+	unsigned int shift = highestBit(value) - (subBucketBits - 1);
+	return (std::size_t(shift) << (subBucketBits - 1)) + static_cast<std::size_t>(value >> shift);
+}
+
+std::uint64_t HdrHistogram::lowestAt(std::size_t index) const {
+	if (index < (std::size_t(1) << subBucketBits)) return index;
+	std::size_t shift = (index >> (subBucketBits - 1)) - 1;
+	std::uint64_t sub = index - (shift << (subBucketBits - 1));
+	return sub << shift;
+}
+
+std::uint64_t HdrHistogram::highestAt(std::size_t index) const {
+	if (index < (std::size_t(1) << subBucketBits)) return index;
+	std::size_t shift = (index >> (subBucketBits - 1)) - 1;
+	return lowestAt(index) + (std::uint64_t(1) << shift) - 1;
+}
+
+void HdrHistogram::record(std::uint64_t value) {
+	if (value > maxValue) value = maxValue;
+	counts[indexOf(value)].fetch_add(1, std::memory_order_relaxed);
+	total.fetch_add(1, std::memory_order_relaxed);
+	sum.fetch_add(value, std::memory_order_relaxed);
+	std::uint64_t m = minValue.load(std::memory_order_relaxed);
+	while (value < m && !minValue.compare_exchange_weak(m, value, std::memory_order_relaxed)) {}
+	m = maxRecorded.load(std::memory_order_relaxed);
+	while (value > m && !maxRecorded.compare_exchange_weak(m, value, std::memory_order_relaxed)) {}
+}
+
+std::uint64_t HdrHistogram::getCount() const {
+	return total.load(std::memory_order_relaxed);
+}
+
+std::uint64_t HdrHistogram::getMin() const {
+	std::uint64_t m = minValue.load(std::memory_order_relaxed);
+	return getCount()?m:0;
+}
+
+std::uint64_t HdrHistogram::getMax() const {
+	return maxRecorded.load(std::memory_order_relaxed);
+}
+
+double HdrHistogram::getMean() const {
+	std::uint64_t c = getCount();
+	if (c == 0) return 0;
+	return static_cast<double>(sum.load(std::memory_order_relaxed)) / c;
+}
+
+std::uint64_t HdrHistogram::getPercentile(double percentile) const {
+	std::uint64_t c = getCount();
+	if (c == 0) return 0;
+	if (percentile > 100) percentile = 100;
+	std::uint64_t target = static_cast<std::uint64_t>(std::ceil(percentile * c / 100.0));
+	if (target == 0) target = 1;
+	std::uint64_t acc = 0;
+	for (std::size_t i = 0; i < bucketCount; i++) {
+		acc += counts[i].load(std::memory_order_relaxed);
+		if (acc >= target) return std::min(highestAt(i), getMax());
+	}
+	return getMax();
+}
+
+void HdrHistogram::add(const HdrHistogram &other) {
+	std::size_t cnt = std::min(bucketCount, other.bucketCount);
+	for (std::size_t i = 0; i < cnt; i++) {
+		std::uint64_t v = other.counts[i].load(std::memory_order_relaxed);
+		if (v) counts[i].fetch_add(v, std::memory_order_relaxed);
+	}
+	std::uint64_t c = other.getCount();
+	if (c == 0) return;
+	total.fetch_add(c, std::memory_order_relaxed);
+	sum.fetch_add(other.sum.load(std::memory_order_relaxed), std::memory_order_relaxed);
+	std::uint64_t v = other.getMin();
+	std::uint64_t m = minValue.load(std::memory_order_relaxed);
+	while (v < m && !minValue.compare_exchange_weak(m, v, std::memory_order_relaxed)) {}
+	v = other.getMax();
+	m = maxRecorded.load(std::memory_order_relaxed);
+	while (v > m && !maxRecorded.compare_exchange_weak(m, v, std::memory_order_relaxed)) {}
+}
+
+void HdrHistogram::reset() {
+	for (std::size_t i = 0; i < bucketCount; i++) counts[i].store(0, std::memory_order_relaxed);
+	total.store(0, std::memory_order_relaxed);
+	sum.store(0, std::memory_order_relaxed);
+	minValue.store(~std::uint64_t(0), std::memory_order_relaxed);
+	maxRecorded.store(0, std::memory_order_relaxed);
+}
+
+Value HdrHistogram::toJson(double scale) const {
+	return Object("count",getCount())
+			("min",getMin()/scale)
+			("mean",getMean()/scale)
+			("p50",getPercentile(50)/scale)
+			("p90",getPercentile(90)/scale)
+			("p99",getPercentile(99)/scale)
+			("p999",getPercentile(99.9)/scale)
+			("max",getMax()/scale);
+}
+
+
+}
@@ -0,0 +1,96 @@
+/*
+ * hdrHistogram.h
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_COUCHIT_HDRHISTOGRAM_H_
+#define SRC_COUCHIT_HDRHISTOGRAM_H_
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+#include "json.h"
+
+namespace couchit {
+
+
+///High dynamic range histogram
+/**
+ * Values are recorded into buckets whose width grows with the magnitude of the value,
+ * so the relative error is constant across the whole range. With subBucketBits=7, the
+ * error is below 1%. The histogram is suitable to collect latencies in nanoseconds,
+ * where values from microseconds to minutes need to be tracked together.
+ *
+ * Recording is lock-free, so single histogram can be shared by many threads. Reading
+ * the histogram while it is being updated gives slightly inconsistent, but usable results.
+ */
+class HdrHistogram {
+public:
+
+	///Constructs the histogram
+	/**
+	 * @param maxBits highest trackable value is 2^maxBits-1. Larger values are recorded as
+	 * the highest trackable value. Default value covers approx. 18 minutes in nanoseconds
+	 * @param subBucketBits precision. Relative error is 2^(1-subBucketBits)
+	 */
+	HdrHistogram(unsigned int maxBits = 40, unsigned int subBucketBits = 7);
+
+	///Records the value
+	void record(std::uint64_t value);
+
+	///Returns count of recorded values
+	std::uint64_t getCount() const;
+	///Returns lowest recorded value (0 if empty)
+	std::uint64_t getMin() const;
+	///Returns highest recorded value
+	std::uint64_t getMax() const;
+	///Returns mean value
+	double getMean() const;
+	///Returns value at given percentile
+	/**
+	 * @param percentile percentile in range 0-100
+	 * @return value at the percentile. The returned value is the upper bound of the bucket,
+	 * which contains the percentile
+	 */
+	std::uint64_t getPercentile(double percentile) const;
+
+	///Adds values recorded by other histogram
+	/** @note both histograms must have same parameters */
+	void add(const HdrHistogram &other);
+
+	///Clears the histogram
+	void reset();
+
+	///Exports summary
+	/**
+	 * @param scale all values are divided by this number. For example, use 1e6 to
+	 * convert nanoseconds to milliseconds
+	 * @return object with fields count, min, mean, p50, p90, p99, p999 and max
+	 */
+	Value toJson(double scale = 1.0) const;
+
+protected:
+
+	unsigned int subBucketBits;
+	std::uint64_t maxValue;
+	std::size_t bucketCount;
+	std::unique_ptr<std::atomic<std::uint64_t>[]> counts;
+	std::atomic<std::uint64_t> total;
+	std::atomic<std::uint64_t> sum;
+	std::atomic<std::uint64_t> minValue;
+	std::atomic<std::uint64_t> maxRecorded;
+
+	std::size_t indexOf(std::uint64_t value) const;
+	std::uint64_t lowestAt(std::size_t index) const;
+	std::uint64_t highestAt(std::size_t index) const;
+};
+
+
+}
+
+
+
+#endif /* SRC_COUCHIT_HDRHISTOGRAM_H_ */
@@ -0,0 +1,151 @@
+/*
+ * jsonWriter.cpp
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#include "jsonWriter.h"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+
+#if defined(__SSE2__) && defined(__GNUC__)
+#include <emmintrin.h>
+#define COUCHIT_JSONWRITER_SSE2
+#endif
+
+namespace couchit {
+
+///Finds first character which needs escaping
+static inline const unsigned char *findEscape(const unsigned char *p, const unsigned char *e) {
+#ifdef COUCHIT_JSONWRITER_SSE2
+	const __m128i quote = _mm_set1_epi8('"');
+	const __m128i bslash = _mm_set1_epi8('\\');
+	const __m128i ctrl = _mm_set1_epi8(0x1F);
+	while (e - p >= 16) {
+		__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i *>(p));
+		//x <= 0x1F (unsigned) when min(x,0x1F) == x
+		__m128i m = _mm_or_si128(
+				_mm_or_si128(_mm_cmpeq_epi8(x, quote), _mm_cmpeq_epi8(x, bslash)),
+				_mm_cmpeq_epi8(_mm_min_epu8(x, ctrl), x));
+		int mask = _mm_movemask_epi8(m);
+		if (mask) return p + __builtin_ctz(mask);
+		p += 16;
+	}
+#endif
+	while (p < e && *p != '"' && *p != '\\' && *p >= 0x20) ++p;
+	return p;
+}
+
+void JsonBlockWriter::write(const Value &v) {
+	switch (v.type()) {
+	case json::undefined:
+	case json::null:
+		putSpan("null",4);
+		break;
+	case json::boolean:
+		if (v.getBool()) putSpan("true",4);
+		else putSpan("false",5);
+		break;
+	case json::number:
+		writeNumber(v);
+		break;
+	case json::string:
+		if (v.flags() & json::binaryString) writeSerialized(v);
+		else writeString(v.getString());
+		break;
+	case json::array: {
+		putChar('[');
+		bool first = true;
+		for (Value x : v) {
+			if (!first) putChar(',');
+			first = false;
+			write(x);
+		}
+		putChar(']');
+		break;
+	}
+	case json::object: {
+		putChar('{');
+		bool first = true;
+		for (Value x : v) {
+			if (!first) putChar(',');
+			first = false;
+			writeString(x.getKey());
+			putChar(':');
+			write(x);
+		}
+		putChar('}');
+		break;
+	}
+	default:
+		writeSerialized(v);
+		break;
+	}
+}
+
+void JsonBlockWriter::putSpan(const void *data, std::size_t len) {
+	const unsigned char *p = reinterpret_cast<const unsigned char *>(data);
+	while (len) {
+		if (wrpos == wrend) nextBuffer(1);
+		std::size_t n = std::min<std::size_t>(len, wrend - wrpos);
+		std::memcpy(wrpos, p, n);
+		wrpos += n;
+		p += n;
+		len -= n;
+	}
+}
+
+void JsonBlockWriter::writeString(const StrViewA &str) {
+	static const char hex[] = "0123456789abcdef";
+	const unsigned char *p = reinterpret_cast<const unsigned char *>(str.data);
+	const unsigned char *e = p + str.length;
+	putChar('"');
+	while (p < e) {
+		const unsigned char *q = findEscape(p, e);
+		putSpan(p, q - p);
+		if (q == e) break;
+		unsigned char c = *q;
+		switch (c) {
+		case '"': putSpan("\\\"",2); break;
+		case '\\': putSpan("\\\\",2); break;
+		case '\b': putSpan("\\b",2); break;
+		case '\f': putSpan("\\f",2); break;
+		case '\n': putSpan("\\n",2); break;
+		case '\r': putSpan("\\r",2); break;
+		case '\t': putSpan("\\t",2); break;
+		default: {
+			char buf[6] = {'\\','u','0','0',hex[c >> 4],hex[c & 0xF]};
+			putSpan(buf,6);
+			break;
+		}
+		}
+		p = q + 1;
+	}
+	putChar('"');
+}
+
+void JsonBlockWriter::writeNumber(const Value &v) {
+	//integers are written directly, other numbers are formatted by the imtjson
+	auto fl = v.flags();
+	if (fl & (json::numberInteger|json::numberUnsignedInteger)) {
+		if (wrend - wrpos < 24) nextBuffer(24);
+		char *b = reinterpret_cast<char *>(wrpos);
+		char *e = reinterpret_cast<char *>(wrend);
+		auto r = (fl & json::numberUnsignedInteger)?std::to_chars(b, e, v.getUIntLong())
+				:std::to_chars(b, e, v.getIntLong());
+		wrpos = reinterpret_cast<unsigned char *>(r.ptr);
+	} else {
+		writeSerialized(v);
+	}
+}
+
+void JsonBlockWriter::writeSerialized(const Value &v) {
+	v.serialize([&](char c) {
+		putChar(c);
+	});
+}
+
+}
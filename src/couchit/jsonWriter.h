@@ -0,0 +1,61 @@
+/*
+ * jsonWriter.h
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_COUCHIT_JSONWRITER_H_
+#define SRC_COUCHIT_JSONWRITER_H_
+
+#include "json.h"
+
+namespace couchit {
+
+///Serializes JSON by blocks
+/**
+ * Unlike Value::serialize(), which calls a function for every character, the writer copies
+ * whole strings and numbers to the buffer. Strings are scanned for characters which need
+ * escaping by 16 bytes at once (SSE2, when available), and the parts which don't need escaping
+ * are copied by memcpy. The output is a compact JSON which is the same as the result of
+ * Value::stringify(). UTF-8 characters are written as they are.
+ *
+ * The derived class supplies buffers, see nextBuffer()
+ */
+class JsonBlockWriter {
+public:
+	virtual ~JsonBlockWriter() {}
+
+	///Serializes the value
+	void write(const Value &v);
+
+protected:
+	///current write position
+	unsigned char *wrpos = nullptr;
+	///end of the current buffer
+	unsigned char *wrend = nullptr;
+
+	///Called when the current buffer is full
+	/**
+	 * The function must process data written to the current buffer and set wrpos and wrend
+	 * to a new buffer.
+	 *
+	 * @param reqSize minimal required space. It is always small (up to 32 bytes)
+	 */
+	virtual void nextBuffer(std::size_t reqSize) = 0;
+
+	void putChar(char c) {
+		if (wrpos == wrend) nextBuffer(1);
+		*wrpos++ = static_cast<unsigned char>(c);
+	}
+	void putSpan(const void *data, std::size_t len);
+	void writeString(const StrViewA &str);
+	void writeNumber(const Value &v);
+	void writeSerialized(const Value &v);
+};
+
+}
+
+
+
+#endif /* SRC_COUCHIT_JSONWRITER_H_ */
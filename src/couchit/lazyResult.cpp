@@ -0,0 +1,258 @@
+/*
+ * lazyResult.cpp
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#include "lazyResult.h"
+
+#include <stdexcept>
+
+namespace couchit {
+
+namespace {
+
+///Finds boundaries of JSON values without parsing them
+class JsonScanner {
+public:
+	JsonScanner(StrViewA text):text(text),pos(0) {}
+
+	void skipWs() {
+		while (pos < text.length) {
+			char c = text[pos];
+			if (c != ' ' && c != '\t' && c != '\r' && c != '\n') break;
+			pos++;
+		}
+	}
+
+	bool eof() {
+		skipWs();
+		return pos >= text.length;
+	}
+
+	char peek() {
+		skipWs();
+		if (pos >= text.length) error();
+		return text[pos];
+	}
+
+	void expect(char c) {
+		if (peek() != c) error();
+		pos++;
+	}
+
+	bool accept(char c) {
+		if (peek() != c) return false;
+		pos++;
+		return true;
+	}
+
+	///Reads name of a member including the colon. Returns the name without quotes
+	StrViewA readName() {
+		StrViewA s = readValue();
+		expect(':');
+		if (s.length < 2 || s[0] != '"') error();
+		return s.substr(1, s.length-2);
+	}
+
+	///Skips a value and returns its text
+	StrViewA readValue() {
+		char c = peek();
+		std::size_t start = pos;
+		if (c == '"') {
+			skipString();
+		} else if (c == '{' || c == '[') {
+			skipContainer();
+		} else {
+			while (pos < text.length) {
+				c = text[pos];
+				if (c == ',' || c == '}' || c == ']' || c == ' ' || c == '\t' || c == '\r' || c == '\n') break;
+				pos++;
+			}
+			if (pos == start) error();
+		}
+		return text.substr(start, pos-start);
+	}
+
+	[[noreturn]] void error() {
+		throw std::runtime_error("LazyResult: Malformed JSON");
+	}
+
+protected:
+	StrViewA text;
+	std::size_t pos;
+
+	void skipString() {
+		pos++;
+		while (pos < text.length) {
+			char c = text[pos];
+			if (c == '"') {
+				pos++;
+				return;
+			}
+			pos += c == '\\'?2:1;
+		}
+		error();
+	}
+
+	void skipContainer() {
+		std::size_t depth = 0;
+		while (pos < text.length) {
+			char c = text[pos];
+			if (c == '"') {
+				skipString();
+				continue;
+			}
+			pos++;
+			if (c == '{' || c == '[') {
+				depth++;
+			} else if (c == '}' || c == ']') {
+				if (--depth == 0) return;
+			}
+		}
+		error();
+	}
+};
+
+static Value parseRaw(StrViewA raw) {
+	if (raw.empty()) return json::undefined;
+	return Value::fromString(raw);
+}
+
+}
+
+
+LazyResult::LazyResult(const Value &result) {
+	if (result.type() == json::string) {
+		source = String(result);
+		indexRows(source.str());
+		count = index.size();
+	} else {
+		if (result.type() == json::object) {
+			total = result["total_rows"].getUInt();
+			offset = result["offset"].getUInt();
+			updateSeq = result["update_seq"];
+			parsedRows = result["rows"];
+		} else {
+			parsedRows = result;
+		}
+		count = parsedRows.size();
+	}
+}
+
+void LazyResult::indexRows(StrViewA text) {
+	JsonScanner scn(text);
+	scn.expect('{');
+	if (scn.accept('}')) return;
+	do {
+		StrViewA name = scn.readName();
+		if (name == "rows") {
+			scn.expect('[');
+			if (!scn.accept(']')) {
+				do {
+					RowIndex ri;
+					scn.expect('{');
+					if (!scn.accept('}')) {
+						do {
+							StrViewA fld = scn.readName();
+							StrViewA val = scn.readValue();
+							if (fld == "key") ri.key = val;
+							else if (fld == "id") ri.id = val;
+							else if (fld == "value") ri.value = val;
+							else if (fld == "doc") ri.doc = val;
+							else if (fld == "error") ri.error = val;
+						} while (scn.accept(','));
+						scn.expect('}');
+					}
+					index.push_back(ri);
+				} while (scn.accept(','));
+				scn.expect(']');
+			}
+		} else {
+			StrViewA val = scn.readValue();
+			if (name == "total_rows") total = parseRaw(val).getUInt();
+			else if (name == "offset") offset = parseRaw(val).getUInt();
+			else if (name == "update_seq") updateSeq = parseRaw(val);
+		}
+	} while (scn.accept(','));
+	scn.expect('}');
+}
+
+StrViewA LazyResult::findMember(StrViewA text, StrViewA name) {
+	JsonScanner scn(text);
+	scn.expect('{');
+	if (scn.accept('}')) return StrViewA();
+	do {
+		StrViewA fld = scn.readName();
+		StrViewA val = scn.readValue();
+		if (fld == name) return val;
+	} while (scn.accept(','));
+	return StrViewA();
+}
+
+LazyRow LazyResult::operator[](std::size_t idx) const {
+	LazyRow rw;
+	if (idx >= count) return rw;
+	if (source.empty()) {
+		Value r = parsedRows[idx];
+		rw.key = r["key"];
+		rw.id = r["id"];
+		rw.error = r["error"];
+		rw.value = r["value"];
+		rw.doc = r["doc"];
+	} else {
+		const RowIndex &ri = index[idx];
+		rw.source = source;
+		rw.key = parseRaw(ri.key);
+		rw.id = parseRaw(ri.id);
+		rw.error = parseRaw(ri.error);
+		rw.rawValue = ri.value;
+		rw.rawDoc = ri.doc;
+	}
+	return rw;
+}
+
+Value LazyRow::getValue() const {
+	if (!rawValue.empty() && !value.defined()) value = parseRaw(rawValue);
+	return value;
+}
+
+Value LazyRow::getDoc() const {
+	if (!rawDoc.empty() && !doc.defined()) doc = parseRaw(rawDoc);
+	return doc;
+}
+
+Value LazyRow::getDocField(const StrViewA &name) const {
+	if (rawDoc.empty() || doc.defined()) return doc[name];
+	JsonScanner scn(rawDoc);
+	if (scn.peek() != '{') return json::undefined;
+	scn.expect('{');
+	if (scn.accept('}')) return json::undefined;
+	do {
+		StrViewA fld = scn.readName();
+		StrViewA val = scn.readValue();
+		if (fld.indexOf("\\",0) != fld.npos) {
+			//escaped name must be decoded before it is compared (quotes are around the name)
+			if (Value::fromString(StrViewA(fld.data-1, fld.length+2)).getString() == name) return parseRaw(val);
+		} else if (fld == name) {
+			return parseRaw(val);
+		}
+	} while (scn.accept(','));
+	return json::undefined;
+}
+
+Row LazyRow::toRow() const {
+	Object r;
+	if (key.defined()) r.set("key", key);
+	if (id.defined()) r.set("id", id);
+	if (error.defined()) r.set("error", error);
+	Value v = getValue();
+	if (v.defined()) r.set("value", v);
+	Value d = getDoc();
+	if (d.defined()) r.set("doc", d);
+	return Row(Value(r));
+}
+
+
+}
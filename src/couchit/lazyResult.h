@@ -0,0 +1,148 @@
+/*
+ * lazyResult.h
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_COUCHIT_LAZYRESULT_H_
+#define SRC_COUCHIT_LAZYRESULT_H_
+
+#include <vector>
+
+#include "json.h"
+#include "result.h"
+
+namespace couchit {
+
+
+///Row of the LazyResult
+/**
+ * The key, the id and the error are parsed when the row is created. The value and the
+ * document are kept as JSON text and parsed when they are accessed. Parsed values are
+ * remembered by the row.
+ */
+class LazyRow {
+public:
+	///contains key
+	Value key;
+	///contains source document ID
+	Value id;
+	///contains error information for this row
+	Value error;
+
+	LazyRow() {}
+
+	///Returns value of the row
+	Value getValue() const;
+	///Returns the document (will be undefined, if documents are not requested in the query)
+	Value getDoc() const;
+	///Returns single field of the document
+	/**
+	 * Only the requested field is parsed, the rest of the document is just skipped. This is
+	 * much faster than getDoc(), when only few fields of large documents are needed. Names
+	 * which contain escape sequences are decoded before they are compared.
+	 *
+	 * @param name name of the field
+	 * @return value of the field, or undefined, if the field doesn't exist
+	 */
+	Value getDocField(const StrViewA &name) const;
+
+	///Returns 'true' if row exists (it is not error)
+	bool exists() const {return error != null;}
+
+	///Converts to the Row (parses everything)
+	Row toRow() const;
+
+protected:
+	friend class LazyResult;
+
+	String source;
+	StrViewA rawValue;
+	StrViewA rawDoc;
+	mutable Value value;
+	mutable Value doc;
+};
+
+
+///Result of a query which parses documents and values on demand
+/**
+ * Execute the query with Query::lazy() (or View::lazyRows) and construct this object from
+ * the returned value. The response is kept as single string and only positions of the rows
+ * are indexed. This lowers both CPU time and memory, when the query includes large
+ * documents and only few fields are needed.
+ *
+ * @code
+ * LazyResult res = db.createQuery(view).includeDocs().lazy().exec();
+ * for (std::size_t i = 0; i < res.size(); i++) {
+ *     LazyRow rw = res[i];
+ *     std::cout << rw.id.getString() << " " << rw.getDocField("_rev").getString() << std::endl;
+ * }
+ * @endcode
+ *
+ * The object also accepts already parsed results (for example results of local views or
+ * queries with postprocessing), so the code can use it regardless on the source of the result.
+ */
+class LazyResult {
+public:
+
+	///Constructs the result
+	/**
+	 * @param result unparsed response (string), or parsed result (object or array of rows)
+	 * @exception std::exception response is not valid JSON
+	 */
+	LazyResult(const Value &result);
+
+	std::size_t getTotal() const {return total;}
+	std::size_t getOffset() const {return offset;}
+	///Returns update_seq if available
+	Value getUpdateSeq() const {return updateSeq;}
+
+	///Returns count of rows
+	std::size_t size() const {return count;}
+	///Returns row at given index
+	LazyRow operator[](std::size_t index) const;
+
+	bool hasItems() const {return pos < count;}
+	LazyRow getNext() {return operator[](pos++);}
+	LazyRow peek() const {return operator[](pos);}
+	void rewind() {pos = 0;}
+
+	///Finds a member of the top-level object in the unparsed response
+	/**
+	 * @param text unparsed response
+	 * @param name name of the member
+	 * @return JSON text of the member's value. It refers to the text, so the caller can
+	 * replace it. Returns empty string, if the member doesn't exist
+	 * @exception std::exception response is not valid JSON
+	 */
+	static StrViewA findMember(StrViewA text, StrViewA name);
+
+protected:
+
+	struct RowIndex {
+		StrViewA key;
+		StrViewA id;
+		StrViewA value;
+		StrViewA doc;
+		StrViewA error;
+	};
+
+	String source;
+	std::vector<RowIndex> index;
+	Value parsedRows;
+	std::size_t total = 0;
+	std::size_t offset = 0;
+	std::size_t count = 0;
+	std::size_t pos = 0;
+	Value updateSeq;
+
+	void indexRows(StrViewA text);
+};
+
+
+}
+
+
+
+#endif /* SRC_COUCHIT_LAZYRESULT_H_ */
@@ -15,6 +15,7 @@
 #include "json.h"
 #include "queryServerIfc.h"
 #include "iterrange.h"
+#include "nativeReduce.h"
 
 namespace couchit {
 
@@ -189,10 +190,14 @@ Value LocalView::getDocument(const String &docId) const {
 
 
 Value LocalView::reduce(const RowsWithKeys &r) const {
+	AbstractViewBase::ReduceMode mode = linkedView->reduceMode();
+	if (NativeReduce::isNative(mode)) return NativeReduce::reduce(mode, r);
 	return linkedView->reduce(r);
 }
 
 Value LocalView::rereduce(const ReducedRows &r) const {
+	AbstractViewBase::ReduceMode mode = linkedView->reduceMode();
+	if (NativeReduce::isNative(mode)) return NativeReduce::rereduce(mode, r);
 	return linkedView->rereduce(r);
 }
 
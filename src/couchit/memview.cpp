@@ -1,7 +1,9 @@
+#include <stdexcept>
 #include <unordered_set>
 #include "memview.h"
 
 #include "iterrange.h"
+#include "nativeReduce.h"
 
 
 namespace couchit {
@@ -260,6 +262,72 @@ void MemView::onChange(const ChangeEvent& doc) {
 	onUpdate();
 }
 
+bool MemView::onEvents(const ChangeEventBatch &events) {
+
+	typedef std::vector<std::pair<Value, Value> > Rows;
+
+	class Collect: public EmitFn {
+	public:
+		Collect(Rows &rows):rows(rows) {}
+		virtual void operator()(const Value &key, const Value &value) const {
+			rows.push_back(std::make_pair(key, value));
+		}
+	protected:
+		Rows &rows;
+	};
+
+	struct MappedDoc {
+		String id;
+		Value doc;
+		Rows rows;
+	};
+
+	USync _(updateLock);
+
+	std::vector<MappedDoc> mapped;
+	mapped.reserve(events.length);
+	Value lastSeq;
+	std::exception_ptr err;
+
+	for (std::size_t i = 0; i < events.length; i++) {
+		const ChangeEvent &ev = events[i];
+		if (ev.seqId.hasValue()) lastSeq = ev.seqId;
+		if (ev.idle) continue;
+		if (ev.deleted) {
+			mapped.push_back(MappedDoc{String(ev.id), Value(), Rows()});
+		} else {
+			Value vid = ev.doc["_id"];
+			if (vid.type() != json::string) continue;
+			String id(vid);
+			if ((flags &  flgIncludeDesignDocs) == 0 && id.substr(0,1) == "_") continue;
+			mapped.push_back(MappedDoc{id, ev.doc, Rows()});
+			try {
+				mapDoc(ev.doc, Collect(mapped.back().rows));
+			} catch (...) {
+				//the document is skipped, the rest of the batch is applied
+				mapped.pop_back();
+				if (!err) err = std::current_exception();
+			}
+		}
+	}
+
+	if (!mapped.empty()) {
+		Sync __(lock);
+		for (auto &&md : mapped) {
+			eraseDocLk(md.id);
+			for (auto &&kv : md.rows) {
+				addDocLk(md.id, md.doc, kv.first, kv.second);
+			}
+		}
+	}
+
+	if (lastSeq.hasValue())
+		updateSeq = lastSeq;
+	onUpdate();
+	if (err) std::rethrow_exception(err);
+	return true;
+}
+
 void MemView::addDoc(const Value& doc) {
 	Value vid = doc["_id"];
 	if (vid.type() == json::string) {
@@ -535,6 +603,24 @@ MemReduce::MemReduce(MemView& srcmap, ReduceFn&& reduceFn)
 	srcmap.reg(this);
 }
 
+MemReduce::MemReduce(MemView& srcmap, AbstractViewBase::ReduceMode mode)
+	:MemReduce(srcmap, nativeReduceFn(mode))
+{
+}
+
+MemReduce::ReduceFn MemReduce::nativeReduceFn(AbstractViewBase::ReduceMode mode) {
+	if (!NativeReduce::isNative(mode))
+		throw std::invalid_argument("MemReduce: reduce mode must be rmCount, rmSum or rmStats");
+	return [mode](const Result &res, bool rereduce) -> Value {
+		if (res.empty()) return Value();
+		std::vector<ReducedRow> values;
+		values.reserve(res.size());
+		for (Row rw : res) values.push_back(ReducedRow(rw.value));
+		ReducedRows rows(values.data(), values.size());
+		return rereduce?NativeReduce::rereduce(mode, rows):NativeReduce::reduce(mode, rows);
+	};
+}
+
 MemReduce::~MemReduce() {
 	if (srcmap) srcmap->unreg(this);
 
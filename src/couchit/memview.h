@@ -8,6 +8,7 @@
 #include "view.h"
 #include "query.h"
 #include "changes.h"
+#include "queryServerIfc.h"
 #include <unordered_map>
 #include <unordered_set>
 
@@ -80,7 +81,8 @@ public:
 	 * checkpoint service requires just storing a loading functions. Function also loads the data
 	 * from the last checkpoint and initializes updateSeq. You can call update() after checkpoint
 	 * is loaded. Checkpoints are generated after reasoned updates are made.
-	 * @param checkpointFile definition of checkpoint file.
+	 * @param checkpointFile definition of checkpoint file. Use journalCheckpoint() to share
+	 * single journal between more views and feeds.
 	 * @param serialNr serial number of current database
 	 * @param saveInterval interval in updates.Default value is 1000 updates so every 1000th
 	 * update new checkpoint is stored (replacing the oldone)
@@ -187,6 +189,14 @@ public:
 
 	virtual void onChange(const ChangeEvent &doc);
 
+	///Processes batch of changes
+	/** Documents are mapped outside of the lock, then the result is applied
+	 * under single exclusive lock, so readers see whole batch at once. A document whose
+	 * map function throws is skipped, the rest of the batch is applied and the first
+	 * exception is rethrown
+	 */
+	virtual bool onEvents(const ChangeEventBatch &events) override;
+
 
 	virtual Value getLastKnownSeqID() const;
 
@@ -402,8 +412,17 @@ public:
 
 
 	MemReduce(MemView &srcmap, ReduceFn &&reduceFn);
+	///Creates materialized reduce which uses build-in reduce function
+	/**
+	 * @param srcmap source map
+	 * @param mode one of AbstractViewBase::rmCount, AbstractViewBase::rmSum or AbstractViewBase::rmStats
+	 */
+	MemReduce(MemView &srcmap, AbstractViewBase::ReduceMode mode);
 	~MemReduce();
 
+	///Creates reduce function which calculates build-in function (_count, _sum, _stats) natively
+	static ReduceFn nativeReduceFn(AbstractViewBase::ReduceMode mode);
+
 	DirectAccess direct() const;
 	Query createQuery(std::size_t viewFlags) const;
 
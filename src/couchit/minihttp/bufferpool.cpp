@@ -0,0 +1,72 @@
+/*
+ * bufferpool.cpp
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#include "bufferpool.h"
+
+namespace couchit {
+
+unsigned char *IOBufferPool::acquire() {
+	{
+		std::lock_guard<std::mutex> _(lock);
+		if (!freeBuffers.empty()) {
+			unsigned char *b = freeBuffers.back();
+			freeBuffers.pop_back();
+			IOStats::getInstance().bufferReuses.fetch_add(1, std::memory_order_relaxed);
+			return b;
+		}
+	}
+	IOStats::getInstance().bufferAllocs.fetch_add(1, std::memory_order_relaxed);
+	return new unsigned char[bufferSize];
+}
+
+void IOBufferPool::release(unsigned char *buffer) {
+	if (buffer == nullptr) return;
+	{
+		std::lock_guard<std::mutex> _(lock);
+		if (freeBuffers.size() < maxPooled) {
+			freeBuffers.push_back(buffer);
+			return;
+		}
+	}
+	delete [] buffer;
+}
+
+IOBufferPool &IOBufferPool::getInstance() {
+	static IOBufferPool pool;
+	return pool;
+}
+
+IOBufferPool::~IOBufferPool() {
+	for (auto &&b: freeBuffers) delete [] b;
+}
+
+IOStats::Snapshot IOStats::get() const {
+	Snapshot s;
+	s.recvCalls = recvCalls.load(std::memory_order_relaxed);
+	s.recvBytes = recvBytes.load(std::memory_order_relaxed);
+	s.sendCalls = sendCalls.load(std::memory_order_relaxed);
+	s.sendBytes = sendBytes.load(std::memory_order_relaxed);
+	s.bufferAllocs = bufferAllocs.load(std::memory_order_relaxed);
+	s.bufferReuses = bufferReuses.load(std::memory_order_relaxed);
+	return s;
+}
+
+void IOStats::reset() {
+	recvCalls.store(0, std::memory_order_relaxed);
+	recvBytes.store(0, std::memory_order_relaxed);
+	sendCalls.store(0, std::memory_order_relaxed);
+	sendBytes.store(0, std::memory_order_relaxed);
+	bufferAllocs.store(0, std::memory_order_relaxed);
+	bufferReuses.store(0, std::memory_order_relaxed);
+}
+
+IOStats &IOStats::getInstance() {
+	static IOStats stats;
+	return stats;
+}
+
+}
@@ -0,0 +1,108 @@
+/*
+ * bufferpool.h
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_COUCHIT_SRC_COUCHIT_MINIHTTP_BUFFERPOOL_H_
+#define SRC_COUCHIT_SRC_COUCHIT_MINIHTTP_BUFFERPOOL_H_
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+namespace couchit {
+
+///Pool of large I/O buffers
+/**
+ * Network connections receive data into large buffers, so a response can be
+ * received by a few syscalls. Because allocation of such buffer for every connection
+ * is expensive, released buffers are kept in the pool and reused by next connection
+ */
+class IOBufferPool {
+public:
+
+	///Size of single buffer
+	static const std::size_t bufferSize = 65536;
+	///Maximum count of buffers kept in the pool
+	static const std::size_t maxPooled = 64;
+
+	///Retrieves a buffer from the pool or allocates new one
+	unsigned char *acquire();
+	///Returns buffer back to the pool
+	void release(unsigned char *buffer);
+
+	static IOBufferPool &getInstance();
+
+	~IOBufferPool();
+
+protected:
+	std::mutex lock;
+	std::vector<unsigned char *> freeBuffers;
+};
+
+///Counters of network I/O
+/** Counters are shared by all connections. They can be used to tune buffer sizes
+ * and batch sizes.
+ */
+class IOStats {
+public:
+
+	struct Snapshot {
+		std::uint64_t recvCalls;
+		std::uint64_t recvBytes;
+		std::uint64_t sendCalls;
+		std::uint64_t sendBytes;
+		std::uint64_t bufferAllocs;
+		std::uint64_t bufferReuses;
+	};
+
+	std::atomic<std::uint64_t> recvCalls{0};
+	std::atomic<std::uint64_t> recvBytes{0};
+	std::atomic<std::uint64_t> sendCalls{0};
+	std::atomic<std::uint64_t> sendBytes{0};
+	std::atomic<std::uint64_t> bufferAllocs{0};
+	std::atomic<std::uint64_t> bufferReuses{0};
+
+	///Counters of the calling thread
+	/** Requests are processed synchronously, so the difference of these counters taken
+	 * before and after the request is the traffic of that request
+	 */
+	struct ThreadCounters {
+		std::uint64_t recvBytes = 0;
+		std::uint64_t sendBytes = 0;
+	};
+
+	void recordRecv(std::size_t bytes) {
+		recvCalls.fetch_add(1, std::memory_order_relaxed);
+		recvBytes.fetch_add(bytes, std::memory_order_relaxed);
+		thisThread().recvBytes += bytes;
+	}
+
+	void recordSend(std::size_t bytes) {
+		sendCalls.fetch_add(1, std::memory_order_relaxed);
+		sendBytes.fetch_add(bytes, std::memory_order_relaxed);
+		thisThread().sendBytes += bytes;
+	}
+
+	///Retrieves counters of the calling thread
+	static ThreadCounters &thisThread() {
+		static thread_local ThreadCounters counters;
+		return counters;
+	}
+
+	///Retrieves current state of counters
+	Snapshot get() const;
+	///Resets all counters to zero
+	void reset();
+
+	static IOStats &getInstance();
+};
+
+}
+
+
+
+#endif /* SRC_COUCHIT_SRC_COUCHIT_MINIHTTP_BUFFERPOOL_H_ */
@@ -68,47 +68,53 @@ protected:
 		return input->waitRead(milisecs);
 	}
 
-	bool parseChunkLine(std::size_t &put_back_count) {
-		auto pos = chunkLine.find("\r\n");
-		decltype(pos) beg = 0;
-		if (pos == 0) {
-			beg = pos+2;
-			pos = chunkLine.find("\r\n",beg);
-		}
-
-		if (pos == chunkLine.npos) return false;
-		put_back_count = chunkLine.length() - pos - 2;
-
+	///Parses collected chunk header
+	/**
+	 * @retval true header parsed, curChunk contains size of the chunk
+	 * @retval false header is empty (end of line of the previous chunk)
+	 */
+	bool parseChunkHeader() {
+		if (chunkHdrSz == 0) return false;
 		std::size_t n = 0;
-		for (auto x = beg; x < pos; x++) {
+		for (unsigned int x = 0; x < chunkHdrSz; x++) {
+			char c = chunkHdr[x];
+			if (c == ';') break; //chunk extension
 			n = n * 16;
-			char c = chunkLine[x];
 			if (isdigit(c)) n = n + (c - '0');
 			else if (c >= 'A' && c <= 'F') n = n + (c-'A'+10);
 			else if (c >= 'a' && c <= 'f') n = n + (c-'a'+10);
 			else throw std::runtime_error("Invalid chunk header");
 		}
+		chunkHdrSz = 0;
 		curChunk = n;
 		return true;
-
 	}
 
+	///Reads chunk header
+	/** Chunk header is parsed directly from the input buffer. Only the header
+	 * itself is collected (because it can be split between two reads), the
+	 * data of the chunk are never copied
+	 */
 	bool openChunk(bool nonblock) {
 		do {
 			auto buff = input->read(nonblock);
 			if (AbstractInputStream::isEof(buff)) {
 				return false;
 			}
-
-			chunkLine.append(reinterpret_cast<const char *>(buff.data), buff.length);
-			std::size_t put_back_count;
-			if (parseChunkLine(put_back_count)) {
-				input->putBack(buff.substr(buff.length-put_back_count));
-				chunkLine.clear();
-				return curChunk > 0;
+			std::size_t pos = 0;
+			while (pos < buff.length) {
+				char c = buff[pos++];
+				if (c == '\n') {
+					if (parseChunkHeader()) {
+						input->putBack(buff.substr(pos));
+						return curChunk > 0;
+					}
+				} else if (c != '\r') {
+					if (chunkHdrSz == sizeof(chunkHdr))
+						throw std::runtime_error("Chunk header is too long (50+ bytes)");
+					chunkHdr[chunkHdrSz++] = c;
+				}
 			}
-			if (chunkLine.length() > 50)
-				throw std::runtime_error("Chunk header is too long (50+ bytes)");
 		}
 		while (!nonblock);
 		return true;
@@ -150,7 +156,8 @@ protected:
 #endif
 	InputStream input;
 	unsigned int curChunk = 0;
-	std::string chunkLine;
+	char chunkHdr[50];
+	unsigned int chunkHdrSz = 0;
 	bool eof = false;
 };
 
@@ -0,0 +1,189 @@
+/*
+ * compression.cpp
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#include <stdexcept>
+#include "compression.h"
+
+#ifdef COUCHIT_ZLIB
+#include <zlib.h>
+#endif
+
+namespace couchit {
+
+#ifdef COUCHIT_ZLIB
+
+bool isCompressionSupported() {
+	return true;
+}
+
+struct InflateInputStream::State {
+	z_stream strm;
+};
+
+struct DeflateOutputStream::State {
+	z_stream strm;
+};
+
+InflateInputStream::InflateInputStream(InputStream source)
+	:source(source),state(new State)
+{
+	std::memset(&state->strm, 0, sizeof(state->strm));
+	//15+32 - detect gzip or zlib header automatically
+	if (inflateInit2(&state->strm, 15+32) != Z_OK) {
+		delete state;
+		throw std::runtime_error("Failed to initialize decompression");
+	}
+}
+
+InflateInputStream::~InflateInputStream() {
+	inflateEnd(&state->strm);
+	delete state;
+}
+
+json::BinaryView InflateInputStream::doRead(bool nonblock) {
+	z_stream &strm = state->strm;
+	while (!finished) {
+		json::BinaryView in(nullptr, 0);
+		if (!pending) {
+			in = source.read(nonblock);
+			if (AbstractInputStream::isEof(in)) {
+				throw std::runtime_error("Compressed stream is truncated");
+			}
+			if (in.empty()) return json::BinaryView(0,0);
+		}
+		strm.next_in = const_cast<Bytef *>(in.data);
+		strm.avail_in = in.length;
+		strm.next_out = outBuff;
+		strm.avail_out = sizeof(outBuff);
+		int r = inflate(&strm, Z_NO_FLUSH);
+		source.putBack(in.substr(in.length - strm.avail_in));
+		if (r == Z_STREAM_END) {
+			finished = true;
+		} else if (r != Z_OK && r != Z_BUF_ERROR) {
+			throw std::runtime_error("Failed to decompress the stream");
+		}
+		//output buffer is full, there can be more data pending in the decoder
+		pending = strm.avail_out == 0;
+		std::size_t produced = sizeof(outBuff) - strm.avail_out;
+		if (produced) return json::BinaryView(outBuff, produced);
+	}
+	//the source must end together with the compressed stream (for example, the chunked
+	//stream must read its final chunk), otherwise the connection cannot be reused
+	while (!sourceEof) {
+		json::BinaryView in = source.read(nonblock);
+		if (AbstractInputStream::isEof(in)) {
+			sourceEof = true;
+		} else if (in.empty()) {
+			return json::BinaryView(0,0);
+		} else {
+			throw std::runtime_error("Unexpected data after the end of the compressed stream");
+		}
+	}
+	return AbstractInputStream::eofConst;
+}
+
+bool InflateInputStream::doWaitRead(int milisecs) {
+	if (pending || sourceEof) return true;
+	return source->waitRead(milisecs);
+}
+
+void InflateInputStream::closeInput() {
+	source->closeInput();
+}
+
+DeflateOutputStream::DeflateOutputStream(OutputStream target, int level)
+	:target(target),state(new State)
+{
+	std::memset(&state->strm, 0, sizeof(state->strm));
+	//15+16 - write gzip header
+	if (deflateInit2(&state->strm, level, Z_DEFLATED, 15+16, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+		delete state;
+		throw std::runtime_error("Failed to initialize compression");
+	}
+}
+
+DeflateOutputStream::~DeflateOutputStream() {
+	deflateEnd(&state->strm);
+	delete state;
+}
+
+void DeflateOutputStream::compress(const json::BinaryView &data, int mode) {
+	z_stream &strm = state->strm;
+	strm.next_in = const_cast<Bytef *>(data.data);
+	strm.avail_in = data.length;
+	int r;
+	do {
+		//compress directly to the buffer of the target stream
+		Buffer b = target->getBuffer();
+		strm.next_out = b.buff;
+		strm.avail_out = b.size;
+		r = deflate(&strm, mode);
+		if (r == Z_STREAM_ERROR) {
+			throw std::runtime_error("Failed to compress the stream");
+		}
+		target->commit(b.size - strm.avail_out);
+	} while (strm.avail_out == 0 || (mode == Z_FINISH && r != Z_STREAM_END));
+}
+
+json::BinaryView DeflateOutputStream::doWrite(const json::BinaryView &data, bool ) {
+	if (data.empty()) return data;
+	compress(data, Z_NO_FLUSH);
+	return json::BinaryView(0,0);
+}
+
+void DeflateOutputStream::flush() {
+	AbstractOutputStream::flush();
+	if (!closed) compress(json::BinaryView(nullptr, 0), Z_SYNC_FLUSH);
+	target.flush();
+}
+
+#else
+
+bool isCompressionSupported() {
+	return false;
+}
+
+struct InflateInputStream::State {};
+struct DeflateOutputStream::State {};
+
+InflateInputStream::InflateInputStream(InputStream source):source(source),state(nullptr) {
+	throw std::runtime_error("Compression is not supported");
+}
+InflateInputStream::~InflateInputStream() {}
+json::BinaryView InflateInputStream::doRead(bool) {return AbstractInputStream::eofConst;}
+bool InflateInputStream::doWaitRead(int) {return true;}
+void InflateInputStream::closeInput() {}
+
+DeflateOutputStream::DeflateOutputStream(OutputStream target, int):target(target),state(nullptr) {
+	throw std::runtime_error("Compression is not supported");
+}
+DeflateOutputStream::~DeflateOutputStream() {}
+void DeflateOutputStream::compress(const json::BinaryView &, int ) {}
+json::BinaryView DeflateOutputStream::doWrite(const json::BinaryView &data, bool ) {return data;}
+void DeflateOutputStream::flush() {}
+
+#endif
+
+bool DeflateOutputStream::doWaitWrite(int milisecs) {
+	return target->waitWrite(milisecs);
+}
+
+AbstractOutputStream::Buffer DeflateOutputStream::createBuffer() {
+	return Buffer(inBuff, sizeof(inBuff));
+}
+
+void DeflateOutputStream::closeOutput() {
+	if (closed) return;
+	AbstractOutputStream::flush();
+#ifdef COUCHIT_ZLIB
+	compress(json::BinaryView(nullptr, 0), Z_FINISH);
+#endif
+	closed = true;
+	target(nullptr);
+}
+
+}
@@ -0,0 +1,88 @@
+/*
+ * compression.h
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_COUCHIT_SRC_COUCHIT_MINIHTTP_COMPRESSION_H_
+#define SRC_COUCHIT_SRC_COUCHIT_MINIHTTP_COMPRESSION_H_
+
+#include "abstractio.h"
+
+namespace couchit {
+
+///Returns true, when the library has been compiled with the compression support (zlib)
+bool isCompressionSupported();
+
+///Decodes gzip or deflate (zlib) compressed stream
+/**
+ * The stream decompresses data read from the source stream. Format of the source
+ * is detected automatically. The source is read to its end after the compressed stream
+ * is finished. When the source ends before the compressed stream is finished, or when
+ * there are data after it, the stream throws an exception.
+ *
+ * @note if the library has been compiled without compression support, the constructor
+ * throws an exception
+ */
+class InflateInputStream: public AbstractInputStream {
+public:
+	InflateInputStream(InputStream source);
+	~InflateInputStream();
+
+	virtual void closeInput() override;
+
+protected:
+
+	virtual json::BinaryView doRead(bool nonblock = false) override;
+	virtual bool doWaitRead(int milisecs) override;
+
+	struct State;
+
+	InputStream source;
+	State *state;
+	bool finished = false;
+	bool sourceEof = false;
+	bool pending = false;
+	unsigned char outBuff[65536];
+};
+
+///Compresses the stream to the gzip format
+/**
+ * Data written to the stream are compressed and written to the target stream. Compressed
+ * data are written directly to the buffer of the target stream. Closing this
+ * stream finishes compression and closes the target stream.
+ *
+ * @note if the library has been compiled without compression support, the constructor
+ * throws an exception
+ */
+class DeflateOutputStream: public AbstractOutputStream {
+public:
+	DeflateOutputStream(OutputStream target, int level = 6);
+	~DeflateOutputStream();
+
+	virtual void closeOutput() override;
+	virtual void flush() override;
+
+protected:
+
+	virtual Buffer createBuffer() override;
+	virtual json::BinaryView doWrite(const json::BinaryView &data, bool nonblock) override;
+	virtual bool doWaitWrite(int milisecs) override;
+
+	void compress(const json::BinaryView &data, int mode);
+
+	struct State;
+
+	OutputStream target;
+	State *state;
+	bool closed = false;
+	unsigned char inBuff[16384];
+};
+
+
+}
+
+
+
+#endif /* SRC_COUCHIT_SRC_COUCHIT_MINIHTTP_COMPRESSION_H_ */
@@ -47,7 +47,15 @@ inline json::Value couchit::HeaderRead<Fn>::parseHeaders() {
 		}
 
 		std::size_t pos = line.indexOf(":",0);
-		if (pos != line.npos) {
+		std::size_t lsp = line.lastIndexOf(" ");
+		if (!stline && lsp != line.npos && line.substr(lsp+1,6) == "HTTP/1") {
+			//request line (METHOD URI VERSION) - URI can contain colon
+			stline = true;
+			std::size_t fsp = line.indexOf(" ",0);
+			collect("_method",line.substr(0,fsp));
+			collect("_uri",trim(line.substr(fsp+1,lsp-fsp-1)));
+			collect("_version",line.substr(lsp+1));
+		} else if (pos != line.npos) {
 			StrViewA field = line.substr(0,pos);
 			StrViewA value = line.substr(pos+1);
 			StrViewA cfield = trim(field);
@@ -7,13 +7,70 @@
 
 #include "httpclient.h"
 
+#include <cerrno>
+
 
 
 #include "chunkstream.h"
+#include "compression.h"
 #include "hdrrd.h"
 #include "hdrwr.h"
 namespace couchit {
 
+class LimitedStream: public AbstractInputStream {
+public:
+	LimitedStream(const InputStream &stream, std::size_t limit)
+		:stream(stream), limit(limit) {}
+
+	~LimitedStream() {
+	}
+
+	virtual void closeInput() {
+		stream->closeInput();
+	}
+
+	///Transfers rest of the stream to the descriptor
+	std::size_t transferTo(NetworkConnection &conn, int fd) {
+		std::size_t done = 0;
+		if (!lastBuff.empty()) {
+			NetworkConnection::writeToFd(fd, lastBuff, conn.getTimeout());
+			done += lastBuff.length;
+			lastBuff = json::BinaryView();
+		}
+		std::size_t r = conn.recvToFile(fd, limit);
+		limit -= r;
+		return done + r;
+	}
+
+	///Returns true, when whole content has been read
+	bool isComplete() const {
+		return limit == 0;
+	}
+
+protected:
+
+	virtual json::BinaryView doRead(bool nonblock = false) {
+		if (limit == 0) return eofConst;
+
+		auto x =  stream->read(nonblock);
+		auto rest = x.substr(limit);
+		x = x.substr(0,limit);
+		limit = limit-x.length;
+		stream->putBack(rest);
+
+		return x;
+	}
+	virtual bool doWaitRead(int milisecs) {
+		return stream->waitRead(milisecs);
+	}
+
+
+protected:
+	InputStream stream;
+	std::size_t limit;
+	std::size_t commitSize = 0;
+};
+
 
 HttpClient::HttpClient()
 	:curTimeout(70000)
@@ -74,7 +131,7 @@ bool HttpClient::handleSendError() {
 
 }
 
-OutputStream HttpClient::beginBody() {
+OutputStream HttpClient::beginBody(std::size_t contentLength) {
 
 
 	class ErrorStream: public AbstractOutputStream {
@@ -96,18 +153,27 @@ OutputStream HttpClient::beginBody() {
 	if (curTarget.empty()) {
 		return OutputStream(new ErrorStream);
 	}else {
-		initRequest(true,-1);
+		initRequest(true,contentLength);
 		if (handleSendError()) {
 			return OutputStream(new ErrorStream);
-		} else {
+		} else if (contentLength == std::size_t(-1)) {
 			return OutputStream(new ChunkedOutputStream<>(OutputStream(conn)));
+		} else {
+			return OutputStream(conn);
 		}
 	}
 }
 
+OutputStream HttpClient::beginBody() {
+	return beginBody(std::size_t(-1));
+}
+
 int HttpClient::send() {
 	if (!headersSent) {
 		initRequest(false,0);
+	} else if (conn != nullptr) {
+		//flush rest of the body
+		conn->flush();
 	}
 	if (handleSendError()) {
 		return curStatus;
@@ -121,13 +187,35 @@ int HttpClient::send(const StrViewA& body) {
 
 int HttpClient::send(const void* body, std::size_t body_length) {
 	if (!headersSent) {
-		initRequest(true,body_length);
+		//headers stay in the buffer and they are sent together with the body
+		initRequest(true,body_length,false);
 		if (handleSendError()) {
 			return curStatus;
 		}
-		OutputStream stream(conn);
-		stream(json::BinaryView(reinterpret_cast<const unsigned char *>(body), body_length));
-		stream->commit(0,true);
+		conn->sendWithBuffer(json::BinaryView(reinterpret_cast<const unsigned char *>(body), body_length));
+	}
+	if (handleSendError()) {
+		return curStatus;
+	}
+	return readResponse();
+}
+
+int HttpClient::sendFile(int fd, std::uint64_t offset, std::size_t length) {
+	if (!headersSent) {
+		initRequest(true,length);
+		if (handleSendError()) {
+			return curStatus;
+		}
+		std::size_t done = conn->sendFile(fd, offset, length);
+		if (handleSendError()) {
+			return curStatus;
+		}
+		if (done < length) {
+			//the file is shorter than the declared Content-Length, the request is incomplete
+			conn = nullptr;
+			curStatus = -EIO;
+			return curStatus;
+		}
 	}
 	if (handleSendError()) {
 		return curStatus;
@@ -173,7 +261,31 @@ void HttpClient::discardResponse() {
 	}
 }
 
-void HttpClient::initRequest(bool haveBody, std::size_t contentLength) {
+std::size_t HttpClient::readResponseTo(int fd) {
+	if (responseData == nullptr) return 0;
+	std::size_t done = 0;
+	bool complete = true;
+	LimitedStream *ls = dynamic_cast<LimitedStream *>(static_cast<AbstractInputStream *>(responseData));
+	if (ls != nullptr && conn != nullptr) {
+		done = ls->transferTo(*conn, fd);
+		complete = ls->isComplete();
+	} else {
+		int tm = conn != nullptr?static_cast<int>(conn->getTimeout()):-1;
+		BinaryView b = responseData->read();
+		while (!b.empty()) {
+			NetworkConnection::writeToFd(fd, b, tm);
+			done += b.length;
+			b = responseData->read();
+		}
+	}
+	responseData = nullptr;
+	//rest of the body is still in the connection (timeout, closed by the peer), so it cannot be reused
+	if (conn != nullptr && (!complete || conn->hasErrors()))
+		conn = nullptr;
+	return done;
+}
+
+void HttpClient::initRequest(bool haveBody, std::size_t contentLength, bool flush) {
 
 	if (conn == nullptr) {
 		connectTarget();
@@ -204,6 +316,10 @@ void HttpClient::initRequest(bool haveBody, std::size_t contentLength) {
 		hdr("Connection","close");
 	}
 
+	if (compression && !hdr["Accept-Encoding"].defined()) {
+		hdr("Accept-Encoding","gzip, deflate");
+	}
+
 	if (!auth.empty()) {
 		String authstr((auth.length()+2)*4/3+7,[&](char *c) {
 			char *s = c;
@@ -223,49 +339,13 @@ void HttpClient::initRequest(bool haveBody, std::size_t contentLength) {
 
 	hdrwr.serialize(hdr);
 
-	stream->commit(0,true);
+	stream->commit(0,flush);
 
 	headersSent = true;
 }
 
 int HttpClient::readResponse() {
 
-	class LimitedStream: public AbstractInputStream {
-	public:
-		LimitedStream(const InputStream &stream, std::size_t limit)
-			:stream(stream), limit(limit) {}
-
-		~LimitedStream() {
-		}
-
-		virtual void closeInput() {
-			stream->closeInput();
-		}
-
-	protected:
-
-		virtual json::BinaryView doRead(bool nonblock = false) {
-			if (limit == 0) return eofConst;
-
-			auto x =  stream->read(nonblock);
-			auto rest = x.substr(limit);
-			x = x.substr(0,limit);
-			limit = limit-x.length;
-			stream->putBack(rest);
-
-			return x;
-		}
-		virtual bool doWaitRead(int milisecs) {
-			return stream->waitRead(milisecs);
-		}
-
-
-	protected:
-		InputStream stream;
-		std::size_t limit;
-		std::size_t commitSize = 0;
-	};
-
 	PNetworkConection conn = this->conn;
 
 	if (conn == nullptr) {
@@ -301,6 +381,11 @@ int HttpClient::readResponse() {
 		}
 	}
 
+	StrViewA ce = v["Content-Encoding"].getString();
+	if ((ce == "gzip" || ce == "deflate") && isCompressionSupported()) {
+		responseData = new InflateInputStream(static_cast<AbstractInputStream *>(responseData));
+	}
+
 	if (v["Connection"].getString() == "close") {
 		this->keepAlive = false;
 	}
@@ -309,6 +394,85 @@ int HttpClient::readResponse() {
 
 }
 
+std::vector<HttpClient::PipelinedResponse> HttpClient::pipelineGET(const std::vector<json::String> &urls, Value headers, std::size_t depth) {
+	std::vector<PipelinedResponse> res(urls.size());
+	std::size_t next = 0;
+	bool retried = false;
+	if (depth == 0) depth = 1;
+	while (next < urls.size()) {
+		open(urls[next], "GET", true);
+		customHeaders = headers;
+		json::String target = curTarget;
+		//crackURL() overwrites the path and the credentials, so they are remembered
+		//for each request and restored before the request is sent
+		std::vector<std::pair<json::String, json::String> > paths;
+		paths.push_back(std::make_pair(curPath, auth));
+		if (!target.empty()) {
+			for (std::size_t i = next+1; i < urls.size() && paths.size() < depth; i++) {
+				StrViewA u = urls[i];
+				if (u.substr(0,7) != "http://" || crackURL(u.substr(7)) != target) break;
+				paths.push_back(std::make_pair(curPath, auth));
+			}
+			curPath = paths[0].first;
+			auth = paths[0].second;
+		}
+
+		int err = 0;
+		std::size_t sent = 0;
+		for (auto &&p: paths) {
+			curPath = p.first;
+			auth = p.second;
+			initRequest(false,0);
+			if (handleSendError()) {
+				err = curStatus;
+				break;
+			}
+			++sent;
+		}
+
+		std::size_t done = 0;
+		bool lost = false;
+		while (done < sent) {
+			int st = readResponse();
+			if (st <= 0) {
+				err = st;
+				lost = true;
+				break;
+			}
+			PipelinedResponse &r = res[next];
+			r.status = st;
+			r.headers = responseHeaders;
+			BinaryView b = responseData->read();
+			while (!b.empty()) {
+				r.body.append(reinterpret_cast<const char *>(b.data), b.length);
+				b = responseData->read();
+			}
+			responseData = nullptr;
+			++next;
+			++done;
+			retried = false;
+			//the server is going to close the connection, rest must be sent again
+			if (!keepAlive || conn == nullptr) break;
+		}
+
+		if (done < paths.size()) {
+			conn = nullptr;
+			if (done == 0) {
+				if (retried) {
+					res[next].status = err;
+					++next;
+					retried = false;
+				} else {
+					retried = true;
+				}
+			} else if (lost) {
+				depth = 1;
+			}
+		}
+	}
+	return res;
+}
+
 bool HttpClient::everythingRead(AbstractInputStream* stream) {
 	json::BinaryView b = stream->read(0);
 	return b.empty();
@@ -384,6 +548,10 @@ void HttpClient::setTimeout(std::uintptr_t timeoutInMS) {
 		conn->setTimeout(timeoutInMS);
 	}
 }
+void HttpClient::setCompression(bool enable) {
+	compression = enable && isCompressionSupported();
+}
+
 void HttpClient::initConnection() {
 	conn->setTimeout(curTimeout);
 	conn->setCancelFunction(cancelFunction);
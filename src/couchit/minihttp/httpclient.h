@@ -7,6 +7,8 @@
 
 #ifndef LIGHTCOUCH_MINIHTTP_HTTPCLIENT_H_
 #define LIGHTCOUCH_MINIHTTP_HTTPCLIENT_H_
+#include <string>
+#include <vector>
 #include "../json.h"
 #include "abstractio.h"
 #include "netio.h"
@@ -40,6 +42,16 @@ public:
 	///Sets i/o timeout
 	void setTimeout(std::uintptr_t timeoutInMS);
 
+	///Enables or disables compressed responses
+	/**
+	 * @param enable set true to send Accept-Encoding: gzip, deflate. Compressed responses
+	 * are decoded transparently while the response is read
+	 *
+	 * @note compression is available only when the library has been compiled with zlib, otherwise
+	 * the function does nothing
+	 */
+	void setCompression(bool enable);
+
 	///Constructs CancelFunction object
 	static CancelFunction initCancelFunction();
 
@@ -65,6 +77,15 @@ public:
 	 */
 	OutputStream beginBody();
 
+	///Starts to generate a request body of known length
+	/** The body is sent directly to the connection without chunked encoding. You
+	 * have to write exactly contentLength bytes, then call the function send()
+	 *
+	 * @param contentLength length of the body in bytes
+	 * @return OutputStream object
+	 */
+	OutputStream beginBody(std::size_t contentLength);
+
 	///Sends the request with or without the body
 	/**
 	 * If the body has been opened by beginBody(), the function finish the body and receives
@@ -100,6 +121,18 @@ public:
 	 * @note if the body has been started by beginBody(), the function ignores the argument
 	 * */
 	int send(const void *body, std::size_t body_length);
+	///Sends the request with the body read from a file
+	/**
+	 * The body is transfered from the file directly to the connection (see
+	 * NetworkConnection::sendFile), so memory usage doesn't depend on the size of the body
+	 *
+	 * @param fd file descriptor of the source file
+	 * @param offset offset in the file
+	 * @param length length of the body in bytes
+	 * @return status code of the response, see send(). If the file ends before the length
+	 * is sent, the connection is closed and the function returns -EIO
+	 */
+	int sendFile(int fd, std::uint64_t offset, std::size_t length);
 
 	///Retrieves headers after response is retrieved
 	/**
@@ -119,6 +152,20 @@ public:
 	 */
 	bool waitForData(int timeout);
 
+	///Writes the response body to a descriptor
+	/**
+	 * If the response has known length, data are transfered from the connection directly
+	 * to the descriptor (see NetworkConnection::recvToFile). Otherwise, they are copied.
+	 *
+	 * @param fd target descriptor (file or pipe)
+	 * @return count of bytes written. If it is less than the Content-Length (timeout,
+	 * connection closed by the peer), the connection is closed, so it is not reused by the
+	 * next request
+	 *
+	 * @note function reads rest of the response, there is no need to call discardResponse()
+	 */
+	std::size_t readResponseTo(int fd);
+
 	///Discards response data to allow to reuse connection
 	/** You have to call this function to finish response. This is not
 	 * made automatically.
@@ -126,6 +173,35 @@ public:
 	void discardResponse();
 
 
+	///Response of the pipelined request
+	struct PipelinedResponse {
+		///status code. Zero or negative value means error (see send())
+		int status = 0;
+		///response headers (see getHeaders())
+		Value headers;
+		///response body
+		std::string body;
+	};
+
+	///Sends GET requests through single connection without waiting for responses (HTTP pipelining)
+	/**
+	 * Requests are written to the keep-alive connection back to back and responses are
+	 * read in the same order, so a burst of small requests costs one round trip instead
+	 * of many. Whole responses are read to the memory.
+	 *
+	 * If the server closes the connection in the middle of the pipeline, unanswered requests
+	 * are sent again through a new connection one by one, because the server probably doesn't
+	 * support pipelining. This is safe, because GET requests are idempotent. When the request
+	 * fails as the first request of the connection, it is tried once more, then the
+	 * error is reported in its status.
+	 *
+	 * @param urls urls of requests. The pipeline is split when the target server changes
+	 * @param headers custom headers sent with all requests
+	 * @param depth maximum count of requests sent before their responses are read
+	 * @return responses in the same order as urls
+	 */
+	std::vector<PipelinedResponse> pipelineGET(const std::vector<json::String> &urls, Value headers = Value(), std::size_t depth = 16);
+
 	void close();
 
 	void abort();
@@ -156,12 +232,13 @@ protected:
 	json::Value responseHeaders;
 	uintptr_t curTimeout;
 	bool keepAlive = false;
+	bool compression = false;
 	int curStatus;
 	bool headersSent;
 	CancelFunction cancelFunction;
 
 
-	void initRequest(bool haveBody, std::size_t contentLength);
+	void initRequest(bool haveBody, std::size_t contentLength, bool flush = true);
 	int readResponse();
 
 
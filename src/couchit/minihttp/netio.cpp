@@ -6,6 +6,7 @@
  */
 
 
+#include <algorithm>
 #include <cstring>
 #include <poll.h>
 #include "netio.h"
@@ -15,9 +16,12 @@
 #include <imtjson/json.h>
 #include <netdb.h>
 #include <sys/socket.h>
+#include <sys/sendfile.h>
+#include <sys/uio.h>
 #include <unistd.h>
 #include "../exception.h"
 
+#include <netinet/in.h>
 #include <netinet/tcp.h>
 
 #include "../json.h"
@@ -122,6 +126,7 @@ NetworkConnection* couchit::NetworkConnection::connect(const StrViewA &addr_ddot
 
 couchit::NetworkConnection::NetworkConnection(int socket)
 	:socket(socket)
+	,inputBuff(IOBufferPool::getInstance().acquire())
 	,eofFound(false)
 	,lastSendError(0)
 	,lastRecvError(0)
@@ -135,6 +140,7 @@ couchit::NetworkConnection::NetworkConnection(int socket)
 
 NetworkConnection::~NetworkConnection() {
 	::close(socket);
+	IOBufferPool::getInstance().release(inputBuff);
 }
 
 ICancelWait* NetworkConnection::createCancelFunction() {
@@ -150,8 +156,9 @@ void NetworkConnection::setTimeout(std::uintptr_t timeout) {
 }
 
 json::BinaryView NetworkConnection::doRead(bool nonblock) {
-	int rc = recv(socket,inputBuff,3000,0);
+	int rc = recv(socket,inputBuff,IOBufferPool::bufferSize,0);
 	if (rc > 0) {
+		IOStats::getInstance().recordRecv(rc);
 //		std::cout << "Read: " << StrViewA(BinaryView(inputBuff,rc)) << std::endl;
 		return json::BinaryView(inputBuff,rc);
 	} else if (rc == 0) {
@@ -216,6 +223,7 @@ json::BinaryView NetworkConnection::doWrite(const json::BinaryView &data, bool n
 	if (data.empty()) return data;
 	if (lastSendError || timeout) return json::BinaryView(0,0);
 	int sent = send(socket, data.data, data.length,0);
+	if (sent > 0) IOStats::getInstance().recordSend(sent);
 	if (sent < 0) {
 		int err = errno;
 		if (err != EWOULDBLOCK && err != EINTR && err != EAGAIN) {
@@ -304,10 +312,269 @@ void NetworkConnection::close() {
 	shutdown(socket, SHUT_RDWR);
 }
 
+std::size_t NetworkConnection::sendFile(int fd, std::uint64_t offset, std::size_t length) {
+	flush();
+	off_t off = offset;
+	std::size_t done = 0;
+	bool useSendFile = true;
+	while (done < length && !lastSendError && !timeout) {
+		if (useSendFile) {
+			ssize_t r = ::sendfile(socket, fd, &off, length - done);
+			if (r > 0) {
+				IOStats::getInstance().recordSend(r);
+				done += r;
+			} else if (r == 0) {
+				//end of file reached
+				break;
+			} else {
+				int err = errno;
+				if (err == EWOULDBLOCK || err == EAGAIN || err == EINTR) {
+					if (doWaitWrite(timeoutTime) == false) timeout = true;
+				} else if ((err == EINVAL || err == ENOSYS) && done == 0) {
+					useSendFile = false;
+				} else {
+					lastSendError = err;
+				}
+			}
+		} else {
+			std::size_t toread = std::min(length - done, sizeof(outputBuff));
+			ssize_t r = ::pread(fd, outputBuff, toread, off);
+			if (r > 0) {
+				json::BinaryView rest = doWrite(json::BinaryView(outputBuff, r), false);
+				if (!rest.empty() || lastSendError || timeout) break;
+				off += r;
+				done += r;
+			} else if (r == 0) {
+				break;
+			} else {
+				int err = errno;
+				if (err != EINTR) {
+					throw SystemException("Failed to read the file", err);
+				}
+			}
+		}
+	}
+	return done;
+}
+
+std::size_t NetworkConnection::sendWithBuffer(const json::BinaryView &data, bool nonblock) {
+	std::size_t bufLen = availBuff.buff?wrpos:0;
+	std::size_t bufSent = 0;
+	std::size_t done = 0;
+	while ((bufSent < bufLen || done < data.length) && !lastSendError && !timeout) {
+		struct iovec iov[2];
+		int cnt = 0;
+		if (bufSent < bufLen) {
+			iov[cnt].iov_base = availBuff.buff + bufSent;
+			iov[cnt].iov_len = bufLen - bufSent;
+			cnt++;
+		}
+		if (done < data.length) {
+			iov[cnt].iov_base = const_cast<unsigned char *>(data.data + done);
+			iov[cnt].iov_len = data.length - done;
+			cnt++;
+		}
+		struct msghdr msg = {};
+		msg.msg_iov = iov;
+		msg.msg_iovlen = cnt;
+		ssize_t r = ::sendmsg(socket, &msg, 0);
+		if (r > 0) {
+			IOStats::getInstance().recordSend(r);
+			std::size_t b = std::min<std::size_t>(r, bufLen - bufSent);
+			bufSent += b;
+			done += r - b;
+		} else {
+			int err = r < 0?errno:EAGAIN;
+			if (err == EINTR) continue;
+			if (err != EWOULDBLOCK && err != EAGAIN) {
+				lastSendError = err;
+			} else if (nonblock) {
+				break;
+			} else if (doWaitWrite(timeoutTime) == false) {
+				timeout = true;
+			}
+		}
+	}
+	if (bufSent < bufLen) {
+		std::memmove(availBuff.buff, availBuff.buff + bufSent, bufLen - bufSent);
+		wrpos = bufLen - bufSent;
+	} else {
+		wrpos = 0;
+	}
+	return done;
+}
+
+namespace {
+
+class SplicePipe {
+public:
+	SplicePipe() {
+		if (pipe2(fds, O_CLOEXEC) == -1) fds[0] = fds[1] = -1;
+	}
+	~SplicePipe() {
+		if (fds[0] != -1) ::close(fds[0]);
+		if (fds[1] != -1) ::close(fds[1]);
+	}
+	bool valid() const {return fds[0] != -1;}
+	int rd() const {return fds[0];}
+	int wr() const {return fds[1];}
+protected:
+	int fds[2];
+};
+
+}
+
+std::size_t NetworkConnection::recvToFile(int fd, std::size_t length) {
+	std::size_t done = 0;
+
+	//data which has been already read to the buffer
+	if (!lastBuff.empty()) {
+		json::BinaryView b = lastBuff.substr(0, length);
+		putBack(lastBuff.substr(b.length));
+		writeToFd(fd, b, timeoutTime);
+		done += b.length;
+	}
+
+	SplicePipe pipe;
+	bool useSplice = pipe.valid();
+
+	while (done < length && !eofFound) {
+		std::size_t remain = length - done;
+		if (useSplice) {
+			ssize_t r = splice(socket, nullptr, pipe.wr(), nullptr, remain, SPLICE_F_MOVE|SPLICE_F_NONBLOCK);
+			if (r == 0) {
+				eofFound = true;
+			} else if (r < 0) {
+				int err = errno;
+				if (err == EWOULDBLOCK || err == EAGAIN || err == EINTR) {
+					if (doWaitRead(timeoutTime) == false) {
+						timeout = true;
+						eofFound = true;
+					}
+				} else if (err == EINVAL) {
+					useSplice = false;
+				} else {
+					lastRecvError = err;
+					eofFound = true;
+				}
+			} else {
+				IOStats::getInstance().recordRecv(r);
+				std::size_t inpipe = r;
+				while (inpipe) {
+					ssize_t w = useSplice?splice(pipe.rd(), nullptr, fd, nullptr, inpipe, SPLICE_F_MOVE):-1;
+					if (w > 0) {
+						inpipe -= w;
+					} else {
+						int err = useSplice?errno:EINVAL;
+						if (err == EINTR) continue;
+						if (err != EINVAL) throw SystemException("Failed to write to the target descriptor", err);
+						//target doesn't support splice, copy rest of the pipe
+						useSplice = false;
+						ssize_t rd = ::read(pipe.rd(), inputBuff, std::min(inpipe, IOBufferPool::bufferSize));
+						if (rd <= 0) throw SystemException("Failed to read the pipe", errno);
+						writeToFd(fd, json::BinaryView(inputBuff, rd), timeoutTime);
+						inpipe -= rd;
+					}
+				}
+				done += r;
+			}
+		} else {
+			json::BinaryView b = doRead(false);
+			if (b.empty()) break;
+			json::BinaryView c = b.substr(0, remain);
+			putBack(b.substr(c.length));
+			writeToFd(fd, c, timeoutTime);
+			done += c.length;
+		}
+	}
+	return done;
+}
+
+void NetworkConnection::writeToFd(int fd, const json::BinaryView &data, int timeout_ms) {
+	json::BinaryView b = data;
+	while (!b.empty()) {
+		ssize_t w = ::write(fd, b.data, b.length);
+		if (w < 0) {
+			int err = errno;
+			if (err == EINTR) continue;
+			if (err == EAGAIN || err == EWOULDBLOCK) {
+				struct pollfd pfd;
+				pfd.fd = fd;
+				pfd.events = POLLOUT;
+				pfd.revents = 0;
+				if (poll(&pfd, 1, timeout_ms) == 0)
+					throw SystemException("Timeout while writing to the target descriptor", ETIMEDOUT);
+				continue;
+			}
+			throw SystemException("Failed to write to the target descriptor", err);
+		}
+		b = b.substr(w);
+	}
+}
+
 NetworkConnection::Buffer NetworkConnection::createBuffer() {
 	return Buffer(outputBuff,sizeof(outputBuff));
 }
 
+NetworkListener::NetworkListener(const StrViewA &addr_ddot_port) {
+
+	struct addrinfo req;
+	std::memset(&req,0,sizeof(req));
+	req.ai_family = AF_INET;
+	req.ai_socktype = SOCK_STREAM;
+	req.ai_flags = AI_PASSIVE;
+
+	struct addrinfo *res;
+
+	std::size_t pos = addr_ddot_port.lastIndexOf(":");
+	json::String host = pos == ((std::size_t)-1)?json::String(addr_ddot_port):json::String(addr_ddot_port.substr(0,pos));
+	json::String service = pos == ((std::size_t)-1)?json::String("0"):json::String(addr_ddot_port.substr(pos+1));
+
+	int e = getaddrinfo(host.c_str(),service.c_str(),&req,&res);
+	if (e != 0) throw SystemException("Unable to resolve address to listen", EINVAL);
+
+	socket = ::socket(res->ai_family,res->ai_socktype|SOCK_CLOEXEC,res->ai_protocol);
+	if (socket == -1) {
+		int err = errno;
+		freeaddrinfo(res);
+		throw SystemException("Unable to create listening socket", err);
+	}
+	int flag = 1;
+	setsockopt(socket, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+	if (::bind(socket, res->ai_addr, res->ai_addrlen) == -1 || ::listen(socket, SOMAXCONN) == -1) {
+		int err = errno;
+		freeaddrinfo(res);
+		::close(socket);
+		throw SystemException("Unable to listen", err);
+	}
+	freeaddrinfo(res);
+
+	struct sockaddr_in addr;
+	socklen_t addrlen = sizeof(addr);
+	getsockname(socket, reinterpret_cast<struct sockaddr *>(&addr), &addrlen);
+	port = ntohs(addr.sin_port);
+}
+
+NetworkListener::~NetworkListener() {
+	::close(socket);
+}
+
+NetworkConnection *NetworkListener::accept() {
+	do {
+		int s = ::accept4(socket, nullptr, nullptr, SOCK_CLOEXEC);
+		if (s != -1) return new NetworkConnection(s);
+		int err = errno;
+		if (err == EINVAL || err == EBADF) return nullptr;
+		if (err != EINTR && err != ECONNABORTED && err != EPROTO) {
+			throw SystemException("Failed to accept connection", err);
+		}
+	} while (true);
+}
+
+void NetworkListener::close() {
+	shutdown(socket, SHUT_RDWR);
+}
+
 
 
 }
@@ -13,6 +13,7 @@
 #include <stdint.h>
 
 #include "abstractio.h"
+#include "bufferpool.h"
 #include "cancelFunction.h"
 
 
@@ -56,11 +57,69 @@ public:
 	virtual void closeInput();
 	void close();
 
+	///Sends content of a file directly to the connection
+	/**
+	 * Data are transfered by sendfile(), so they are not copied through the user space. If
+	 * the descriptor cannot be used with sendfile(), the function falls back to pread()
+	 *
+	 * @param fd source file descriptor (regular file)
+	 * @param offset offset in the file
+	 * @param length count of bytes to send
+	 * @return count of bytes actually sent. If it is less than length, an error or the end of
+	 * the file has been reached. Check getLastSendError() or isTimeout()
+	 *
+	 * @note function flushes the output buffer before the data are sent
+	 */
+	std::size_t sendFile(int fd, std::uint64_t offset, std::size_t length);
+
+	///Sends content of the output buffer followed by the data
+	/**
+	 * Buffered data (for example headers) and the data are sent together by single
+	 * sendmsg() call, so the data are not copied to the output buffer. Partial writes are
+	 * continued until all is sent.
+	 *
+	 * @param data data to send after the buffered data
+	 * @param nonblock set true to return when the socket is full. Unsent part of the buffer
+	 * is kept in the buffer. Otherwise, the function waits for the socket with the timeout
+	 * @return count of bytes of the data which were sent. If it is less than data.length,
+	 * the socket is full (nonblock), or an error happened. Check getLastSendError() or isTimeout()
+	 */
+	std::size_t sendWithBuffer(const json::BinaryView &data, bool nonblock = false);
+
+	///Receives data from the connection directly to a descriptor
+	/**
+	 * Data are transfered by splice() through a pipe, so they are not copied through the user space.
+	 * If the target cannot be used with splice(), the function falls back to recv() and write()
+	 *
+	 * @param fd target descriptor (file or pipe)
+	 * @param length count of bytes to transfer
+	 * @return count of bytes actually transfered. If it is less than length, the connection has
+	 * been closed or an error happened.
+	 *
+	 * @exception SystemException failed to write to the target descriptor
+	 */
+	std::size_t recvToFile(int fd, std::size_t length);
+
+	///Writes whole buffer to the descriptor
+	/**
+	 * @param fd target descriptor
+	 * @param data data to write
+	 * @param timeout_ms how long to wait when the descriptor is not ready (non-blocking
+	 * pipe or socket). Default value waits infinitely
+	 * @exception SystemException failed to write or timeout (ETIMEDOUT)
+	 */
+	static void writeToFd(int fd, const json::BinaryView &data, int timeout_ms = -1);
+
+	///Returns current I/O timeout in milliseconds
+	uintptr_t getTimeout() const {return timeoutTime;}
+
 
 
 
 protected:
 
+	friend class NetworkListener;
+
 	NetworkConnection(int socket);
 
 	virtual json::BinaryView doWrite(const json::BinaryView &data, bool nonblock = false);
@@ -77,7 +136,8 @@ protected:
 	
 	void *waitHandle; //<used by some platforms (Windows)
 
-	unsigned char inputBuff[4096];
+	///input buffer, acquired from the IOBufferPool
+	unsigned char *inputBuff;
 	unsigned char outputBuff[4096];
 	bool eofFound;
 	int lastSendError;
@@ -94,6 +154,39 @@ protected:
 typedef json::RefCntPtr<NetworkConnection> PNetworkConection;
 
 
+///Listening socket which accepts incoming connections
+/**
+ * The listener is intended for local servers used by tests and benchmarks, for example
+ * the MockCouchDB. It is available on POSIX platforms only.
+ */
+class NetworkListener {
+public:
+	///Opens the listening socket
+	/**
+	 * @param addr_ddot_port address and port to bind. Use port 0 to bind a random free port
+	 * @exception SystemException unable to bind or listen
+	 */
+	NetworkListener(const StrViewA &addr_ddot_port);
+	~NetworkListener();
+
+	///Returns port number where the listener is bound
+	int getPort() const {return port;}
+
+	///Waits for incoming connection
+	/**
+	 * @return new connection, or nullptr, if the listener has been closed
+	 */
+	NetworkConnection *accept();
+
+	///Closes the listener. Thread blocked in the accept() is woken up
+	void close();
+
+protected:
+	int socket;
+	int port;
+};
+
+
 
 
 }
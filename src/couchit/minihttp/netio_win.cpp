@@ -10,14 +10,17 @@
 #include <WinSock2.h>
 #include <Ws2tcpip.h>
 #include <atomic>
+#include <io.h>
 
 #undef min
 #undef max
 
 #pragma comment (lib,"ws2_32.lib")
 
+#include <cerrno>
 #include <cstring>
 #include "netio.h"
+#include "../exception.h"
 
 #include <imtjson/string.h>
 
@@ -146,6 +149,7 @@ NetworkConnection* couchit::NetworkConnection::connect(const StrViewA &addr_ddot
 
 couchit::NetworkConnection::NetworkConnection(int socket)
 	:socket(socket)
+	,inputBuff(IOBufferPool::getInstance().acquire())
 	,buffUsed(0)
 	,rdPos(0)
 	,eofFound(false)
@@ -165,6 +169,8 @@ NetworkConnection::~NetworkConnection() {
 	while (a.readPending || a.writePending) {
 		SleepEx(0, TRUE);
 	}
+	//pending read could write to the buffer, so it is released after it is finished
+	IOBufferPool::getInstance().release(inputBuff);
 
 }
 
@@ -206,7 +212,7 @@ const unsigned char* NetworkConnection::read(std::size_t processed, std::size_t*
 			Async &async = Async::get(waitHandle);
 
 			if (async.rcount == (DWORD)-1 && !async.readPending) {
-				async.readToBuffer(socket, this->inputBuff, sizeof(this->inputBuff));
+				async.readToBuffer(socket, this->inputBuff, IOBufferPool::bufferSize);
 			}
 			
 			if (!async.waitForPending(async.readPending, timeoutTime, cancelFunction)) {
@@ -235,7 +241,7 @@ const unsigned char* NetworkConnection::read(std::size_t processed, std::size_t*
 			Async &async = Async::get(waitHandle);
 
 			if (async.rcount == (DWORD)-1 && !async.readPending) {
-				async.readToBuffer(socket, this->inputBuff, sizeof(this->inputBuff));
+				async.readToBuffer(socket, this->inputBuff, IOBufferPool::bufferSize);
 			}
 
 			if (async.readPending) return 0;
@@ -330,7 +336,7 @@ json::BinaryView NetworkConnection::read(std::size_t processed)
 				return BinaryView(inputBuff, buffUsed);
 			}
 			//no data ready, reade some
-			async.readToBuffer(socket, this->inputBuff, sizeof(this->inputBuff));
+			async.readToBuffer(socket, this->inputBuff, IOBufferPool::bufferSize);
 		}
 		//in all cases, return empty buffer
 		return BinaryView(nullptr,0);
@@ -345,7 +351,7 @@ json::BinaryView NetworkConnection::read(std::size_t processed)
 				async.rcount = 0;
 				return BinaryView(inputBuff, buffUsed);
 			}
-			async.readToBuffer(socket, this->inputBuff, sizeof(this->inputBuff));
+			async.readToBuffer(socket, this->inputBuff, IOBufferPool::bufferSize);
 		}
 		timeout = true;
 		return BinaryView(nullptr,0);
@@ -464,5 +470,55 @@ void Async::writeBuffer(SOCKET s, const unsigned char * buffer, unsigned int len
 }
 
 
+
+std::size_t NetworkConnection::sendFile(int fd, std::uint64_t offset, std::size_t length) {
+	//there is no sendfile(), data are copied through the output buffer
+	flush();
+	if (_lseeki64(fd, offset, SEEK_SET) < 0) {
+		throw SystemException("Failed to seek the file", errno);
+	}
+	std::size_t done = 0;
+	while (done < length && !lastSendError && !timeout) {
+		unsigned int toread = static_cast<unsigned int>(std::min(length - done, sizeof(outputBuff)));
+		int r = _read(fd, outputBuff, toread);
+		if (r > 0) {
+			json::BinaryView rest = doWrite(json::BinaryView(outputBuff, r), false);
+			if (!rest.empty() || lastSendError || timeout) break;
+			done += r;
+		} else if (r == 0) {
+			break;
+		} else {
+			throw SystemException("Failed to read the file", errno);
+		}
+	}
+	return done;
+}
+
+std::size_t NetworkConnection::recvToFile(int fd, std::size_t length) {
+	//there is no splice(), data are copied through the input buffer
+	std::size_t done = 0;
+	while (done < length) {
+		json::BinaryView b = doRead(false);
+		if (b.empty()) break;
+		json::BinaryView c = b.substr(0, length - done);
+		putBack(b.substr(c.length));
+		writeToFd(fd, c, static_cast<int>(timeoutTime));
+		done += c.length;
+	}
+	return done;
+}
+
+void NetworkConnection::writeToFd(int fd, const json::BinaryView &data, int ) {
+	//CRT descriptors are always blocking, the timeout is not used
+	json::BinaryView b = data;
+	while (!b.empty()) {
+		int w = _write(fd, b.data, static_cast<unsigned int>(b.length));
+		if (w < 0) {
+			throw SystemException("Failed to write to the target descriptor", errno);
+		}
+		b = b.substr(w);
+	}
+}
+
 }
 
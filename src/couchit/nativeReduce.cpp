@@ -0,0 +1,217 @@
+/*
+ * nativeReduce.cpp
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#include "nativeReduce.h"
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+namespace couchit {
+
+namespace {
+
+struct Stats {
+	double sum = 0;
+	double count = 0;
+	double min = 0;
+	double max = 0;
+	double sumsqr = 0;
+
+	void merge(const Stats &other) {
+		if (other.count == 0) return;
+		if (count == 0) {
+			min = other.min;
+			max = other.max;
+		} else {
+			min = std::min(min, other.min);
+			max = std::max(max, other.max);
+		}
+		sum += other.sum;
+		count += other.count;
+		sumsqr += other.sumsqr;
+	}
+};
+
+}
+
+///Buffer for extracted numbers, reused between calls
+static std::vector<double> &numBuffer() {
+	static thread_local std::vector<double> buffer;
+	return buffer;
+}
+
+///Extracts values as numbers into the buffer
+/**
+ * @retval true all values are numbers
+ * @retval false found non-numeric value, the buffer is not complete
+ */
+template<typename T>
+static bool extractNumbers(const T &rows, std::vector<double> &out) {
+	out.clear();
+	out.reserve(rows.length);
+	for (std::size_t i = 0; i < rows.length; i++) {
+		const Value &v = rows[i].value;
+		if (v.type() != json::number) return false;
+		out.push_back(v.getNumber());
+	}
+	return true;
+}
+
+//loops below uses independent accumulators, so the compiler is able to vectorize them
+
+static double sumNumbers(const double *d, std::size_t cnt) {
+	double a0 = 0, a1 = 0, a2 = 0, a3 = 0;
+	std::size_t i = 0;
+	for (; i + 4 <= cnt; i += 4) {
+		a0 += d[i];
+		a1 += d[i+1];
+		a2 += d[i+2];
+		a3 += d[i+3];
+	}
+	for (; i < cnt; i++) a0 += d[i];
+	return (a0 + a1) + (a2 + a3);
+}
+
+static Stats statNumbers(const double *d, std::size_t cnt) {
+	Stats st;
+	if (cnt == 0) return st;
+	double s0 = 0, s1 = 0, q0 = 0, q1 = 0;
+	double mn0 = d[0], mn1 = d[0], mx0 = d[0], mx1 = d[0];
+	std::size_t i = 0;
+	for (; i + 2 <= cnt; i += 2) {
+		double x0 = d[i], x1 = d[i+1];
+		s0 += x0; s1 += x1;
+		q0 += x0 * x0; q1 += x1 * x1;
+		mn0 = std::min(mn0, x0); mn1 = std::min(mn1, x1);
+		mx0 = std::max(mx0, x0); mx1 = std::max(mx1, x1);
+	}
+	for (; i < cnt; i++) {
+		double x = d[i];
+		s0 += x;
+		q0 += x * x;
+		mn0 = std::min(mn0, x);
+		mx0 = std::max(mx0, x);
+	}
+	st.sum = s0 + s1;
+	st.sumsqr = q0 + q1;
+	st.min = std::min(mn0, mn1);
+	st.max = std::max(mx0, mx1);
+	st.count = static_cast<double>(cnt);
+	return st;
+}
+
+///Converts number to Value, integral results are stored as integers
+static Value numberValue(double v) {
+	if (v == std::floor(v) && std::abs(v) < 9007199254740992.0) {
+		return Value(static_cast<long long>(v));
+	} else {
+		return Value(v);
+	}
+}
+
+static Value statsValue(const Stats &st) {
+	return Object("sum", numberValue(st.sum))
+			("count", numberValue(st.count))
+			("min", numberValue(st.min))
+			("max", numberValue(st.max))
+			("sumsqr", numberValue(st.sumsqr));
+}
+
+static double requireNumber(const Value &v, StrViewA fn) {
+	if (v.type() != json::number)
+		throw QueryServerError("builtin_reduce_error",
+				String({"The builtin ",fn," function requires map values to be numbers"}));
+	return v.getNumber();
+}
+
+template<typename T>
+static Value sumRows(const T &rows) {
+	std::vector<double> &buff = numBuffer();
+	if (extractNumbers(rows, buff)) {
+		return numberValue(sumNumbers(buff.data(), buff.size()));
+	}
+	//slow path - arrays are summed per element, number is treated as one item array
+	buff.clear();
+	bool isArray = false;
+	for (std::size_t i = 0; i < rows.length; i++) {
+		const Value &v = rows[i].value;
+		if (v.type() == json::array) {
+			isArray = true;
+			if (buff.size() < v.size()) buff.resize(v.size(), 0.0);
+			for (std::size_t j = 0, cnt = v.size(); j < cnt; j++) {
+				buff[j] += requireNumber(v[j], "_sum");
+			}
+		} else {
+			if (buff.empty()) buff.push_back(0.0);
+			buff[0] += requireNumber(v, "_sum");
+		}
+	}
+	if (!isArray) return numberValue(buff.empty()?0.0:buff[0]);
+	Array res;
+	res.reserve(buff.size());
+	for (double d : buff) res.push_back(numberValue(d));
+	return res;
+}
+
+template<typename T>
+static Value statRows(const T &rows) {
+	std::vector<double> &buff = numBuffer();
+	if (extractNumbers(rows, buff)) {
+		return statsValue(statNumbers(buff.data(), buff.size()));
+	}
+	//slow path - mix of numbers and already reduced statistics
+	Stats st;
+	for (std::size_t i = 0; i < rows.length; i++) {
+		const Value &v = rows[i].value;
+		Stats item;
+		if (v.type() == json::object) {
+			item.sum = requireNumber(v["sum"], "_stats");
+			item.count = requireNumber(v["count"], "_stats");
+			item.min = requireNumber(v["min"], "_stats");
+			item.max = requireNumber(v["max"], "_stats");
+			item.sumsqr = requireNumber(v["sumsqr"], "_stats");
+		} else {
+			double x = requireNumber(v, "_stats");
+			item.sum = item.min = item.max = x;
+			item.sumsqr = x * x;
+			item.count = 1;
+		}
+		st.merge(item);
+	}
+	return statsValue(st);
+}
+
+template<typename T>
+static Value reduceRows(NativeReduce::Mode mode, const T &rows) {
+	switch (mode) {
+	case AbstractViewBase::rmCount: return Value(rows.length);
+	case AbstractViewBase::rmSum: return sumRows(rows);
+	case AbstractViewBase::rmStats: return statRows(rows);
+	default: return Value();
+	}
+}
+
+Value NativeReduce::reduce(Mode mode, const RowsWithKeys& rows) {
+	return reduceRows(mode, rows);
+}
+
+Value NativeReduce::reduce(Mode mode, const ReducedRows& values) {
+	return reduceRows(mode, values);
+}
+
+Value NativeReduce::rereduce(Mode mode, const ReducedRows& values) {
+	switch (mode) {
+	//rereduce of _count is sum of partial counts
+	case AbstractViewBase::rmCount:
+	case AbstractViewBase::rmSum: return sumRows(values);
+	case AbstractViewBase::rmStats: return statRows(values);
+	default: return Value();
+	}
+}
+
+}
@@ -0,0 +1,67 @@
+/*
+ * nativeReduce.h
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_COUCHIT_NATIVEREDUCE_H_
+#define SRC_COUCHIT_NATIVEREDUCE_H_
+
+#include "queryServerIfc.h"
+
+namespace couchit {
+
+
+///Native implementation of the build-in reduce functions _count, _sum and _stats
+/**
+ * Functions extract values from the rows into a contiguous array of numbers and perform
+ * the calculation over that array. Result is compatible with the result of the same build-in
+ * function executed by the CouchDB.
+ *
+ * The _sum function accepts numbers and arrays of numbers (summed per element). The _stats function
+ * accepts numbers and already reduced statistics (objects sum,count,min,max,sumsqr). Other
+ * values cause QueryServerError
+ */
+class NativeReduce {
+public:
+
+	typedef AbstractViewBase::ReduceMode Mode;
+
+	///Returns true, if the mode can be calculated natively
+	static bool isNative(Mode mode) {
+		return mode == AbstractViewBase::rmCount
+				|| mode == AbstractViewBase::rmSum
+				|| mode == AbstractViewBase::rmStats;
+	}
+
+	///Reduces rows of the view
+	/**
+	 * @param mode reduce mode (rmCount, rmSum, rmStats)
+	 * @param rows rows to reduce
+	 * @return reduced value. Function returns undefined value, if the mode is not native
+	 */
+	static Value reduce(Mode mode, const RowsWithKeys &rows);
+	///Reduces values emitted by the map function
+	/**
+	 * @param mode reduce mode (rmCount, rmSum, rmStats)
+	 * @param values values to reduce (keys and documents are not needed for build-in functions)
+	 * @return reduced value. Function returns undefined value, if the mode is not native
+	 */
+	static Value reduce(Mode mode, const ReducedRows &values);
+	///Rereduces already reduced values
+	/**
+	 * @param mode reduce mode (rmCount, rmSum, rmStats)
+	 * @param values results of previous reduce
+	 * @return reduced value. Function returns undefined value, if the mode is not native
+	 */
+	static Value rereduce(Mode mode, const ReducedRows &values);
+
+};
+
+
+}
+
+
+
+#endif /* SRC_COUCHIT_NATIVEREDUCE_H_ */
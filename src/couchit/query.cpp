@@ -3,6 +3,7 @@
 #include "couchDB.h"
 
 #include <imtjson/abstractValue.h>
+#include <stdexcept>
 namespace couchit {
 
 template class JoinedQuery<json::Value (*)(json::Value),json::Value (*)(json::Value),json::Value (*)(json::Value,json::Value) >;
@@ -137,6 +138,9 @@ Value Query::exec(const QueryRequest &request) const {
 
 
 Result::Result(const Value& result):pos(0),cnt(result.size()) {
+	if (result.type() == json::string) {
+		throw std::runtime_error("Result: the response is unparsed (Query::lazy() or View::lazyRows), use LazyResult to read it");
+	}
 	if (result.type() == json::object) {
 		total = result["total_rows"].getUInt();
 		offset = result["offset"].getUInt();
@@ -194,6 +198,11 @@ Query& couchit::Query::includeDocs() {
 	return *this;
 }
 
+Query& couchit::Query::lazy() {
+	request.view.flags |= View::lazyRows;
+	return *this;
+}
+
 Query& couchit::Query::conflicts() {
 	request.view.flags |= View::includeDocs|View::conflicts;
 	return *this;
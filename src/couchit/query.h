@@ -121,6 +121,12 @@ public:
 	///Includes conflict informations to the result (enables includeDocs)
 	Query &conflicts();
 
+	///Returns the response unparsed, use LazyResult to read the result
+	/** Similar to View::lazyRows. The function exec() returns JSON text of the response
+	 * as a string, which cannot be converted to the Result (it throws an exception).
+	 */
+	Query &lazy();
+
 	///Set POST data for the list as additional arguments
 	Query &setPostData(Value postData);
 
@@ -265,9 +271,37 @@ template<typename BindFn, typename AgrFn, typename MergeFn>
 class JoinedQuery: public Query {
 public:
 	JoinedQuery(const Query &left, const Query &right, const BindFn &bindFn, const AgrFn &agrFn, const MergeFn &mergeFn)
-		:Query(left.request.view,qobj),lq(left),rq(right),qobj(*this,bindFn,agrFn,mergeFn) {}
+		:Query(left.request.view,qobj),lq(left),rq(right),qobj(*this,bindFn,agrFn,mergeFn)
+		,keysPerChunk(defaultKeysPerChunk),maxParallel(defaultMaxParallel) {}
 	JoinedQuery(const JoinedQuery &other)
-		:Query(other.lq.request.view,qobj),lq(other.lq),rq(other.rq),qobj(other.qobj) {}
+		:Query(other.lq.request.view,qobj),lq(other.lq),rq(other.rq),qobj(*this,other.qobj.bindFn,other.qobj.agrFn,other.qobj.mergeFn)
+		,keysPerChunk(other.keysPerChunk),maxParallel(other.maxParallel) {}
+
+	static const std::size_t defaultKeysPerChunk = 1000;
+	static const unsigned int defaultMaxParallel = 1;
+
+	///Configures lookup of the foreign keys
+	/**
+	 * Foreign keys collected from the left side are deduplicated and split into chunks. Each
+	 * chunk is requested by a separate keys-query. By default, the chunks are executed
+	 * one by one in the current thread. When maxParallel is above 1, up to maxParallel
+	 * requests run concurrently (each request uses own connection from the pool). Results are
+	 * always merged in the order of the left side.
+	 *
+	 * @param keysPerChunk count of keys per single request
+	 * @param maxParallel maximum count of concurrent requests. Set 1 (default) to execute the chunks
+	 * one by one in the current thread
+	 * @return reference to this query
+	 *
+	 * @note When maxParallel is above 1, the right side query is executed from multiple threads
+	 * at once, so it must be thread safe (which is true for the CouchDB, LocalView and MemView).
+	 * The callbacks (BindFn, AgrFn, MergeFn) are always called from the current thread.
+	 */
+	JoinedQuery &chunks(std::size_t keysPerChunk, unsigned int maxParallel) {
+		this->keysPerChunk = keysPerChunk?keysPerChunk:1;
+		this->maxParallel = maxParallel?maxParallel:1;
+		return *this;
+	}
 
 protected:
 
@@ -299,12 +333,15 @@ protected:
 
 		void addFk(const Value &v, std::size_t index);
 		void addFk(const KeyType &v, std::size_t index);
+		void storeGroup(const Value &key, Array &group);
 
 	};
 
 	Query lq;
 	Query rq;
 	QObj qobj;
+	std::size_t keysPerChunk;
+	unsigned int maxParallel;
 };
 
 
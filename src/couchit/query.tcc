@@ -8,6 +8,11 @@
 #ifndef LIGHTCOUCH_QUERY_TCC_
 #define LIGHTCOUCH_QUERY_TCC_
 
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <future>
+
 #include "document.h"
 #include "query.h"
 #include "changeset.h"
@@ -217,6 +222,15 @@ void JoinedQuery<BindFn,AgrFn,MergeFn>::QObj::addFk(const KeyType &v, std::size_
 }
 
 
+template<typename BindFn, typename AgrFn, typename MergeFn>
+void JoinedQuery<BindFn,AgrFn,MergeFn>::QObj::storeGroup(const Value &key, Array &group) {
+	Value v = agrFn(group);
+	auto rang = keyAtIndexMap.equal_range(key);
+	for (auto iter = rang.first; iter != rang.second;++iter) {
+		resultMap[iter->second.first][iter->second.second] = v;
+	}
+}
+
 template<typename BindFn, typename AgrFn, typename MergeFn>
 Value JoinedQuery<BindFn,AgrFn,MergeFn>::QObj::executeQuery(const QueryRequest &) {
 	Result res = owner.lq.exec();
@@ -246,35 +260,67 @@ Value JoinedQuery<BindFn,AgrFn,MergeFn>::QObj::executeQuery(const QueryRequest &
 
 	if (!keys.empty()) {
 
+		std::size_t keyCount = keys.size();
+		std::size_t chunkSize = owner.keysPerChunk;
+		std::size_t chunkCount = (keyCount + chunkSize - 1) / chunkSize;
+		std::vector<Value> chunkResults(chunkCount);
+		std::atomic<std::size_t> nextChunk(0);
+		Value allKeys(keys);
+
+		auto worker = [&] {
+			std::size_t i;
+			while ((i = nextChunk.fetch_add(1)) < chunkCount) {
+				Query q(owner.rq);
+				if (chunkCount == 1) {
+					q.keys(allKeys);
+				} else {
+					std::size_t b = i * chunkSize;
+					std::size_t e = std::min(b + chunkSize, keyCount);
+					Array chunk;
+					chunk.reserve(e - b);
+					for (std::size_t j = b; j < e; j++) chunk.push_back(allKeys[j]);
+					q.keys(chunk);
+				}
+				chunkResults[i] = q.exec();
+			}
+		};
 
-		owner.rq.keys(keys);
-		Result rside = owner.rq.exec();
+		//current thread is also one of the workers
+		std::size_t workers = std::min<std::size_t>(owner.maxParallel, chunkCount);
+		std::vector<std::future<void> > helpers;
+		for (std::size_t i = 1; i < workers; i++) {
+			helpers.push_back(std::async(std::launch::async, worker));
+		}
+		std::exception_ptr err;
+		try {
+			worker();
+		} catch (...) {
+			err = std::current_exception();
+		}
+		for (auto &&f : helpers) {
+			try {
+				f.get();
+			} catch (...) {
+				if (err == nullptr) err = std::current_exception();
+			}
+		}
+		if (err != nullptr) std::rethrow_exception(err);
 
-		if (!rside.empty()) {
-			Array group;
+		//keys are unique, so each key appears in one chunk only
+		Array group;
+		for (const Value &chunkRes : chunkResults) {
+			Result rside(chunkRes);
 			Value curKey;
-
+			group.clear();
 			for (Row r : rside) {
 				if (r.key != curKey) {
-					if (!group.empty()) {
-						Value v = agrFn(group);
-						auto rang = keyAtIndexMap.equal_range(curKey);
-						for (auto iter = rang.first; iter != rang.second;++iter) {
-							resultMap[iter->second.first][iter->second.second] = v;
-						}
-					}
+					if (!group.empty()) storeGroup(curKey, group);
 					curKey = r.key;
 					group.clear();
 				}
 				group.push_back(r);
 			}
-			{
-				Value v = agrFn(group);
-				auto rang = keyAtIndexMap.equal_range(curKey);
-				for (auto iter = rang.first; iter != rang.second;++iter) {
-					resultMap[iter->second.first][iter->second.second] = v;
-				}
-			}
+			if (!group.empty()) storeGroup(curKey, group);
 		}
 	}
 
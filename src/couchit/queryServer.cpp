@@ -9,23 +9,253 @@
 
 #include <sys/types.h>
 #include <sys/stat.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <exception>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
 
 #include <imtjson/abstractValue.h>
 
 
 #include "changeset.h"
+#include "exception.h"
 #include "namedEnum.h"
+#include "nativeReduce.h"
 #include "num2str.h"
 
 namespace couchit {
 
 QueryServer::QueryServer(const StrViewA &name):qserverName(name) {}
 
+///Small pool of threads which executes map functions of single map_doc request
+/** The calling thread participates on the work, so the pool holds threads-1 workers. Tasks
+ * are picked through an atomic index, function run() returns after all tasks are finished */
+class QueryServer::MapWorkers {
+public:
+	typedef std::function<void(std::size_t)> Task;
+
+	MapWorkers(unsigned int threads);
+	~MapWorkers();
+
+	///Executes task for indexes 0..count-1, rethrows first exception
+	void run(std::size_t count, const Task &task);
+
+protected:
+	std::mutex lock;
+	std::condition_variable wakeup;
+	std::condition_variable done;
+	std::vector<std::thread> workers;
+	const Task *curTask = nullptr;
+	std::size_t curCount = 0;
+	std::atomic<std::size_t> nextIndex;
+	std::size_t activeWorkers = 0;
+	unsigned int generation = 0;
+	bool exitFlag = false;
+	std::exception_ptr error;
+
+	void worker();
+	void runTasks();
+};
+
+QueryServer::MapWorkers::MapWorkers(unsigned int threads):nextIndex(0) {
+	for (unsigned int i = 1; i < threads; i++) {
+		workers.push_back(std::thread([this]{worker();}));
+	}
+}
+
+QueryServer::MapWorkers::~MapWorkers() {
+	{
+		std::unique_lock<std::mutex> _(lock);
+		exitFlag = true;
+		wakeup.notify_all();
+	}
+	for (auto &&t: workers) t.join();
+}
+
+void QueryServer::MapWorkers::run(std::size_t count, const Task &task) {
+	std::unique_lock<std::mutex> _(lock);
+	curTask = &task;
+	curCount = count;
+	nextIndex = 0;
+	error = nullptr;
+	activeWorkers = workers.size();
+	generation++;
+	wakeup.notify_all();
+	_.unlock();
+	runTasks();
+	_.lock();
+	done.wait(_,[&]{return activeWorkers == 0;});
+	curTask = nullptr;
+	if (error != nullptr) {
+		std::exception_ptr e = error;
+		error = nullptr;
+		std::rethrow_exception(e);
+	}
+}
+
+void QueryServer::MapWorkers::runTasks() {
+	std::size_t i;
+	while ((i = nextIndex.fetch_add(1)) < curCount) {
+		try {
+			(*curTask)(i);
+		} catch (...) {
+			std::unique_lock<std::mutex> _(lock);
+			if (error == nullptr) error = std::current_exception();
+		}
+	}
+}
+
+void QueryServer::MapWorkers::worker() {
+	unsigned int seen = 0;
+	std::unique_lock<std::mutex> _(lock);
+	for(;;) {
+		wakeup.wait(_,[&]{return exitFlag || generation != seen;});
+		if (exitFlag) break;
+		seen = generation;
+		_.unlock();
+		runTasks();
+		_.lock();
+		if (--activeWorkers == 0) done.notify_all();
+	}
+}
+
+QueryServer::~QueryServer() {}
+
+void QueryServer::setMapThreads(unsigned int threads) {
+	if (threads > 1) mapWorkers = std::unique_ptr<MapWorkers>(new MapWorkers(threads));
+	else mapWorkers = nullptr;
+}
+
 
 
 int QueryServer::runDispatchStdIO() {
 
+#ifdef _WIN32
 	return runDispatch(std::cin, std::cout);
+#else
+	return runDispatch(0, 1);
+#endif
+}
+
+namespace {
+
+///Channel over iostreams
+class StreamChannel: public QueryServer::Channel {
+public:
+	StreamChannel(std::istream &input, std::ostream &output):input(input),output(output) {}
+
+	virtual Value read() override {
+		if (input.rdbuf()->in_avail() <= 0) output.flush();
+		input >> std::ws;
+		if (input.eof()) return Value();
+		return Value::fromStream(input);
+	}
+	virtual void write(const Value &response) override {
+		response.toStream(output);
+		output.put('\n');
+	}
+	virtual void flush() override {
+		output.flush();
+	}
+
+protected:
+	std::istream &input;
+	std::ostream &output;
+};
+
+#ifndef _WIN32
+
+///Channel over file descriptors, splits requests to lines directly in the input buffer
+class FdChannel: public QueryServer::Channel {
+public:
+	FdChannel(int fdin, int fdout):fdin(fdin),fdout(fdout) {}
+	~FdChannel() {
+		try {flush();} catch (...) {}
+	}
+
+	virtual Value read() override;
+	virtual void write(const Value &response) override;
+	virtual void flush() override;
+
+protected:
+	static const std::size_t blockSize = 65536;
+
+	int fdin;
+	int fdout;
+	std::vector<char> inBuff;
+	std::size_t inPos = 0;
+	std::vector<char> outBuff;
+	bool eof = false;
+};
+
+Value FdChannel::read() {
+	for(;;) {
+		const char *beg = inBuff.data() + inPos;
+		const char *end = inBuff.data() + inBuff.size();
+		const char *nl = static_cast<const char *>(std::memchr(beg, '\n', end - beg));
+		if (nl != nullptr) {
+			inPos = nl - inBuff.data() + 1;
+			if (nl != beg) return Value::fromString(StrViewA(beg, nl - beg));
+		} else if (eof) {
+			inPos = inBuff.size();
+			if (beg == end) return Value();
+			return Value::fromString(StrViewA(beg, end - beg));
+		} else {
+			//no complete request in the buffer - flush responses before we start to wait
+			flush();
+			inBuff.erase(inBuff.begin(), inBuff.begin() + inPos);
+			inPos = 0;
+			std::size_t sz = inBuff.size();
+			inBuff.resize(sz + blockSize);
+			ssize_t rd;
+			do {
+				rd = ::read(fdin, inBuff.data() + sz, blockSize);
+			} while (rd < 0 && errno == EINTR);
+			if (rd < 0) {
+				int e = errno;
+				inBuff.resize(sz);
+				throw SystemException("QueryServer: Failed to read request", e);
+			}
+			inBuff.resize(sz + rd);
+			eof = rd == 0;
+		}
+	}
+}
+
+void FdChannel::write(const Value &response) {
+	response.serialize([&](char c) {outBuff.push_back(c);});
+	outBuff.push_back('\n');
+	if (outBuff.size() >= blockSize) flush();
+}
+
+void FdChannel::flush() {
+	const char *p = outBuff.data();
+	std::size_t remain = outBuff.size();
+	while (remain) {
+		ssize_t wr = ::write(fdout, p, remain);
+		if (wr < 0) {
+			int e = errno;
+			if (e == EINTR) continue;
+			outBuff.clear();
+			throw SystemException("QueryServer: Failed to write response", e);
+		}
+		p += wr;
+		remain -= wr;
+	}
+	outBuff.clear();
+}
+
+#endif
+
 }
 
 enum Command {
@@ -69,10 +299,24 @@ static NamedEnumDef<DDocCommand> ddocCommandsDef[] = {
 static NamedEnum<DDocCommand> ddocCommands(ddocCommandsDef);
 
 
-int couchit::QueryServer::runDispatch(std::istream &in, std::ostream &out) {
+int QueryServer::runDispatch(std::istream &in, std::ostream &out) {
+	StreamChannel channel(in, out);
+	return runDispatch(channel);
+}
+
+int QueryServer::runDispatch(int fdin, int fdout) {
+#ifdef _WIN32
+	throw std::runtime_error("QueryServer::runDispatch(int,int) is not supported on this platform");
+#else
+	FdChannel channel(fdin, fdout);
+	return runDispatch(channel);
+#endif
+}
+
+int QueryServer::runDispatch(Channel &channel) {
 
-	while (!in.eof()) {
-		Value req = Value::fromStream(in);
+	Value req;
+	while ((req = channel.read()).defined()) {
 
 		try {
 
@@ -80,8 +324,10 @@ int couchit::QueryServer::runDispatch(std::istream &in, std::ostream &out) {
 			Value resp;
 			switch (cmd) {
 				case cmdReset:
-					if (rrule != nullptr && rrule())
+					if (rrule != nullptr && rrule()) {
+						channel.flush();
 						return 100;
+					}
 					resp=commandReset(req);
 					break;
 				case cmdAddLib: resp=commandAddLib(req);break;
@@ -89,24 +335,21 @@ int couchit::QueryServer::runDispatch(std::istream &in, std::ostream &out) {
 				case cmdMapDoc: resp=commandMapDoc(req);break;
 				case cmdReduce: resp=commandReduce(req);break;
 				case cmdReReduce: resp=commandReReduce(req);break;
-				case cmdDDoc: resp=commandDDoc(req,in,out);break;
+				case cmdDDoc: resp=commandDDoc(req,channel);break;
 			}
-			resp.toStream(out);
+			channel.write(resp);
 		} catch (QueryServerError &e) {
-			Value resp({"error",e.type,e.explain});
-			resp.toStream(out);
+			channel.write(Value({"error",e.type,e.explain}));
 		} catch (VersionMistmatch &) {
-			Value resp({"error","try_again","restarting query server, please try again"});
-			resp.toStream(out);
-			out << std::endl;
+			channel.write(Value({"error","try_again","restarting query server, please try again"}));
+			channel.flush();
 			throw;
 		} catch (std::exception &e) {
-			Value resp({"error","internal_error",e.what()});
-			resp.toStream(out);
+			channel.write(Value({"error","internal_error",e.what()}));
 		}
-		out << std::endl;
 
 	}
+	channel.flush();
 	return 0;
 }
 
@@ -172,8 +415,23 @@ Value QueryServer::commandMapDoc(const Value& req) {
 		}
 	};
 
-	Document doc = req[1];
 	Array result;
+	std::size_t cnt = preparedMaps.size();
+
+	if (mapWorkers != nullptr && cnt > 1) {
+		//each view has own output and own document, results are collected in order of the views
+		std::vector<Array> subresults(cnt);
+		mapWorkers->run(cnt, [&](std::size_t i) {
+			Document doc(req[1]);
+			Emit emit(subresults[i]);
+			preparedMaps[i]->map(doc,emit);
+		});
+		result.reserve(cnt);
+		for (auto &&x : subresults) result.push_back(x);
+		return result;
+	}
+
+	Document doc = req[1];
 	Array subres;
 
 	for (auto &&x : preparedMaps) {
@@ -209,10 +467,14 @@ Value QueryServer::commandReduce(const Value& req) {
 			throw QueryServerError("not_found",String({"Reduce Function '",name,"' not found"}));
 		}
 		AbstractViewBase &view = *fniter->second;
-		if (view.reduceMode() != AbstractViewBase::rmFunction) {
+		AbstractViewBase::ReduceMode mode = view.reduceMode();
+		if (NativeReduce::isNative(mode)) {
+			output.add(NativeReduce::reduce(mode, rowBuffer));
+		} else if (mode != AbstractViewBase::rmFunction) {
 			throw QueryServerError("invalid_view",String({"Specified view '",name,"' doesn't define reduce function"}));
+		} else {
+			output.add(view.reduce(rowBuffer));
 		}
-		output.add(view.reduce(rowBuffer));
 	}
 	rowBuffer.clear();
 	return {true,output};
@@ -235,10 +497,14 @@ Value QueryServer::commandReReduce(const Value& req) {
 			throw QueryServerError("not_found",String({"Reduce Function '",name,"' not found"}));
 		}
 		AbstractViewBase &view = *fniter->second;
-		if (view.reduceMode() != AbstractViewBase::rmFunction) {
+		AbstractViewBase::ReduceMode mode = view.reduceMode();
+		if (NativeReduce::isNative(mode)) {
+			output.add(NativeReduce::rereduce(mode, valueBuffer));
+		} else if (mode != AbstractViewBase::rmFunction) {
 			throw QueryServerError("invalid_view",String({"Specified view '",name,"' doesn't define reduce function"}));
+		} else {
+			output.add(view.rereduce(valueBuffer));
 		}
-		output.add(view.rereduce(valueBuffer));
 	}
 	rowBuffer.clear();
 	return {true,output};
@@ -338,7 +604,7 @@ Value QueryServer::compileDesignSection(T &reg, const Value &section, StrViewA s
 }
 
 
-Value QueryServer::commandDDoc(const Value& req, std::istream &input, std::ostream &output) {
+Value QueryServer::commandDDoc(const Value& req, Channel &channel) {
 	StrViewA docid = req[1].getString();
 	if (docid == "new") {
 		//cache new document
@@ -366,7 +632,7 @@ Value QueryServer::commandDDoc(const Value& req, std::istream &input, std::ostre
 		try {
 			switch(cmd){
 				case ddcmdShows: resp = commandShow(fn,arguments);break;
-				case ddcmdLists: resp = commandList(fn, arguments, input, output);break;
+				case ddcmdLists: resp = commandList(fn, arguments, channel);break;
 				case ddcmdFilters: resp = commandFilter(fn,arguments);break;
 				case ddcmdUpdates: resp = commandUpdate(fn,arguments);break;
 				case ddcmdViews: resp = commandView(fn,arguments);break;
@@ -385,14 +651,13 @@ Value QueryServer::commandShow(const Value& fn, const Value& args) {
 	return {"resp",resp};
 }
 
-Value QueryServer::commandList(const Value& fn, const Value& args, std::istream &input, std::ostream &output) {
+Value QueryServer::commandList(const Value& fn, const Value& args, Channel &channel) {
 
 	class ListCtx: public IListContext {
 	public:
-		std::istream &requests;
-		std::ostream &responses;
-		ListCtx(std::istream &requests,std::ostream &responses, Value viewHeader)
-			: requests(requests), responses(responses)
+		Channel &channel;
+		ListCtx(Channel &channel, Value viewHeader)
+			: channel(channel)
 			,viewHeader(viewHeader)
 			,eof(false),headerSent(false) {
 		}
@@ -406,10 +671,11 @@ Value QueryServer::commandList(const Value& fn, const Value& args, std::istream
 			} else {
 				resp = {"chunks" ,chunks};
 			}
-			resp.toStream(responses);
-			responses.put('\n');
+			channel.write(resp);
 			chunks.clear();
-			Value req = Value::fromStream(requests);
+			Value req = channel.read();
+			if (!req.defined())
+				throw QueryServerError("protocol_error","Unexpected end of input, expects list_row or list_end");
 
 			if (req[0].getString() == "list_row") {
 				return req[1];
@@ -453,7 +719,7 @@ Value QueryServer::commandList(const Value& fn, const Value& args, std::istream
 	const json::IValue *v = fn.getHandle()->unproxy();
 	AbstractListBase &listFn = dynamic_cast<const FnCallValue<AbstractListBase> &>(*v).getFunction();
 
-	ListCtx listCtx(input,output,args[0]);
+	ListCtx listCtx(channel,args[0]);
 	listFn.run(listCtx,args[1]);
 	return listCtx.finish();
 
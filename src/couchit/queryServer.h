@@ -9,6 +9,7 @@
 #define LIGHTCOUCH_QUERYSERVER_H_09888912AE57CCE472
 
 #include <ctime>
+#include <memory>
 #include "couchDB.h"
 #include "document.h"
 #include "query.h"
@@ -40,6 +41,8 @@ public:
 	 */
 	QueryServer(const StrViewA &name);
 
+	~QueryServer();
+
 
 	///Registers view
 	/**
@@ -91,11 +94,45 @@ public:
 	void regFilter(String filterName, AbstractFilterBase *impl);
 
 
+	///Transport of the query server protocol
+	/** The protocol transfers one JSON request and one JSON response per line. The responses
+	 * can be buffered, however they must be flushed before the channel starts to wait for the next
+	 * request
+	 */
+	class Channel {
+	public:
+		virtual ~Channel() {}
+		///Reads next request
+		/**
+		 * @return request, or undefined value when the end of input has been reached
+		 */
+		virtual Value read() = 0;
+		///Writes response
+		virtual void write(const Value &response) = 0;
+		///Flushes all pending responses
+		virtual void flush() = 0;
+	};
+
 	///Starts queryServer's dispatcher
 	/**
 	 */
 	int runDispatch(std::istream &input, std::ostream &output);
 
+	///Starts queryServer's dispatcher on the file descriptors
+	/**
+	 * Requests are read in large blocks and split to lines directly in the buffer. Responses
+	 * are collected in an output buffer, which is flushed only when no further request is
+	 * waiting in the input buffer. This is much faster than using the iostreams, when CouchDB
+	 * sends many map_doc requests during view build.
+	 *
+	 * @param fdin input descriptor
+	 * @param fdout output descriptor
+	 */
+	int runDispatch(int fdin, int fdout);
+
+	///Starts queryServer's dispatcher on the custom channel
+	int runDispatch(Channel &channel);
+
 	///start dispatching from standard input/output
 	virtual int runDispatchStdIO();
 
@@ -148,6 +185,22 @@ public:
 
 	void setRestartRule(const RestartRule &rule);
 
+	///Sets count of threads used to execute map functions
+	/**
+	 * When design document registers several views, the command map_doc can run the map
+	 * function of each view concurrently. The results are always returned in the order in
+	 * which the views were added, so the protocol order is not affected.
+	 *
+	 * @param threads count of threads. Value 0 or 1 disables parallel processing (default).
+	 * The dispatcher's thread also executes map functions, so the count of created worker
+	 * threads is threads-1.
+	 *
+	 * @note map functions of different views can be called at the same time. Each
+	 * view receives its own instance of the document, however the views must not share
+	 * unprotected state.
+	 */
+	void setMapThreads(unsigned int threads);
+
 
 
 protected:
@@ -182,7 +235,10 @@ protected:
 
 
 private:
+	class MapWorkers;
+
 	std::vector<AbstractViewBase  *> preparedMaps;
+	std::unique_ptr<MapWorkers> mapWorkers;
 
 	Value commandReset(const Value &req);
 	Value commandAddLib(const Value &req);
@@ -190,10 +246,10 @@ private:
 	Value commandMapDoc(const Value &req);
 	Value commandReduce(const Value &req);
 	Value commandReReduce(const Value &req);
-	Value commandDDoc(const Value &req, std::istream &input, std::ostream &output);
+	Value commandDDoc(const Value &req, Channel &channel);
 
 	Value commandShow(const Value &fn, const Value &args);
-	Value commandList(const Value &fn, const Value &args, std::istream &input, std::ostream &output);
+	Value commandList(const Value &fn, const Value &args, Channel &channel);
 	Value commandUpdate(const Value &fn, const Value &args);
 	Value commandView(const Value &fn, const Value &args);
 	Value commandFilter(const Value &fn, const Value &args);
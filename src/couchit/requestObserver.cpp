@@ -0,0 +1,139 @@
+/*
+ * requestObserver.cpp
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#include "requestObserver.h"
+
+#include <mutex>
+
+namespace couchit {
+
+static bool isNamedResource(StrViewA seg) {
+	return seg == "_view" || seg == "_show" || seg == "_list" || seg == "_update" || seg == "_rewrite";
+}
+
+String RequestInfo::makePathTemplate(StrViewA url, StrViewA baseUrl) {
+	StrViewA path = url;
+	if (!baseUrl.empty() && path.substr(0, baseUrl.length) == baseUrl) {
+		path = path.substr(baseUrl.length);
+	} else {
+		std::size_t p = path.indexOf("://",0);
+		if (p != path.npos) {
+			std::size_t q = path.indexOf("/",p+3);
+			path = q == path.npos?StrViewA():path.substr(q);
+		}
+	}
+	std::size_t q = path.indexOf("?",0);
+	if (q != path.npos) path = path.substr(0,q);
+
+	std::string out;
+	StrViewA prev;
+	bool haveDoc = false;
+	std::size_t pos = 0;
+	std::size_t segIndex = 0;
+	while (pos < path.length) {
+		std::size_t e = path.indexOf("/",pos);
+		if (e == path.npos) e = path.length;
+		StrViewA seg = path.substr(pos, e-pos);
+		pos = e+1;
+		if (seg.empty()) continue;
+		out.push_back('/');
+		if (segIndex == 0) {
+			if (seg[0] == '_') out.append(seg.data, seg.length);
+			else out.append("{db}");
+		} else if (prev == "_design") {
+			out.append("{ddoc}");
+			haveDoc = true;
+		} else if (prev == "_local") {
+			out.append("{docid}");
+			haveDoc = true;
+		} else if (isNamedResource(prev)) {
+			out.append("{name}");
+		} else if (seg[0] == '_') {
+			out.append(seg.data, seg.length);
+		} else if (!haveDoc) {
+			out.append("{docid}");
+			haveDoc = true;
+		} else {
+			out.append("{param}");
+		}
+		prev = seg;
+		segIndex++;
+	}
+	if (out.empty()) out.push_back('/');
+	return String(StrViewA(out));
+}
+
+RequestStats::Group &RequestStats::getGroup(const RequestInfo &info) {
+	std::string key;
+	key.reserve(info.method.length + info.pathTemplate.length() + 1);
+	key.append(info.method.data, info.method.length);
+	key.push_back(' ');
+	key.append(info.pathTemplate.c_str(), info.pathTemplate.length());
+	{
+		std::shared_lock<std::shared_mutex> _(lock);
+		auto iter = groups.find(key);
+		if (iter != groups.end()) return *iter->second;
+	}
+	std::unique_lock<std::shared_mutex> _(lock);
+	auto &g = groups[key];
+	if (g == nullptr) g = std::unique_ptr<Group>(new Group);
+	return *g;
+}
+
+void RequestStats::onRequest(const RequestInfo &info) {
+	Group &g = getGroup(info);
+	if (info.status < 200 || info.status >= 400) g.errors.fetch_add(1, std::memory_order_relaxed);
+	if (info.notModified) g.notModified.fetch_add(1, std::memory_order_relaxed);
+	if (info.fromCache) g.fromCache.fetch_add(1, std::memory_order_relaxed);
+	g.bytesSent.fetch_add(info.bytesSent, std::memory_order_relaxed);
+	g.bytesReceived.fetch_add(info.bytesReceived, std::memory_order_relaxed);
+	g.totalTime.record(std::chrono::duration_cast<std::chrono::nanoseconds>(info.totalTime).count());
+	g.timeToFirstByte.record(std::chrono::duration_cast<std::chrono::nanoseconds>(info.timeToFirstByte).count());
+	g.queueWait.record(std::chrono::duration_cast<std::chrono::nanoseconds>(info.queueWait).count());
+}
+
+Value RequestStats::Group::toJson() const {
+	return Object("count",totalTime.getCount())
+			("errors",errors.load(std::memory_order_relaxed))
+			("notModified",notModified.load(std::memory_order_relaxed))
+			("fromCache",fromCache.load(std::memory_order_relaxed))
+			("bytesSent",bytesSent.load(std::memory_order_relaxed))
+			("bytesReceived",bytesReceived.load(std::memory_order_relaxed))
+			("totalTime",totalTime.toJson(1e6))
+			("timeToFirstByte",timeToFirstByte.toJson(1e6))
+			("queueWait",queueWait.toJson(1e6));
+}
+
+void RequestStats::Group::reset() {
+	errors.store(0, std::memory_order_relaxed);
+	notModified.store(0, std::memory_order_relaxed);
+	fromCache.store(0, std::memory_order_relaxed);
+	bytesSent.store(0, std::memory_order_relaxed);
+	bytesReceived.store(0, std::memory_order_relaxed);
+	totalTime.reset();
+	timeToFirstByte.reset();
+	queueWait.reset();
+}
+
+Value RequestStats::dump(bool reset) {
+	Object res;
+	std::shared_lock<std::shared_mutex> _(lock);
+	for (auto &&g : groups) {
+		if (g.second->totalTime.getCount() == 0) continue;
+		res.set(StrViewA(g.first), g.second->toJson());
+		if (reset) g.second->reset();
+	}
+	return res;
+}
+
+void RequestStats::reset() {
+	std::shared_lock<std::shared_mutex> _(lock);
+	for (auto &&g : groups) g.second->reset();
+}
+
+
+}
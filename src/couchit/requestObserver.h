@@ -0,0 +1,134 @@
+/*
+ * requestObserver.h
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_COUCHIT_REQUESTOBSERVER_H_
+#define SRC_COUCHIT_REQUESTOBSERVER_H_
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+
+#include "hdrHistogram.h"
+#include "json.h"
+
+namespace couchit {
+
+
+///Information about single request made by the CouchDB object
+struct RequestInfo {
+	typedef std::chrono::steady_clock::duration Duration;
+
+	///HTTP method
+	StrViewA method;
+	///Full url of the request
+	StrViewA url;
+	///Path template
+	/** Path relative to the server's root, where the database name, document ids and names of
+	 * design documents are replaced by placeholders and the query string is removed. For example
+	 * "/{db}/_design/{ddoc}/_view/{name}". It allows to aggregate similar requests together
+	 */
+	String pathTemplate;
+	///Count of bytes sent (including headers)
+	std::uint64_t bytesSent = 0;
+	///Count of bytes received (including headers)
+	std::uint64_t bytesReceived = 0;
+	///Time spent waiting for a free connection (see Config::maxConnections)
+	Duration queueWait = Duration::zero();
+	///Time from the start of the request to the arrival of the response's headers
+	Duration timeToFirstByte = Duration::zero();
+	///Total time of the request including parsing the response
+	Duration totalTime = Duration::zero();
+	///Status code. It is 0 when the request failed without response
+	int status = 0;
+	///Server responded by 304 Not Modified
+	bool notModified = false;
+	///Result has been taken from the QueryCache
+	bool fromCache = false;
+
+	///Creates path template from the url
+	/**
+	 * @param url url of the request
+	 * @param baseUrl base url of the server (Config::baseUrl)
+	 * @return path template
+	 */
+	static String makePathTemplate(StrViewA url, StrViewA baseUrl);
+};
+
+
+///Receives information about finished requests
+/**
+ * Install the observer by Config::requestObserver. The observer is called by the thread which
+ * executed the request, so it must be MT safe, and it should not block.
+ *
+ * Reported are requests made through the requestGET, requestPOST, requestPUT and requestDELETE,
+ * attachment uploads and downloads and the requests of the changes feed. When the request is
+ * repeated because the server is not available, only the last attempt is reported, but the
+ * time includes all attempts.
+ *
+ * The attachment download is reported when the headers arrive, because the body is read
+ * later by the caller. The changes feed is reported when the connection is finished.
+ */
+class IRequestObserver {
+public:
+	virtual ~IRequestObserver() {}
+	virtual void onRequest(const RequestInfo &info) = 0;
+};
+
+
+///Aggregates requests into histograms
+/**
+ * Requests are grouped by method and path template. Every group collects counters
+ * and the HDR histograms of the total time, time to first byte and the queue wait. The object
+ * can be periodically dumped to the log or to a monitoring system
+ */
+class RequestStats: public IRequestObserver {
+public:
+
+	virtual void onRequest(const RequestInfo &info) override;
+
+	///Exports collected statistics
+	/**
+	 * @param reset set true to clear statistics after the export
+	 * @return object where the key is "METHOD pathTemplate" and the value contains counters and
+	 * histograms. Times are in milliseconds
+	 */
+	Value dump(bool reset = false);
+
+	///Clears statistics
+	void reset();
+
+protected:
+
+	struct Group {
+		std::atomic<std::uint64_t> errors{0};
+		std::atomic<std::uint64_t> notModified{0};
+		std::atomic<std::uint64_t> fromCache{0};
+		std::atomic<std::uint64_t> bytesSent{0};
+		std::atomic<std::uint64_t> bytesReceived{0};
+		HdrHistogram totalTime;
+		HdrHistogram timeToFirstByte;
+		HdrHistogram queueWait;
+
+		Value toJson() const;
+		void reset();
+	};
+
+	std::shared_mutex lock;
+	std::map<std::string, std::unique_ptr<Group>, std::less<> > groups;
+
+	Group &getGroup(const RequestInfo &info);
+};
+
+
+}
+
+
+
+#endif /* SRC_COUCHIT_REQUESTOBSERVER_H_ */
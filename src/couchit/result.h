@@ -15,6 +15,12 @@ namespace couchit {
 class Result: public Value {
 public:
 
+	///Constructs result from the response of the query
+	/**
+	 * @param result response of the query (object with rows) or array of rows
+	 * @exception std::runtime_error the response is unparsed, because the query
+	 * was executed with Query::lazy() or View::lazyRows. Use LazyResult in this case
+	 */
 	Result(const Value &result);
 	Result(const Value &resultArray, std::size_t total, std::size_t offset, const Value &updateSeq = json::undefined);
 
@@ -55,6 +55,12 @@ public:
 	 * returned
 	 */
 	static const std::size_t reverseOrder = 0x400;
+	///return the response unparsed
+	/** The query returns JSON text of the response as a string. Use LazyResult to access
+	 * the rows, which parses documents and values only when they are accessed. Ignored by
+	 * local views and by views with postprocessing
+	 */
+	static const std::size_t lazyRows = 0x800;
 
 
 	///specify group level
@@ -0,0 +1,1231 @@
+/*
+ * mockCouchDB.cpp
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#include "mockCouchDB.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <set>
+
+#include "../couchit/collation.h"
+#include "../couchit/defaultUIDGen.h"
+#include "../couchit/document.h"
+#include "../couchit/fnv.h"
+#include "../couchit/nativeReduce.h"
+#include "../couchit/revision.h"
+#include "../couchit/minihttp/chunkstream.h"
+#include "../couchit/minihttp/compression.h"
+#include "../couchit/minihttp/hdrrd.h"
+#include "../couchit/minihttp/stringstreams.h"
+
+namespace couchit {
+
+namespace {
+
+///Error reported to the client as the response
+class MockError {
+public:
+	MockError(int status, StrViewA error, StrViewA reason)
+		:status(status),body(Object("error",error)("reason",reason)) {}
+	int status;
+	Value body;
+};
+
+struct Row {
+	Value key;
+	Value value;
+	Value id;
+};
+
+static const std::size_t noLimit = (std::size_t)-1;
+
+}
+
+class MockCouchDB::Request {
+public:
+	std::string method;
+	///path split to segments, segments are url-decoded
+	std::vector<std::string> path;
+	///query arguments, url-decoded
+	std::map<std::string, std::string> args;
+	Value headers;
+	std::string body;
+
+	bool hasArg(const char *name) const {
+		return args.find(name) != args.end();
+	}
+	StrViewA arg(const char *name, StrViewA defVal = StrViewA()) const {
+		auto iter = args.find(name);
+		if (iter == args.end()) return defVal;
+		return StrViewA(iter->second);
+	}
+	bool boolArg(const char *name, bool defVal = false) const {
+		auto iter = args.find(name);
+		if (iter == args.end()) return defVal;
+		return iter->second == "true";
+	}
+	std::size_t numArg(const char *name, std::size_t defVal) const {
+		auto iter = args.find(name);
+		if (iter == args.end()) return defVal;
+		return std::strtoull(iter->second.c_str(), nullptr, 10);
+	}
+	///Retrieves JSON encoded argument
+	Value jsonArg(const char *name) const {
+		auto iter = args.find(name);
+		if (iter == args.end()) return Value(json::undefined);
+		try {
+			return Value::fromString(StrViewA(iter->second));
+		} catch (...) {
+			throw MockError(400,"bad_request",String({"Invalid JSON in argument ",name}).str());
+		}
+	}
+	///Parses body as JSON
+	Value jsonBody() const {
+		if (body.empty()) return Value(json::undefined);
+		try {
+			return Value::fromString(StrViewA(body));
+		} catch (...) {
+			throw MockError(400,"bad_request","invalid UTF-8 JSON");
+		}
+	}
+};
+
+class MockCouchDB::Response {
+public:
+	int status = 200;
+	std::string contentType = "application/json";
+	std::vector<std::pair<std::string, std::string> > headers;
+	std::string body;
+	///when set, the response is streamed by this function after headers are sent
+	std::function<void(NetworkConnection &)> stream;
+
+	void set(int status, const Value &v) {
+		this->status = status;
+		String s = v.stringify();
+		body.assign(s.c_str(), s.length());
+	}
+
+	void setError(int status, const Value &v) {
+		contentType = "application/json";
+		headers.clear();
+		stream = nullptr;
+		set(status, v);
+	}
+};
+
+class MockCouchDB::Database {
+public:
+	struct Record {
+		Value doc;
+		std::size_t seq;
+		bool deleted;
+	};
+
+	std::string name;
+	std::map<std::string, Record> docs;
+	std::map<std::string, Value> localDocs;
+	///changes ordered by sequence number, each document appears only once
+	std::map<std::size_t, std::string> changes;
+	std::size_t updateSeq = 0;
+	std::size_t docCount = 0;
+	std::size_t delCount = 0;
+	bool dropped = false;
+
+	///mapped rows of views with update sequence when they were created
+	std::map<std::string, std::pair<std::size_t, std::vector<Row> > > viewCache;
+
+	const Record *find(StrViewA id) const {
+		auto iter = docs.find(std::string(id.data, id.length));
+		if (iter == docs.end()) return nullptr;
+		return &iter->second;
+	}
+};
+
+static Value seqValue(std::size_t seq) {
+	return Value(StrViewA(std::to_string(seq) + "-mock"));
+}
+
+static std::size_t parseSeq(StrViewA seq, std::size_t now) {
+	if (seq == "now") return now;
+	std::string s(seq.data, seq.length);
+	//number or quoted string
+	if (!s.empty() && s[0] == '"') s = s.substr(1);
+	return std::strtoull(s.c_str(), nullptr, 10);
+}
+
+static std::string urlDecode(StrViewA str) {
+	std::string out;
+	out.reserve(str.length);
+	for (std::size_t i = 0; i < str.length; i++) {
+		char c = str[i];
+		if (c == '%' && i + 2 < str.length) {
+			char hex[3] = {str[i+1], str[i+2], 0};
+			out.push_back((char)std::strtol(hex, nullptr, 16));
+			i+=2;
+		} else {
+			out.push_back(c);
+		}
+	}
+	return out;
+}
+
+///Splits string by separator, empty parts are skipped
+template<typename Fn>
+static void splitString(StrViewA str, char sep, Fn &&fn) {
+	std::size_t b = 0;
+	for (std::size_t i = 0; i <= str.length; i++) {
+		if (i == str.length || str[i] == sep) {
+			if (i > b) fn(str.substr(b, i - b));
+			b = i + 1;
+		}
+	}
+}
+
+static std::string hexHash(json::BinaryView data) {
+	std::size_t pos = 0;
+	std::uint64_t h = FNV1a<8>::hash([&]() -> int {
+		if (pos < data.length) return data[pos++];
+		else return -1;
+	});
+	char buff[20];
+	snprintf(buff, sizeof(buff), "%016llx", (unsigned long long)h);
+	return buff;
+}
+
+static String makeRev(std::size_t revId, const Value &doc) {
+	String s = doc.stringify();
+	return String({StrViewA(std::to_string(revId)),"-",StrViewA(hexHash(json::BinaryView(s.str())))});
+}
+
+static int compareRaw(const Value &a, const Value &b) {
+	if (a.type() == json::string && b.type() == json::string) {
+		StrViewA sa = a.getString();
+		StrViewA sb = b.getString();
+		int c = std::memcmp(sa.data, sb.data, std::min(sa.length, sb.length));
+		if (c) return c < 0?-1:1;
+		return sa.length < sb.length?-1:sa.length > sb.length?1:0;
+	}
+	return compareJson(a,b);
+}
+
+///Attachment content as binary string
+static String attachmentBytes(const Value &data) {
+	if (data.flags() & json::binaryString) return String(data);
+	return String(json::base64->decodeBinaryValue(data.getString()));
+}
+
+///Parses the body of multipart/related PUT request
+/** The first part contains the document. Attachments marked by "follows" are
+ * stored in the following parts in order of their appearance in the document
+ */
+static Value parseMultipartRelated(const std::string &body, const std::string &contentType) {
+	auto bpos = contentType.find("boundary=");
+	if (bpos == contentType.npos) throw MockError(400,"bad_request","Missing boundary");
+	std::string boundary = contentType.substr(bpos+9);
+	if (!boundary.empty() && boundary[0] == '"') {
+		boundary = boundary.substr(1, boundary.find('"',1)-1);
+	} else {
+		boundary = boundary.substr(0, boundary.find(';'));
+	}
+	std::string delim = "--" + boundary;
+	std::string sep = "\r\n" + delim;
+
+	std::vector<std::string> parts;
+	std::size_t pos = body.find(delim);
+	while (pos != body.npos) {
+		pos += delim.size();
+		if (body.compare(pos, 2, "--") == 0) break;
+		if (body.compare(pos, 2, "\r\n") != 0) throw MockError(400,"bad_request","Malformed multipart body");
+		pos += 2;
+		//skip headers of the part
+		std::size_t start;
+		if (body.compare(pos, 2, "\r\n") == 0) {
+			start = pos + 2;
+		} else {
+			start = body.find("\r\n\r\n", pos);
+			if (start == body.npos) throw MockError(400,"bad_request","Malformed multipart body");
+			start += 4;
+		}
+		std::size_t next = body.find(sep, start);
+		if (next == body.npos) throw MockError(400,"bad_request","Malformed multipart body");
+		parts.push_back(body.substr(start, next-start));
+		pos = next + 2;
+	}
+	if (parts.empty()) throw MockError(400,"bad_request","Empty multipart body");
+
+	Value doc;
+	try {
+		doc = Value::fromString(StrViewA(parts[0]));
+	} catch (...) {
+		throw MockError(400,"bad_request","invalid UTF-8 JSON");
+	}
+	if (doc.type() != json::object) throw MockError(400,"bad_request","Document must be a JSON object");
+	Value srcAtts = doc["_attachments"];
+	if (srcAtts.type() != json::object) return doc;
+
+	Object atts;
+	std::size_t idx = 1;
+	for (Value a : srcAtts) {
+		if (a["follows"].getBool()) {
+			if (idx >= parts.size()) throw MockError(400,"bad_request","Missing attachment part");
+			const std::string &data = parts[idx++];
+			if (a["length"].defined() && a["length"].getUInt() != data.size())
+				throw MockError(400,"bad_request","Attachment length mismatch");
+			Object att(a);
+			att.unset("follows");
+			att.unset("length");
+			att.set("data", Value(json::BinaryView(StrViewA(data)), json::base64));
+			atts.set(a.getKey(), att);
+		} else {
+			atts.set(a.getKey(), a);
+		}
+	}
+	return Object(doc)("_attachments", atts);
+}
+
+///Prepares document for the output, attachments are replaced by stubs unless requested
+static Value outputDoc(const Value &doc, bool attachments, bool revs) {
+	Value atts = doc["_attachments"];
+	if (atts.type() != json::object && !revs) return doc;
+	Object out(doc);
+	if (atts.type() == json::object && !attachments) {
+		Object stubs;
+		for (Value a : atts) {
+			Object stub(a);
+			stub.unset("data");
+			stub.set("stub",true);
+			stubs.set(a.getKey(), stub);
+		}
+		out.set("_attachments", stubs);
+	}
+	if (revs) {
+		Revision rev(doc["_rev"]);
+		out.set("_revisions", Object("start",rev.getRevId())("ids",{rev.getTag()}));
+	}
+	return out;
+}
+
+MockCouchDB::MockCouchDB(const StrViewA &addr_ddot_port)
+	:listener(addr_ddot_port)
+	,requestCount(0)
+	,authorizedCount(0)
+	,stopped(false)
+{
+	acceptThread = std::thread([this]{acceptLoop();});
+}
+
+MockCouchDB::~MockCouchDB() {
+	{
+		Sync _(lock);
+		stopped = true;
+		for (auto &&c : connections) c->close();
+	}
+	changeSignal.notify_all();
+	listener.close();
+	acceptThread.join();
+	for (auto &&t : workers) t.join();
+}
+
+std::string MockCouchDB::getUrl() const {
+	return "http://127.0.0.1:" + std::to_string(listener.getPort()) + "/";
+}
+
+Config MockCouchDB::getConfig(const StrViewA &databaseName) const {
+	Config cfg;
+	cfg.baseUrl = getUrl();
+	cfg.databaseName = std::string(databaseName.data, databaseName.length);
+	return cfg;
+}
+
+void MockCouchDB::createDB(const StrViewA &databaseName) {
+	Sync _(lock);
+	std::string name(databaseName.data, databaseName.length);
+	auto &db = databases[name];
+	if (db == nullptr) {
+		db = std::make_shared<Database>();
+		db->name = name;
+	}
+}
+
+void MockCouchDB::regView(const StrViewA &databaseName, const StrViewA &viewName, AbstractViewBase *impl) {
+	Sync _(lock);
+	std::string key = std::string(databaseName.data, databaseName.length) + "/" + std::string(viewName.data, viewName.length);
+	views[key] = std::unique_ptr<AbstractViewBase>(impl);
+	for (auto &&db : databases) db.second->viewCache.erase(key);
+}
+
+void MockCouchDB::setFaults(const Faults &faults) {
+	Sync _(lock);
+	this->faults = faults;
+}
+
+void MockCouchDB::acceptLoop() {
+	for(;;) {
+		PNetworkConection conn;
+		try {
+			NetworkConnection *c = listener.accept();
+			if (c == nullptr) break;
+			conn = c;
+		} catch (...) {
+			break;
+		}
+		Sync _(lock);
+		if (stopped) {
+			conn->close();
+			break;
+		}
+		connections.push_back(conn);
+		workers.push_back(std::thread([this,conn]{serve(conn);}));
+	}
+}
+
+void MockCouchDB::serve(PNetworkConection conn) {
+	while (!stopped) {
+		Request req;
+		if (!readRequest(*conn, req)) break;
+		std::size_t n = ++requestCount;
+		if (req.headers["Authorization"].defined()) ++authorizedCount;
+		Faults f;
+		{
+			Sync _(lock);
+			f = faults;
+		}
+		if (f.dropEvery && n % f.dropEvery == 0) break;
+		if (f.latency) std::this_thread::sleep_for(std::chrono::milliseconds(f.latency));
+		Response resp;
+		if (f.failEvery && n % f.failEvery == 0) {
+			resp.set(f.failStatus, Object("error","unavailable")("reason","Injected failure"));
+		} else {
+			try {
+				dispatch(req, resp);
+			} catch (MockError &e) {
+				resp.setError(e.status, e.body);
+			} catch (std::exception &e) {
+				resp.setError(500, Object("error","internal_server_error")("reason",e.what()));
+			}
+		}
+		bool keepAlive = req.headers["Connection"].getString() != "close" && !resp.stream;
+		bool gzip = req.headers["Accept-Encoding"].getString().indexOf("gzip",0) != StrViewA::npos
+				&& isCompressionSupported();
+		sendResponse(*conn, resp, keepAlive, req.method == "HEAD", gzip);
+		if (!keepAlive || conn->hasErrors()) break;
+	}
+	conn->close();
+	Sync _(lock);
+	auto iter = std::find(connections.begin(), connections.end(), conn);
+	if (iter != connections.end()) connections.erase(iter);
+}
+
+bool MockCouchDB::readRequest(NetworkConnection &conn, Request &req) {
+	InputStream in(&conn);
+	HeaderRead<InputStream> hdrrd(in);
+	Value hdr = hdrrd.parseHeaders();
+	if (!hdr.defined() || !hdr["_method"].defined()) return false;
+
+	req.headers = hdr;
+	req.method = hdr["_method"].getString();
+	StrViewA uri = hdr["_uri"].getString();
+	std::size_t q = uri.indexOf("?",0);
+	StrViewA path = q == uri.npos?uri:uri.substr(0,q);
+	StrViewA query = q == uri.npos?StrViewA():uri.substr(q+1);
+	splitString(path, '/', [&](StrViewA seg) {
+		req.path.push_back(urlDecode(seg));
+	});
+	splitString(query, '&', [&](StrViewA a) {
+		std::size_t eq = a.indexOf("=",0);
+		if (eq == a.npos) req.args[urlDecode(a)] = std::string();
+		else req.args[urlDecode(a.substr(0,eq))] = urlDecode(a.substr(eq+1));
+	});
+
+	if (hdr["Transfer-Encoding"].getString() == "chunked") {
+		InputStream chunked(new ChunkedInputStream(in));
+		json::BinaryView b = chunked.read();
+		while (!b.empty()) {
+			req.body.append(reinterpret_cast<const char *>(b.data), b.length);
+			b = chunked.read();
+		}
+	} else {
+		std::size_t len = hdr["Content-Length"].getUInt();
+		while (len) {
+			json::BinaryView b = in.read();
+			if (b.empty()) return false;
+			json::BinaryView part = b.substr(0, len);
+			req.body.append(reinterpret_cast<const char *>(part.data), part.length);
+			in.putBack(b.substr(part.length));
+			len -= part.length;
+		}
+	}
+	return true;
+}
+
+static const char *statusMessage(int status) {
+	switch (status) {
+	case 200: return "OK";
+	case 201: return "Created";
+	case 202: return "Accepted";
+	case 304: return "Not Modified";
+	case 400: return "Bad Request";
+	case 404: return "Object Not Found";
+	case 405: return "Method Not Allowed";
+	case 409: return "Conflict";
+	case 412: return "Precondition Failed";
+	case 500: return "Internal Server Error";
+	case 503: return "Service Unavailable";
+	default: return "Unknown";
+	}
+}
+
+///Compresses the body to the gzip format and encodes it as a chunked body
+static std::string gzipChunked(const std::string &body) {
+	std::string compressed;
+	auto outfn = [&](json::BinaryView data) {
+		compressed.append(reinterpret_cast<const char *>(data.data), data.length);
+	};
+	{
+		OutputStream out(new DeflateOutputStream(new ConsumentOutputStream<decltype(outfn)>(outfn)));
+		out(json::BinaryView(StrViewA(body)));
+		out(nullptr);
+	}
+	char hdr[20];
+	snprintf(hdr, sizeof(hdr), "%zx\r\n", compressed.size());
+	std::string out(hdr);
+	out.append(compressed).append("\r\n0\r\n\r\n");
+	return out;
+}
+
+void MockCouchDB::sendResponse(NetworkConnection &conn, const Response &resp, bool keepAlive, bool headOnly, bool gzip) {
+	std::string out = "HTTP/1.1 " + std::to_string(resp.status) + " " + statusMessage(resp.status) + "\r\n";
+	out.append("Server: CouchDB (couchit mock)\r\n");
+	if (resp.status != 304) out.append("Content-Type: " + resp.contentType + "\r\n");
+	for (auto &&h : resp.headers) {
+		out.append(h.first).append(": ").append(h.second).append("\r\n");
+	}
+	if (resp.stream) {
+		out.append("Connection: close\r\n\r\n");
+		writeThrottled(conn, json::BinaryView(StrViewA(out)));
+		try {
+			resp.stream(conn);
+		} catch (...) {
+			//connection is closed anyway
+		}
+		return;
+	}
+	if (gzip && !headOnly && !resp.body.empty() && resp.status != 304) {
+		out.append("Content-Encoding: gzip\r\nTransfer-Encoding: chunked\r\n");
+		if (!keepAlive) out.append("Connection: close\r\n");
+		out.append("\r\n");
+		out.append(gzipChunked(resp.body));
+		writeThrottled(conn, json::BinaryView(StrViewA(out)));
+		return;
+	}
+	out.append("Content-Length: " + std::to_string(resp.body.size()) + "\r\n");
+	if (!keepAlive) out.append("Connection: close\r\n");
+	out.append("\r\n");
+	if (!headOnly) out.append(resp.body);
+	writeThrottled(conn, json::BinaryView(StrViewA(out)));
+}
+
+void MockCouchDB::writeThrottled(NetworkConnection &conn, json::BinaryView data) {
+	std::size_t bandwidth;
+	{
+		Sync _(lock);
+		bandwidth = faults.bandwidth;
+	}
+	if (bandwidth == 0) {
+		conn.write(data);
+		conn.flush();
+		return;
+	}
+	//data are sent in slices, each slice is delayed to keep the requested rate
+	std::size_t slice = std::max<std::size_t>(bandwidth / 50, 1);
+	auto start = std::chrono::steady_clock::now();
+	std::size_t sent = 0;
+	while (!data.empty() && !conn.hasErrors()) {
+		json::BinaryView part = data.substr(0, slice);
+		conn.write(part);
+		conn.flush();
+		sent += part.length;
+		data = data.substr(part.length);
+		std::this_thread::sleep_until(start + std::chrono::microseconds(sent * 1000000 / bandwidth));
+	}
+}
+
+std::shared_ptr<MockCouchDB::Database> MockCouchDB::findDB(const std::string &dbname) {
+	Sync _(lock);
+	auto iter = databases.find(dbname);
+	if (iter == databases.end()) throw MockError(404,"not_found","Database does not exist.");
+	return iter->second;
+}
+
+AbstractViewBase *MockCouchDB::findView(const Database &db, const std::string &viewName) {
+	auto iter = views.find(db.name + "/" + viewName);
+	if (iter == views.end()) throw MockError(404,"not_found","missing_named_view");
+	return iter->second.get();
+}
+
+void MockCouchDB::dispatch(Request &req, Response &resp) {
+	const std::vector<std::string> &p = req.path;
+	if (p.empty() || p[0][0] == '_') {
+		handleServer(req, resp);
+		return;
+	}
+	if (p.size() == 1) {
+		handleDB(req, resp, p[0]);
+		return;
+	}
+	std::shared_ptr<Database> db = findDB(p[0]);
+	const std::string &res = p[1];
+	if (res == "_all_docs") handleAllDocs(req, resp, *db);
+	else if (res == "_bulk_docs") handleBulkDocs(req, resp, *db);
+	else if (res == "_bulk_get") handleBulkGet(req, resp, *db);
+	else if (res == "_changes") handleChanges(req, resp, db);
+	else if (res == "_ensure_full_commit") resp.set(201, Object("ok",true));
+	else if (res == "_design" || res == "_local") {
+		if (p.size() < 3) throw MockError(400,"illegal_docid","Illegal document id");
+		std::string docId = res.substr(1) + "/" + p[2];
+		if (res == "_design" && p.size() == 5 && p[3] == "_view") handleView(req, resp, *db, p[2] + "/" + p[4]);
+		else if (p.size() == 3) handleDoc(req, resp, *db, docId);
+		else if (res == "_design") handleAttachment(req, resp, *db, docId, p[3]);
+		else throw MockError(400,"bad_request","Local documents don't have attachments");
+	} else if (res[0] == '_') {
+		throw MockError(400,"bad_request","Unsupported request");
+	} else if (p.size() == 2) {
+		handleDoc(req, resp, *db, res);
+	} else {
+		std::string att = p[2];
+		for (std::size_t i = 3; i < p.size(); i++) att.append("/").append(p[i]);
+		handleAttachment(req, resp, *db, res, att);
+	}
+}
+
+void MockCouchDB::handleServer(Request &req, Response &resp) {
+	const std::vector<std::string> &p = req.path;
+	if (p.empty()) {
+		resp.set(200, Object("couchdb","Welcome")("version","2.3.1")("vendor",Object("name","couchit mock")));
+	} else if (p[0] == "_all_dbs") {
+		Sync _(lock);
+		Array res;
+		for (auto &&db : databases) res.push_back(StrViewA(db.first));
+		resp.set(200, res);
+	} else if (p[0] == "_uuids") {
+		std::size_t count = req.numArg("count", 1);
+		Array res;
+		for (std::size_t i = 0; i < count; i++) res.push_back(FastUIDGen::getInstance()(""));
+		resp.set(200, Object("uuids",res));
+	} else if (p[0] == "_session") {
+		resp.set(200, Object("ok",true)("userCtx",Object("name",nullptr)("roles",json::array)));
+	} else {
+		throw MockError(400,"illegal_database_name","Name must begin with a letter.");
+	}
+}
+
+void MockCouchDB::handleDB(Request &req, Response &resp, const std::string &dbname) {
+	Sync _(lock);
+	auto iter = databases.find(dbname);
+	if (req.method == "PUT") {
+		if (iter != databases.end())
+			throw MockError(412,"file_exists","The database could not be created, the file already exists.");
+		auto db = std::make_shared<Database>();
+		db->name = dbname;
+		databases[dbname] = db;
+		resp.set(201, Object("ok",true));
+		return;
+	}
+	if (iter == databases.end()) throw MockError(404,"not_found","Database does not exist.");
+	Database &db = *iter->second;
+	if (req.method == "GET" || req.method == "HEAD") {
+		resp.set(200, Object("db_name",StrViewA(dbname))
+				("doc_count",db.docCount)
+				("doc_del_count",db.delCount)
+				("update_seq",seqValue(db.updateSeq))
+				("instance_start_time","0"));
+	} else if (req.method == "DELETE") {
+		db.dropped = true;
+		databases.erase(iter);
+		changeSignal.notify_all();
+		resp.set(200, Object("ok",true));
+	} else if (req.method == "POST") {
+		Value r = storeDoc(db, req.jsonBody(), true);
+		if (r["error"].defined()) throw MockError(409, r["error"].getString(), r["reason"].getString());
+		resp.set(201, r);
+	} else {
+		throw MockError(405,"method_not_allowed","Only GET,HEAD,PUT,POST,DELETE allowed");
+	}
+}
+
+Value MockCouchDB::storeDoc(Database &db, Value doc, bool newEdits) {
+	if (doc.type() != json::object) return Object("error","bad_request")("reason","Document must be a JSON object");
+	Value id = doc["_id"];
+	if (!id.defined()) {
+		id = FastUIDGen::getInstance()("");
+		doc = Object(doc)("_id",id);
+	}
+	StrViewA strid = id.getString();
+	std::string key(strid.data, strid.length);
+
+	if (strid.substr(0,7) == "_local/") {
+		auto iter = db.localDocs.find(key);
+		Value cur = iter == db.localDocs.end()?Value():iter->second;
+		if (newEdits && cur.defined() && doc["_rev"] != cur["_rev"])
+			return Object("id",id)("error","conflict")("reason","Document update conflict.");
+		String newRev({"0-",StrViewA(std::to_string(Revision(cur["_rev"]).getRevId() + 1))});
+		if (doc["_deleted"].getBool()) db.localDocs.erase(key);
+		else db.localDocs[key] = Object(doc)("_rev",newRev);
+		return Object("ok",true)("id",id)("rev",newRev);
+	}
+
+	auto iter = db.docs.find(key);
+	Database::Record *cur = iter == db.docs.end()?nullptr:&iter->second;
+	bool deleted = doc["_deleted"].getBool();
+	String newRev;
+
+	if (newEdits) {
+		Value rev = doc["_rev"];
+		if (cur == nullptr || cur->deleted) {
+			if (rev.defined() && (cur == nullptr || rev != cur->doc["_rev"]))
+				return Object("id",id)("error","conflict")("reason","Document update conflict.");
+		} else if (rev != cur->doc["_rev"]) {
+			return Object("id",id)("error","conflict")("reason","Document update conflict.");
+		}
+		std::size_t revId = cur?Revision(cur->doc["_rev"]).getRevId() + 1:1;
+		newRev = makeRev(revId, doc);
+	} else {
+		newRev = String(doc["_rev"]);
+		if (cur && Revision(cur->doc["_rev"]) >= Revision(newRev)) {
+			//current revision wins
+			return Object("ok",true)("id",id)("rev",newRev);
+		}
+	}
+
+	Object ndoc(doc);
+	ndoc.set("_rev", newRev);
+	Value atts = doc["_attachments"];
+	if (atts.type() == json::object) {
+		Value prevAtts = cur?cur->doc["_attachments"]:Value();
+		std::size_t revpos = Revision(newRev).getRevId();
+		Object natts;
+		for (Value a : atts) {
+			if (a["stub"].getBool()) {
+				Value prev = prevAtts[a.getKey()];
+				if (!prev.defined()) return Object("id",id)("error","missing_stub")("reason",String({"Missing attachment: ",a.getKey()}));
+				natts.set(a.getKey(), prev);
+			} else {
+				String bin = attachmentBytes(a["data"]);
+				json::BinaryView bv(bin.str());
+				natts.set(a.getKey(), Object("content_type",a["content_type"])
+						("data",Value(bv, json::base64))
+						("length",bv.length)
+						("digest",StrViewA("md5-" + hexHash(bv)))
+						("revpos",revpos));
+			}
+		}
+		ndoc.set("_attachments", natts);
+	}
+
+	if (cur == nullptr) {
+		cur = &db.docs[key];
+	} else {
+		db.changes.erase(cur->seq);
+		if (cur->deleted) db.delCount--; else db.docCount--;
+	}
+	cur->doc = deleted?Value(Object("_id",id)("_rev",newRev)("_deleted",true)):Value(ndoc);
+	cur->deleted = deleted;
+	cur->seq = ++db.updateSeq;
+	if (deleted) db.delCount++; else db.docCount++;
+	db.changes[cur->seq] = key;
+	changeSignal.notify_all();
+	return Object("ok",true)("id",id)("rev",newRev);
+}
+
+static int errorStatus(const Value &result) {
+	StrViewA err = result["error"].getString();
+	if (err == "conflict") return 409;
+	if (err == "missing_stub") return 412;
+	return 400;
+}
+
+void MockCouchDB::handleDoc(Request &req, Response &resp, Database &db, const std::string &docId) {
+	Sync _(lock);
+	bool local = docId.compare(0,7,"_local/") == 0;
+	if (req.method == "GET" || req.method == "HEAD") {
+		Value doc;
+		if (local) {
+			auto iter = db.localDocs.find(docId);
+			if (iter == db.localDocs.end()) throw MockError(404,"not_found","missing");
+			doc = iter->second;
+		} else {
+			const Database::Record *rec = db.find(docId);
+			if (rec == nullptr) throw MockError(404,"not_found","missing");
+			if (req.hasArg("rev") && req.arg("rev") != rec->doc["_rev"].getString())
+				throw MockError(404,"not_found","missing");
+			if (rec->deleted && !req.hasArg("rev")) throw MockError(404,"not_found","deleted");
+			doc = rec->doc;
+		}
+		String etag({"\"",doc["_rev"].getString(),"\""});
+		resp.headers.emplace_back("ETag", etag.c_str());
+		if (req.headers["If-None-Match"].getString() == etag.str()) {
+			resp.status = 304;
+			return;
+		}
+		resp.set(200, outputDoc(doc, req.boolArg("attachments"), req.boolArg("revs")));
+	} else if (req.method == "PUT") {
+		StrViewA ct = req.headers["Content-Type"].getString();
+		Value body = ct.substr(0,17) == "multipart/related"
+				?parseMultipartRelated(req.body, std::string(ct.data, ct.length))
+				:req.jsonBody();
+		if (body.type() != json::object) throw MockError(400,"bad_request","Document must be a JSON object");
+		Object doc(body);
+		doc.set("_id", StrViewA(docId));
+		if (req.hasArg("rev") && !body["_rev"].defined()) doc.set("_rev", req.arg("rev"));
+		Value r = storeDoc(db, doc, req.arg("new_edits") != "false");
+		if (r["error"].defined()) throw MockError(errorStatus(r), r["error"].getString(), r["reason"].getString());
+		resp.set(201, r);
+	} else if (req.method == "DELETE") {
+		Value r = storeDoc(db, Object("_id",StrViewA(docId))("_rev",req.hasArg("rev")?Value(req.arg("rev")):Value())("_deleted",true), true);
+		if (r["error"].defined()) throw MockError(errorStatus(r), r["error"].getString(), r["reason"].getString());
+		resp.set(200, r);
+	} else {
+		throw MockError(405,"method_not_allowed","Only GET,HEAD,PUT,DELETE allowed");
+	}
+}
+
+void MockCouchDB::handleAttachment(Request &req, Response &resp, Database &db, const std::string &docId, const std::string &attName) {
+	Sync _(lock);
+	const Database::Record *rec = db.find(docId);
+	if (req.method == "GET" || req.method == "HEAD") {
+		if (rec == nullptr || rec->deleted) throw MockError(404,"not_found","missing");
+		Value att = rec->doc["_attachments"][attName];
+		if (!att.defined()) throw MockError(404,"not_found","Document is missing attachment");
+		String etag({"\"",att["digest"].getString(),"\""});
+		resp.headers.emplace_back("ETag", etag.c_str());
+		if (req.headers["If-None-Match"].getString() == etag.str()) {
+			resp.status = 304;
+			return;
+		}
+		String bin = attachmentBytes(att["data"]);
+		StrViewA ct = att["content_type"].getString();
+		resp.contentType.assign(ct.data, ct.length);
+		resp.body.assign(bin.c_str(), bin.length());
+		return;
+	}
+
+	Value rev = req.hasArg("rev")?Value(req.arg("rev")):Value();
+	if (req.method == "PUT") {
+		Object doc(rec && !rec->deleted?rec->doc:Value(Object("_id",StrViewA(docId))));
+		if (rec && rec->deleted) doc.set("_rev", rec->doc["_rev"]);
+		Value ct = req.headers["Content-Type"];
+		Object atts(doc["_attachments"]);
+		for (Value a: Value(atts)) {
+			if (!a["stub"].defined()) atts.set(a.getKey(), Object(a)("stub",true));
+		}
+		atts.set(attName, Object("content_type",ct.defined()?ct:Value("application/octet-stream"))
+				("data",Value(json::BinaryView(StrViewA(req.body)), json::base64)));
+		doc.set("_attachments", atts);
+		if (rev.defined()) doc.set("_rev", rev); else if (rec == nullptr) doc.unset("_rev");
+		Value r = storeDoc(db, doc, true);
+		if (r["error"].defined()) throw MockError(errorStatus(r), r["error"].getString(), r["reason"].getString());
+		resp.set(201, r);
+	} else if (req.method == "DELETE") {
+		if (rec == nullptr || rec->deleted) throw MockError(404,"not_found","missing");
+		Object doc(rec->doc);
+		Object atts;
+		for (Value a : rec->doc["_attachments"]) {
+			if (a.getKey() != StrViewA(attName)) atts.set(a.getKey(), Object(a)("stub",true));
+		}
+		doc.set("_attachments", atts);
+		doc.set("_rev", rev);
+		Value r = storeDoc(db, doc, true);
+		if (r["error"].defined()) throw MockError(errorStatus(r), r["error"].getString(), r["reason"].getString());
+		resp.set(200, r);
+	} else {
+		throw MockError(405,"method_not_allowed","Only GET,HEAD,PUT,DELETE allowed");
+	}
+}
+
+namespace {
+
+typedef int (*CompareFn)(const Value &, const Value &);
+
+///Selects rows by the arguments of the query (keys or range, descending)
+class RowSelector {
+public:
+	RowSelector(const MockCouchDB::Request &req, CompareFn cmp):cmp(cmp) {
+		desc = req.boolArg("descending");
+		inclusiveEnd = req.boolArg("inclusive_end", true);
+		Value key = req.jsonArg("key");
+		if (key.defined()) {
+			startKey = endKey = key;
+		} else {
+			startKey = req.jsonArg(req.hasArg("start_key")?"start_key":"startkey");
+			endKey = req.jsonArg(req.hasArg("end_key")?"end_key":"endkey");
+		}
+		StrViewA sd = req.arg(req.hasArg("start_key_doc_id")?"start_key_doc_id":"startkey_docid");
+		StrViewA ed = req.arg(req.hasArg("end_key_doc_id")?"end_key_doc_id":"endkey_docid");
+		if (!sd.empty()) startDocId = sd;
+		if (!ed.empty()) endDocId = ed;
+	}
+
+	///Selects rows from sorted vector
+	template<typename Fn>
+	void select(const std::vector<Row> &rows, const Value &keys, Fn &&fn) const {
+		int dir = desc?-1:1;
+		if (keys.type() == json::array) {
+			for (Value k : keys) {
+				for (std::size_t i = 0; i < rows.size(); i++) {
+					if (cmp(rows[i].key, k) == 0) fn(rows[i], k);
+				}
+			}
+			return;
+		}
+		std::size_t cnt = rows.size();
+		for (std::size_t j = 0; j < cnt; j++) {
+			const Row &r = rows[desc?cnt - j - 1:j];
+			if (startKey.defined()) {
+				int c = cmp(r.key, startKey) * dir;
+				if (c < 0) continue;
+				if (c == 0 && startDocId.defined() && compareRaw(r.id, startDocId) * dir < 0) continue;
+			}
+			if (endKey.defined()) {
+				int c = cmp(r.key, endKey) * dir;
+				if (c > 0) break;
+				if (c == 0) {
+					if (endDocId.defined()) {
+						int d = compareRaw(r.id, endDocId) * dir;
+						if (d > 0 || (d == 0 && !inclusiveEnd)) break;
+					} else if (!inclusiveEnd) {
+						break;
+					}
+				}
+			}
+			fn(r, Value());
+		}
+	}
+
+	CompareFn cmp;
+	bool desc;
+	bool inclusiveEnd;
+	Value startKey, endKey, startDocId, endDocId;
+};
+
+///Emits rows into the vector
+class RowCollector: public IEmitFn {
+public:
+	RowCollector(std::vector<Row> &rows):rows(rows) {}
+	virtual void operator()() override {rows.push_back(Row{nullptr,nullptr,id});}
+	virtual void operator()(const Value &key) override {rows.push_back(Row{key,nullptr,id});}
+	virtual void operator()(const Value &key, const Value &value) override {rows.push_back(Row{key,value,id});}
+	Value id;
+protected:
+	std::vector<Row> &rows;
+};
+
+static Value keysFromRequest(const MockCouchDB::Request &req) {
+	Value keys = req.jsonArg("keys");
+	if (!keys.defined() && req.method == "POST") keys = req.jsonBody()["keys"];
+	return keys;
+}
+
+///Applies skip and limit to the result rows
+static Value limitRows(const Array &rows, const MockCouchDB::Request &req) {
+	std::size_t skip = req.numArg("skip", 0);
+	std::size_t limit = req.numArg("limit", noLimit);
+	if (skip == 0 && limit >= rows.size()) return rows;
+	Array res;
+	for (std::size_t i = skip; i < rows.size() && res.size() < limit; i++) res.push_back(rows[i]);
+	return res;
+}
+
+}
+
+void MockCouchDB::handleAllDocs(Request &req, Response &resp, Database &db) {
+	Sync _(lock);
+	bool includeDocs = req.boolArg("include_docs");
+	bool attachments = req.boolArg("attachments");
+	Value keys = keysFromRequest(req);
+	Array rows;
+	if (keys.type() == json::array) {
+		for (Value k : keys) {
+			const Database::Record *rec = k.type() == json::string?db.find(k.getString()):nullptr;
+			if (rec == nullptr) {
+				rows.push_back(Object("key",k)("error","not_found"));
+			} else if (rec->deleted) {
+				rows.push_back(Object("id",k)("key",k)("value",Object("rev",rec->doc["_rev"])("deleted",true))
+						("doc",includeDocs?Value(nullptr):Value(json::undefined)));
+			} else {
+				rows.push_back(Object("id",k)("key",k)("value",Object("rev",rec->doc["_rev"]))
+						("doc",includeDocs?outputDoc(rec->doc,attachments,false):Value(json::undefined)));
+			}
+		}
+	} else {
+		std::vector<Row> all;
+		all.reserve(db.docCount);
+		for (auto &&d : db.docs) {
+			if (d.second.deleted) continue;
+			Value id = d.second.doc["_id"];
+			all.push_back(Row{id, Object("rev",d.second.doc["_rev"]), id});
+		}
+		RowSelector sel(req, &compareRaw);
+		sel.select(all, keys, [&](const Row &r, const Value &) {
+			rows.push_back(Object("id",r.id)("key",r.key)("value",r.value)
+					("doc",includeDocs?outputDoc(db.find(r.id.getString())->doc,attachments,false):Value(json::undefined)));
+		});
+	}
+	Object out;
+	out("total_rows",db.docCount)("offset",req.numArg("skip",0))("rows",limitRows(rows, req));
+	if (req.boolArg("update_seq")) out("update_seq",seqValue(faults.zeroViewSeq?0:db.updateSeq));
+	resp.set(200, out);
+}
+
+void MockCouchDB::handleView(Request &req, Response &resp, Database &db, const std::string &viewName) {
+	Sync _(lock);
+	AbstractViewBase *view = findView(db, viewName);
+
+	auto &cache = db.viewCache[db.name + "/" + viewName];
+	std::vector<Row> &all = cache.second;
+	if (cache.first != db.updateSeq || (all.empty() && db.docCount)) {
+		all.clear();
+		RowCollector emit(all);
+		for (auto &&d : db.docs) {
+			if (d.second.deleted || d.first.compare(0,8,"_design/") == 0) continue;
+			emit.id = d.second.doc["_id"];
+			view->map(Document(d.second.doc), emit);
+		}
+		std::stable_sort(all.begin(), all.end(), [](const Row &a, const Row &b) {
+			int c = compareJson(a.key, b.key);
+			if (c == 0) c = compareRaw(a.id, b.id);
+			return c < 0;
+		});
+		cache.first = db.updateSeq;
+	}
+
+	Value keys = keysFromRequest(req);
+	RowSelector sel(req, &compareJson);
+	AbstractViewBase::ReduceMode mode = view->reduceMode();
+	bool reduce = mode != AbstractViewBase::rmNone && req.boolArg("reduce", true);
+	Array rows;
+
+	if (reduce) {
+		std::size_t level = req.boolArg("group")?noLimit:req.numArg("group_level", keys.defined()?noLimit:0);
+		auto groupKey = [&](const Value &key) -> Value {
+			if (level == noLimit) return key;
+			if (level == 0) return nullptr;
+			if (key.type() != json::array || key.size() <= level) return key;
+			Array k;
+			for (std::size_t i = 0; i < level; i++) k.push_back(key[i]);
+			return k;
+		};
+		std::vector<RowWithKey> group;
+		Value curKey;
+		auto flush = [&] {
+			if (group.empty()) return;
+			RowsWithKeys rwk(group.data(), group.size());
+			Value v = NativeReduce::isNative(mode)?NativeReduce::reduce(mode, rwk):view->reduce(rwk);
+			rows.push_back(Object("key",curKey)("value",v));
+			group.clear();
+		};
+		auto collect = [&](const Row &r, const Value &) {
+			Value k = groupKey(r.key);
+			if (!group.empty() && compareJson(k, curKey) != 0) flush();
+			curKey = k;
+			group.push_back(RowWithKey(r.id, r.key, r.value));
+		};
+		if (keys.type() == json::array) {
+			//each requested key is reduced separately, even if it is repeated
+			for (Value k : keys) {
+				sel.select(all, Value(json::array, {k}), collect);
+				flush();
+			}
+		} else {
+			sel.select(all, keys, collect);
+			flush();
+		}
+	} else {
+		bool includeDocs = req.boolArg("include_docs");
+		bool attachments = req.boolArg("attachments");
+		sel.select(all, keys, [&](const Row &r, const Value &) {
+			Object row;
+			row("id",r.id)("key",r.key)("value",r.value);
+			if (includeDocs) {
+				Value linked = r.value.type() == json::object?r.value["_id"]:Value();
+				const Database::Record *rec = db.find(linked.type() == json::string?linked.getString():r.id.getString());
+				row("doc",rec && !rec->deleted?outputDoc(rec->doc,attachments,false):Value(nullptr));
+			}
+			rows.push_back(row);
+		});
+	}
+
+	Object out;
+	if (!reduce) out("total_rows",all.size())("offset",req.numArg("skip",0));
+	out("rows",limitRows(rows, req));
+	if (req.boolArg("update_seq")) out("update_seq",seqValue(faults.zeroViewSeq?0:db.updateSeq));
+	resp.set(200, out);
+}
+
+void MockCouchDB::handleBulkDocs(Request &req, Response &resp, Database &db) {
+	if (req.method != "POST") throw MockError(405,"method_not_allowed","Only POST allowed");
+	Value body = req.jsonBody();
+	Value docs = body["docs"];
+	if (docs.type() != json::array) throw MockError(400,"bad_request","POST body must include `docs` parameter.");
+	bool newEdits = body["new_edits"].defined()?body["new_edits"].getBool():true;
+	Sync _(lock);
+	Array results;
+	results.reserve(docs.size());
+	for (Value d : docs) {
+		Value r = storeDoc(db, d, newEdits);
+		if (newEdits || r["error"].defined()) results.push_back(r);
+	}
+	resp.set(201, results);
+}
+
+void MockCouchDB::handleBulkGet(Request &req, Response &resp, Database &db) {
+	if (req.method != "POST") throw MockError(405,"method_not_allowed","Only POST allowed");
+	Value docs = req.jsonBody()["docs"];
+	if (docs.type() != json::array) throw MockError(400,"bad_request","Missing JSON list of 'docs'.");
+	bool attachments = req.boolArg("attachments");
+	bool revs = req.boolArg("revs");
+	Sync _(lock);
+	Array results;
+	for (Value d : docs) {
+		Value id = d["id"];
+		Value rev = d["rev"];
+		const Database::Record *rec = id.type() == json::string?db.find(id.getString()):nullptr;
+		Value item;
+		if (rec == nullptr || (rev.defined() && rev != rec->doc["_rev"])) {
+			item = Object("error",Object("id",id)("rev",rev.defined()?rev:Value("undefined"))
+					("error","not_found")("reason","missing"));
+		} else {
+			item = Object("ok",outputDoc(rec->doc, attachments, revs));
+		}
+		results.push_back(Object("id",id)("docs",{item}));
+	}
+	resp.set(200, Object("results",results));
+}
+
+Value MockCouchDB::collectChanges(Database &db, const Request &req, std::size_t &since, std::size_t limit) {
+	bool desc = req.boolArg("descending");
+	bool includeDocs = req.boolArg("include_docs");
+	bool attachments = req.boolArg("attachments");
+	StrViewA filter = req.arg("filter");
+
+	std::set<std::string> docIds;
+	AbstractViewBase *view = nullptr;
+	if (filter == "_doc_ids") {
+		Value ids = req.jsonArg("doc_ids");
+		if (!ids.defined() && req.method == "POST") ids = req.jsonBody()["doc_ids"];
+		for (Value i : ids) docIds.insert(std::string(i.getString().data, i.getString().length));
+	} else if (filter == "_view") {
+		view = findView(db, std::string(req.arg("view").data, req.arg("view").length));
+	} else if (!filter.empty() && filter != "_design") {
+		throw MockError(400,"bad_request","Only _doc_ids, _design and _view filters are supported");
+	}
+
+	Array rows;
+	auto process = [&](std::size_t seq, const std::string &id) {
+		since = seq;
+		if (!docIds.empty() && docIds.find(id) == docIds.end()) return;
+		if (filter == "_design" && id.compare(0,8,"_design/") != 0) return;
+		const Database::Record &rec = db.docs[id];
+		if (view) {
+			std::vector<Row> tmp;
+			RowCollector emit(tmp);
+			emit.id = rec.doc["_id"];
+			if (!rec.deleted) view->map(Document(rec.doc), emit);
+			if (tmp.empty()) return;
+		}
+		Object row;
+		row("seq",seqValue(seq))("id",rec.doc["_id"])("changes",{Object("rev",rec.doc["_rev"])});
+		if (rec.deleted) row("deleted",true);
+		if (includeDocs) row("doc",outputDoc(rec.doc, attachments, false));
+		rows.push_back(row);
+	};
+
+	if (desc) {
+		for (auto iter = db.changes.rbegin(); iter != db.changes.rend() && rows.size() < limit; ++iter) {
+			process(iter->first, iter->second);
+		}
+	} else {
+		for (auto iter = db.changes.upper_bound(since); iter != db.changes.end() && rows.size() < limit; ++iter) {
+			process(iter->first, iter->second);
+		}
+	}
+	return rows;
+}
+
+void MockCouchDB::handleChanges(Request &req, Response &resp, const std::shared_ptr<Database> &db) {
+	StrViewA feed = req.arg("feed", "normal");
+	std::size_t limit = req.numArg("limit", noLimit);
+	if (limit == 0) limit = 1;
+	bool heartbeat = req.hasArg("heartbeat");
+	std::size_t heartbeatInterval = req.arg("heartbeat") == "true"?60000:req.numArg("heartbeat", 60000);
+	//with heartbeat, the feed waits infinitely
+	std::size_t timeout = req.numArg("timeout", heartbeat?noLimit:60000);
+	std::size_t since;
+	{
+		Sync _(lock);
+		since = parseSeq(req.arg("since","0"), db->updateSeq);
+	}
+
+	auto waitChange = [this, db](Sync &sync, std::size_t since, std::size_t ms) {
+		auto pred = [&]{return stopped || db->dropped || db->updateSeq > since;};
+		if (ms == noLimit) changeSignal.wait(sync, pred);
+		else changeSignal.wait_for(sync, std::chrono::milliseconds(ms), pred);
+		return !stopped && !db->dropped && db->updateSeq > since;
+	};
+
+	if (feed == "continuous") {
+		{
+			//validates arguments, errors must be reported before the stream starts
+			Sync _(lock);
+			std::size_t s = since;
+			collectChanges(*db, req, s, 0);
+		}
+		Request creq = req;
+		resp.stream = [this, db, creq, since, limit, heartbeat, heartbeatInterval, timeout, waitChange](NetworkConnection &conn) mutable {
+			std::size_t remain = limit;
+			Sync sync(lock);
+			for(;;) {
+				Value rows = collectChanges(*db, creq, since, remain);
+				sync.unlock();
+				for (Value r : rows) {
+					String ln = r.stringify();
+					writeThrottled(conn, json::BinaryView(StrViewA(std::string(ln.c_str(), ln.length()) + "\n")));
+				}
+				remain -= rows.size();
+				if (remain == 0 || conn.hasErrors()) break;
+				sync.lock();
+				if (!waitChange(sync, since, heartbeat?heartbeatInterval:timeout)) {
+					if (stopped || db->dropped || !heartbeat) {
+						sync.unlock();
+						break;
+					}
+					sync.unlock();
+					writeThrottled(conn, json::BinaryView(StrViewA("\n")));
+					if (conn.hasErrors()) return;
+					sync.lock();
+				}
+			}
+			String ln = Value(Object("last_seq",seqValue(since))("pending",0)).stringify();
+			writeThrottled(conn, json::BinaryView(StrViewA(std::string(ln.c_str(), ln.length()) + "\n")));
+		};
+		return;
+	}
+
+	Sync sync(lock);
+	Value rows = collectChanges(*db, req, since, limit);
+	if (feed == "longpoll" && rows.empty() && !req.boolArg("descending")) {
+		if (waitChange(sync, since, timeout)) {
+			rows = collectChanges(*db, req, since, limit);
+		}
+	}
+	resp.set(200, Object("results",rows)("last_seq",seqValue(since))("pending",0));
+}
+
+}
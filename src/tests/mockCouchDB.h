@@ -0,0 +1,163 @@
+/*
+ * mockCouchDB.h
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#ifndef SRC_TESTS_MOCKCOUCHDB_H_
+#define SRC_TESTS_MOCKCOUCHDB_H_
+
+#include <atomic>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../couchit/config.h"
+#include "../couchit/json.h"
+#include "../couchit/queryServerIfc.h"
+#include "../couchit/minihttp/netio.h"
+
+namespace couchit {
+
+///In-process CouchDB stand-in for load and latency testing
+/**
+ * The object starts a HTTP server on the loopback which speaks a subset of the CouchDB's API. It
+ * allows to test and benchmark the client stack (CouchDB, ChangesDistributor, BatchWrite, DocCache)
+ * on single machine without a real database. All data are kept in the memory.
+ *
+ * Supported API:
+ * - PUT, GET, DELETE database
+ * - PUT, GET, DELETE, POST document, including design and local documents
+ * - PUT document as multipart/related (attachments as binary parts)
+ * - inline attachments (base64), PUT, GET and DELETE of standalone attachments
+ * - _all_docs, view queries (views are registered as C++ objects, see regView())
+ * - _bulk_docs (including new_edits=false), _bulk_get
+ * - _changes - normal, longpoll and continuous feed, filters _doc_ids and _design
+ * - gzip compressed responses (chunked), when the client accepts them and zlib is available
+ *
+ * Revision history is not tracked, every document has only the current revision, so there are
+ * no conflicts in the database.
+ *
+ * Behaviour of the server can be changed by setFaults(). It is possible to add latency, limit
+ * bandwidth, and let the server to fail or drop connection. Faults are counted per request, so
+ * the results are deterministic.
+ *
+ * @note available on POSIX platforms only
+ */
+class MockCouchDB {
+public:
+
+	///Injected faults
+	struct Faults {
+		///latency in milliseconds added before each response
+		unsigned int latency = 0;
+		///bandwidth of responses in bytes per second. Zero is unlimited
+		std::size_t bandwidth = 0;
+		///every n-th request is answered by failStatus. Zero disables failures
+		unsigned int failEvery = 0;
+		///status code of failed requests
+		int failStatus = 503;
+		///every n-th request is dropped - the connection is closed without response. Zero disables it
+		unsigned int dropEvery = 0;
+		///views report update_seq with zero sequence number (https://github.com/apache/couchdb/issues/984)
+		bool zeroViewSeq = false;
+	};
+
+	///Starts the server
+	/**
+	 * @param addr_ddot_port address where to listen. Default value listens on the loopback at a random port
+	 */
+	MockCouchDB(const StrViewA &addr_ddot_port = "127.0.0.1:0");
+	///Stops the server, closes all connections
+	~MockCouchDB();
+
+	///Returns url of the server (with trailing slash)
+	std::string getUrl() const;
+
+	///Creates configuration of the client connected to the server
+	/**
+	 * @param databaseName name of the database. It is not created, use createDB() or
+	 * CouchDB::createDatabase()
+	 * @return configuration object
+	 */
+	Config getConfig(const StrViewA &databaseName) const;
+
+	///Creates database directly
+	void createDB(const StrViewA &databaseName);
+
+	///Registers view
+	/**
+	 * @param databaseName name of the database
+	 * @param viewName name of the view in format "ddoc/name". The view is available as
+	 * _design/ddoc/_view/name. The design document doesn't need to exist
+	 * @param impl implementation of the view. Ownership is transfered to the server. Reduce
+	 * modes and reduce functions are supported
+	 */
+	void regView(const StrViewA &databaseName, const StrViewA &viewName, AbstractViewBase *impl);
+
+	///Sets faults
+	void setFaults(const Faults &faults);
+
+	///Returns count of processed requests
+	std::size_t getRequestCount() const {return requestCount;}
+	///Returns count of processed requests which carried the Authorization header
+	std::size_t getAuthorizedRequestCount() const {return authorizedCount;}
+
+
+	class Request;
+	class Response;
+	class Database;
+
+protected:
+
+	typedef std::unique_lock<std::mutex> Sync;
+
+	NetworkListener listener;
+
+	mutable std::mutex lock;
+	///signaled when a database is changed (wakes up longpoll and continuous feeds)
+	std::condition_variable changeSignal;
+	std::map<std::string, std::shared_ptr<Database> > databases;
+	std::map<std::string, std::unique_ptr<AbstractViewBase> > views;
+	Faults faults;
+	std::atomic<std::size_t> requestCount;
+	std::atomic<std::size_t> authorizedCount;
+	std::atomic<bool> stopped;
+
+	std::thread acceptThread;
+	std::vector<std::thread> workers;
+	std::vector<PNetworkConection> connections;
+
+	void acceptLoop();
+	void serve(PNetworkConection conn);
+	bool readRequest(NetworkConnection &conn, Request &req);
+	void sendResponse(NetworkConnection &conn, const Response &resp, bool keepAlive, bool headOnly, bool gzip);
+	void writeThrottled(NetworkConnection &conn, json::BinaryView data);
+
+	void dispatch(Request &req, Response &resp);
+	void handleServer(Request &req, Response &resp);
+	void handleDB(Request &req, Response &resp, const std::string &dbname);
+	void handleDoc(Request &req, Response &resp, Database &db, const std::string &docId);
+	void handleAttachment(Request &req, Response &resp, Database &db, const std::string &docId, const std::string &attName);
+	void handleAllDocs(Request &req, Response &resp, Database &db);
+	void handleView(Request &req, Response &resp, Database &db, const std::string &viewName);
+	void handleBulkDocs(Request &req, Response &resp, Database &db);
+	void handleBulkGet(Request &req, Response &resp, Database &db);
+	void handleChanges(Request &req, Response &resp, const std::shared_ptr<Database> &db);
+
+	std::shared_ptr<Database> findDB(const std::string &dbname);
+	AbstractViewBase *findView(const Database &db, const std::string &viewName);
+	Value storeDoc(Database &db, Value doc, bool newEdits);
+	Value collectChanges(Database &db, const Request &req, std::size_t &since, std::size_t limit);
+};
+
+}
+
+
+
+#endif /* SRC_TESTS_MOCKCOUCHDB_H_ */
@@ -20,6 +20,8 @@ namespace couchit {
 	void testUUIDs(TestSimple &tst) ;
 	void runTestBasics(TestSimple &tst);
 	void runTestLocalview(TestSimple &tst);
+	void runTestMockDB(TestSimple &tst);
+	void runTestCore(TestSimple &tst);
 	void runTestQueryServer(const json::StrViewA &lang, TestSimple &tst);
 	void runQueryServer(const json::StrViewA &lang, const json::StrViewA &chkfile);
 
@@ -58,6 +60,8 @@ int main(int argc, char *argv[]) {
 		cfg << lang << '=' <<srvpath << " qserver" << std::endl;
 
 		couchit::runTestLocalview(tst);
+		couchit::runTestCore(tst);
+		couchit::runTestMockDB(tst);
 		couchit::runMiniHttpTests(tst);
 		couchit::testUUIDs(tst);
 		couchit::runTestBasics(tst);
@@ -0,0 +1,579 @@
+/*
+ * test_core.cpp
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <functional>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <poll.h>
+#include <unistd.h>
+#include "../couchit/changeObserver.h"
+#include "../couchit/checkpointJournal.h"
+#include "../couchit/docmap.h"
+#include "../couchit/jsonWriter.h"
+#include "../couchit/changes.h"
+#include "../couchit/memview.h"
+#include "../couchit/queryServer.h"
+#include "testClass.h"
+
+namespace couchit {
+
+static std::vector<ChangeEvent> makeEvents(std::initializer_list<const char *> ids) {
+	std::vector<ChangeEvent> out;
+	std::size_t seq = 0;
+	for (const char *id: ids) {
+		out.push_back(ChangeEvent(Object("seq",++seq)("id",id)("doc",Object("_id",id)("value",seq))));
+	}
+	return out;
+}
+
+static void observerBatchException(std::ostream &print) {
+	auto events = makeEvents({"a","b","c","d","e"});
+	ChangeObserverFromFn<std::function<bool(const ChangeEvent &)> > obs([&](const ChangeEvent &ev) {
+		if (ev.id == "c") throw std::runtime_error("c");
+		print << ev.id << " ";
+		return true;
+	});
+	try {
+		obs.onEvents(ChangeEventBatch(events.data(), events.size()));
+	} catch (const std::exception &e) {
+		print << "exception:" << e.what() << " ";
+	}
+	print << obs.getLastKnownSeqID().toString();
+}
+
+static void memviewBatchException(std::ostream &print) {
+	MemView view(MemViewDef([](const Value &doc, const EmitFn &emit) {
+		if (doc["_id"].getString() == "c") throw std::runtime_error("c");
+		emit(doc["_id"], doc["value"]);
+	}));
+	auto events = makeEvents({"a","b","c","d","e"});
+	try {
+		view.onEvents(ChangeEventBatch(events.data(), events.size()));
+	} catch (const std::exception &e) {
+		print << "exception:" << e.what() << " ";
+	}
+	for (const char *id: {"a","b","c","d","e"}) {
+		print << id << (view.haveDoc(String(id))?"+":"-") << " ";
+	}
+	print << view.getUpdateSeq().toString();
+}
+
+class QSViewByName: public AbstractViewMapOnly<1> {
+public:
+	virtual void map(const Document &doc, IEmitFn &emit) override {
+		emit(doc["name"], doc["age"]);
+	}
+};
+
+class QSViewTags: public AbstractViewMapOnly<1> {
+public:
+	virtual void map(const Document &doc, IEmitFn &emit) override {
+		for (Value t : doc["tags"]) emit(t);
+	}
+};
+
+class QSViewOdd: public AbstractViewMapOnly<1> {
+public:
+	virtual void map(const Document &doc, IEmitFn &emit) override {
+		if (doc["age"].getUInt() & 1) emit(Value({doc["age"], doc["_id"]}), doc);
+	}
+};
+
+static std::string runQServerSession(const std::string &session, unsigned int threads) {
+	QueryServer qserver("test");
+	qserver.regView("byName", new QSViewByName);
+	qserver.regView("tags", new QSViewTags);
+	qserver.regView("odd", new QSViewOdd);
+	qserver.setMapThreads(threads);
+	std::istringstream in(session);
+	std::ostringstream out;
+	qserver.runDispatch(in, out);
+	return out.str();
+}
+
+static void qserverMapThreads(std::ostream &print) {
+	std::ostringstream session;
+	session << "[\"reset\"]\n[\"add_fun\",\"byName@1\"]\n[\"add_fun\",\"tags@1\"]\n[\"add_fun\",\"odd@1\"]\n";
+	for (unsigned int i = 0; i < 200; i++) {
+		Value doc = Object("_id",String({"doc",Value(i).toString()}))
+				("name",String({"name",Value(i % 17).toString()}))
+				("age",i)
+				("tags",Value(json::array, {Value(i % 3), Value(i % 5)}));
+		session << Value({"map_doc",doc}).stringify() << "\n";
+	}
+	std::string single = runQServerSession(session.str(), 1);
+	std::string parallel = runQServerSession(session.str(), 4);
+	std::size_t lines = std::count(single.begin(), single.end(), '\n');
+	print << lines << "," << (single == parallel);
+}
+
+class QSListKeys: public AbstractList<1> {
+public:
+	virtual void run(IListContext &list, Value) override {
+		list.start(Object("code",200));
+		Value row;
+		while ((row = list.getRow()) != null) {
+			list.send(row["key"].getString());
+			list.send(",");
+		}
+		list.send("end");
+	}
+};
+
+static void writeAllToFd(int fd, const std::string &data) {
+	std::size_t pos = 0;
+	while (pos < data.size()) {
+		ssize_t wr = ::write(fd, data.data()+pos, data.size()-pos);
+		if (wr < 0) {
+			if (errno == EINTR) continue;
+			throw std::runtime_error("write failed");
+		}
+		pos += wr;
+	}
+}
+
+///Reads one line, the response must arrive in time, otherwise the server didn't flush it
+static Value readResponse(int fd, std::string &buff) {
+	for(;;) {
+		std::size_t nl = buff.find('\n');
+		if (nl != buff.npos) {
+			std::string ln = buff.substr(0, nl);
+			buff.erase(0, nl+1);
+			return Value::fromString(ln);
+		}
+		pollfd pfd = {fd, POLLIN, 0};
+		if (::poll(&pfd, 1, 10000) <= 0) throw std::runtime_error("response timeout");
+		char tmp[4096];
+		ssize_t rd = ::read(fd, tmp, sizeof(tmp));
+		if (rd < 0 && errno == EINTR) continue;
+		if (rd <= 0) throw std::runtime_error("unexpected end of output");
+		buff.append(tmp, rd);
+	}
+}
+
+static void qserverFdChannel(std::ostream &print) {
+	int toServer[2], fromServer[2];
+	if (::pipe(toServer) || ::pipe(fromServer)) throw std::runtime_error("pipe failed");
+	QueryServer qserver("test");
+	qserver.regView("byName", new QSViewByName);
+	qserver.regList("keys", new QSListKeys);
+	std::thread thr([&]{
+		qserver.runDispatch(toServer[0], fromServer[1]);
+		::close(fromServer[1]);
+	});
+
+	std::string buff;
+	auto exchange = [&](const Value &req) {
+		std::string line = req.stringify().c_str();
+		line.push_back('\n');
+		writeAllToFd(toServer[1], line);
+		return readResponse(fromServer[0], buff);
+	};
+	auto chunks = [](const Value &resp) {
+		std::string out;
+		for (Value c : resp[1]) out.append(c.getString().data, c.getString().length);
+		return out;
+	};
+
+	try {
+		print << exchange(Value(json::array,{"reset"})).toString() << " ";
+		print << exchange(Value(json::array,{"add_fun","byName@1"})).toString() << " ";
+		//the request doesn't fit to the single block of the input buffer
+		std::string name(100000,'n');
+		Value doc = Object("_id","big")("name",StrViewA(name))("age",5);
+		Value r = exchange(Value(json::array,{"map_doc",doc}));
+		print << r[0][0][0].getString().length << " ";
+		Value ddoc = Object("lists",Object("keys","keys@1"));
+		print << exchange(Value(json::array,{"ddoc","new","_design/test",ddoc})).toString() << " ";
+		//the list function waits for rows, every response must be flushed before it
+		Value args(json::array,{Object("total_rows",2),Object()});
+		r = exchange(Value(json::array,{"ddoc","_design/test",Value(json::array,{"lists","keys"}),args}));
+		print << r[0].getString() << " ";
+		for (const char *k: {"a","b"}) {
+			r = exchange(Value(json::array,{"list_row",Object("key",k)}));
+			print << r[0].getString() << ":" << chunks(r) << " ";
+		}
+		r = exchange(Value(json::array,{"list_end"}));
+		print << r[0].getString() << ":" << chunks(r);
+	} catch (const std::exception &e) {
+		print << "exception:" << e.what();
+	}
+	//end of input finishes the dispatcher
+	::close(toServer[1]);
+	thr.join();
+	::close(toServer[0]);
+	::close(fromServer[0]);
+}
+
+static void checkpointJournal(std::ostream &print) {
+	std::string fname = "/tmp/couchit_test_journal";
+	std::remove(fname.c_str());
+	{
+		CheckpointJournal::Policy p;
+		p.records = 2;
+		PCheckpointJournal j = new CheckpointJournal(fname, p);
+		PCheckpoint chk = journalCheckpoint(j, "view");
+		j->store("db1", 10);
+		j->store("db2", 20);
+		j->store("db1", 30);
+		chk->store(Object("updateSeq",5));
+	}
+	PCheckpointJournal j = new CheckpointJournal(fname);
+	print << j->load("db1").toString() << "," << j->load("db2").toString() << ","
+		  << journalCheckpoint(j, "view")->load()["updateSeq"].toString();
+	j = nullptr;
+	std::remove(fname.c_str());
+}
+
+static std::string readJournalFile(const std::string &fname) {
+	std::ifstream in(fname, std::ios::binary);
+	std::ostringstream data;
+	data << in.rdbuf();
+	return data.str();
+}
+
+static std::size_t countJournalLines(const std::string &fname) {
+	std::string data = readJournalFile(fname);
+	return std::count(data.begin(), data.end(), '\n');
+}
+
+static std::size_t waitJournalLines(const std::string &fname, std::size_t count) {
+	std::size_t lines = countJournalLines(fname);
+	for (int i = 0; i < 200 && lines < count; i++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+		lines = countJournalLines(fname);
+	}
+	return lines;
+}
+
+static void checkpointJournalTorn(std::ostream &print) {
+	std::string fname = "/tmp/couchit_test_journal_torn";
+	std::remove(fname.c_str());
+	{
+		PCheckpointJournal j = new CheckpointJournal(fname);
+		j->store("a", 10);
+		j->store("b", 20);
+	}
+	{
+		//damaged record and torn write of the last line
+		std::ofstream out(fname, std::ios::app|std::ios::binary);
+		out << "{\"k\":\"b\",\"v\":3x\n{\"k\":\"a\",\"v\":4";
+	}
+	{
+		PCheckpointJournal j = new CheckpointJournal(fname);
+		print << j->load("a").toString() << "," << j->load("b").toString() << ",";
+		j->store("c", 30);
+	}
+	PCheckpointJournal j = new CheckpointJournal(fname);
+	print << j->load("a").toString() << "," << j->load("c").toString() << "," << countJournalLines(fname);
+	j = nullptr;
+	std::remove(fname.c_str());
+}
+
+static void checkpointJournalPolicy(std::ostream &print) {
+	std::string fname = "/tmp/couchit_test_journal_policy";
+	std::remove(fname.c_str());
+	{
+		//sync after 3 records
+		CheckpointJournal::Policy p;
+		p.records = 3;
+		p.interval = std::chrono::milliseconds(0);
+		PCheckpointJournal j = new CheckpointJournal(fname, p);
+		j->store("a", 1);
+		j->store("b", 2);
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		print << countJournalLines(fname) << ",";
+		j->store("c", 3);
+		print << waitJournalLines(fname, 3) << " ";
+	}
+	std::remove(fname.c_str());
+	{
+		//sync after the interval
+		CheckpointJournal::Policy p;
+		p.interval = std::chrono::milliseconds(20);
+		PCheckpointJournal j = new CheckpointJournal(fname, p);
+		j->store("a", 1);
+		print << waitJournalLines(fname, 1) << " ";
+	}
+	std::remove(fname.c_str());
+	{
+		//sync by commit only
+		CheckpointJournal::Policy p;
+		p.interval = std::chrono::milliseconds(0);
+		PCheckpointJournal j = new CheckpointJournal(fname, p);
+		j->store("a", 1);
+		j->store("b", 2);
+		std::this_thread::sleep_for(std::chrono::milliseconds(50));
+		print << countJournalLines(fname) << ",";
+		j->commit();
+		print << countJournalLines(fname);
+	}
+	std::remove(fname.c_str());
+}
+
+static void checkpointJournalCompact(std::ostream &print) {
+	std::string fname = "/tmp/couchit_test_journal_compact";
+	std::remove(fname.c_str());
+	CheckpointJournal::Policy p;
+	p.interval = std::chrono::milliseconds(0);
+	p.compactSize = 300;
+	std::size_t maxSize = 0;
+	{
+		PCheckpointJournal j = new CheckpointJournal(fname, p);
+		j->store("other", "x");
+		for (unsigned int i = 0; i < 100; i++) {
+			j->store("seq", i);
+			j->commit();
+			maxSize = std::max(maxSize, readJournalFile(fname).size());
+		}
+	}
+	PCheckpointJournal j = new CheckpointJournal(fname);
+	print << (maxSize <= p.compactSize) << "," << countJournalLines(fname) << ","
+		  << j->load("seq").toString() << "," << j->load("other").toString();
+	j = nullptr;
+	std::remove(fname.c_str());
+}
+
+static Value docMapDoc(unsigned int i, unsigned int rev = 1) {
+	return Object("_id",String({"doc",Value(i).toString()}))
+			("_rev",String({Value(rev).toString(),"-x"}))
+			("value",i*rev);
+}
+
+static void docMapCapacity(std::ostream &print) {
+	std::size_t calls = 0;
+	DocMap<unsigned int>::Config cfg;
+	cfg.capacity = 32;
+	cfg.shards = 4;
+	DocMap<unsigned int> map([&](Value doc) {
+		calls++;
+		return static_cast<unsigned int>(doc["value"].getUInt());
+	}, cfg);
+	bool valid = true;
+	for (unsigned int i = 0; i < 1000; i++) {
+		if (map(docMapDoc(i))->data != i) valid = false;
+	}
+	std::size_t sz = map.size();
+	//cached item is returned without calling the map function
+	unsigned int last = 999;
+	std::size_t before = calls;
+	bool cached = map.find(String({"doc",Value(last).toString()})) != nullptr;
+	map(docMapDoc(last));
+	print << valid << "," << (sz <= 32) << "," << (sz > 0) << "," << cached << "," << (calls - before)
+		  << "," << calls;
+}
+
+static void docMapTTL(std::ostream &print) {
+	std::size_t calls = 0;
+	DocMap<unsigned int>::Config cfg;
+	cfg.sweepInterval = std::chrono::milliseconds(20);
+	DocMap<unsigned int> map([&](Value doc) {
+		calls++;
+		return static_cast<unsigned int>(doc["value"].getUInt());
+	}, cfg);
+	map(docMapDoc(1), 0);
+	map(docMapDoc(2), 3600);
+	map(docMapDoc(3));
+	//ttl 0 doesn't use the cached item
+	map(docMapDoc(1), 0);
+	map(docMapDoc(2), 3600);
+	print << calls << ",";
+	//the sweeper removes the expired item only
+	for (int i = 0; i < 100 && map.find("doc1") != nullptr; i++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	print << (map.find("doc1") == nullptr) << "," << (map.find("doc2") != nullptr) << ","
+		  << (map.find("doc3") != nullptr) << "," << map.size() << ",";
+	//new revision is transformed again
+	print << map(docMapDoc(3, 2))->data << "," << calls;
+}
+
+///Map function which blocks until it is released
+class DocMapGate {
+public:
+	std::atomic<unsigned int> calls{0};
+	std::atomic<bool> entered{false};
+	std::atomic<bool> released{false};
+
+	void pass() {
+		calls++;
+		entered = true;
+		while (!released) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	void waitEntered() {
+		while (!entered) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+};
+
+static void docMapWaiters(std::ostream &print) {
+	DocMapGate gate;
+	DocMap<unsigned int> map([&](Value doc) {
+		gate.pass();
+		return static_cast<unsigned int>(doc["value"].getUInt());
+	});
+	std::vector<DocMap<unsigned int>::Ref> results(8);
+	std::vector<std::thread> thrs;
+	thrs.emplace_back([&]{results[0] = map(docMapDoc(5));});
+	gate.waitEntered();
+	for (unsigned int i = 1; i < 8; i++) thrs.emplace_back([&,i]{results[i] = map(docMapDoc(5));});
+	//let the other threads to reach the waiting
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	gate.released = true;
+	for (auto &&t: thrs) t.join();
+	bool same = true;
+	for (auto &&r: results) if (r != results[0]) same = false;
+	print << gate.calls << "," << same << "," << results[0]->data << "," << (map.find("doc5") == results[0]);
+}
+
+static void docMapWaitersException(std::ostream &print) {
+	DocMapGate gate;
+	DocMap<unsigned int> map([&](Value) -> unsigned int {
+		gate.pass();
+		throw std::runtime_error("failed");
+	});
+	std::atomic<unsigned int> exceptions{0};
+	auto run = [&] {
+		try {
+			map(docMapDoc(5));
+		} catch (const std::runtime_error &) {
+			exceptions++;
+		}
+	};
+	std::vector<std::thread> thrs;
+	thrs.emplace_back(run);
+	gate.waitEntered();
+	for (unsigned int i = 1; i < 8; i++) thrs.emplace_back(run);
+	std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	gate.released = true;
+	for (auto &&t: thrs) t.join();
+	print << gate.calls << "," << exceptions << "," << (map.find("doc5") == nullptr);
+}
+
+static void docMapInvalidateInFlight(std::ostream &print) {
+	DocMapGate gate;
+	DocMap<unsigned int> map([&](Value doc) {
+		gate.pass();
+		return static_cast<unsigned int>(doc["value"].getUInt());
+	});
+	DocMap<unsigned int>::Ref res;
+	std::thread thr([&]{res = map(docMapDoc(5));});
+	gate.waitEntered();
+	//the document changed while it is being transformed
+	map.invalidate("doc5");
+	gate.released = true;
+	thr.join();
+	//the caller receives the result, but it is not cached
+	print << res->data << "," << (map.find("doc5") == nullptr) << ",";
+	map(docMapDoc(5));
+	print << gate.calls << "," << (map.find("doc5") != nullptr);
+}
+
+static void docMapRecursive(std::ostream &print) {
+	std::atomic<unsigned int> calls{0};
+	DocMap<unsigned int> *self = nullptr;
+	DocMap<unsigned int> map([&](Value doc) -> unsigned int {
+		unsigned int c = ++calls;
+		//the map function asks for the same document being transformed
+		if (c == 1) return (*self)(doc)->data + 1;
+		return static_cast<unsigned int>(doc["value"].getUInt());
+	});
+	self = &map;
+	unsigned int r = map(docMapDoc(5))->data;
+	unsigned int again = map(docMapDoc(5))->data;
+	print << r << "," << again << "," << calls;
+}
+
+///Collects output of the JsonBlockWriter through a buffer of the given size
+class TestJsonWriter: public JsonBlockWriter {
+public:
+	TestJsonWriter(std::size_t bufSize):buffer(bufSize) {}
+
+	std::string finish() {
+		flushBuffer();
+		return out;
+	}
+
+protected:
+	std::vector<unsigned char> buffer;
+	std::string out;
+
+	virtual void nextBuffer(std::size_t reqSize) override {
+		flushBuffer();
+		if (buffer.size() < reqSize) buffer.resize(reqSize);
+		wrpos = buffer.data();
+		wrend = buffer.data()+buffer.size();
+	}
+	void flushBuffer() {
+		if (wrpos) out.append(reinterpret_cast<const char *>(buffer.data()), wrpos - buffer.data());
+		wrpos = wrend = nullptr;
+	}
+};
+
+static void jsonWriterStringify(std::ostream &print) {
+	std::string ctrl;
+	for (int i = 0; i < 0x20; i++) ctrl.push_back(static_cast<char>(i));
+	//escaped characters at the borders of 16-byte blocks
+	std::string blocks;
+	for (int i = 0; i < 70; i++) blocks.push_back((i % 16 == 15 || i % 16 == 0)?"\"\\\n"[i % 3]:static_cast<char>('a' + i % 26));
+	std::string longStr(100, 'x');
+	std::vector<Value> values = {
+		Value(StrViewA(ctrl)),
+		"quote\" backslash\\ slash/ \"\"\\\\",
+		"\xC5\xBElu\xC5\xA5ou\xC4\x8Dk\xC3\xBD k\xC5\xAF\xC5\x88 \xF0\x9F\x98\x80",
+		Value(StrViewA(blocks)),
+		Value(StrViewA(longStr)),
+		0, 42, -1, -123456789012LL, 4294967295U, 9007199254740993LL,
+		1.5, -0.25, 0.1, 1e300, -2.5e-300, 3.141592653589793,
+		true, false, nullptr,
+		Value(json::array, {1, -2, "x", Value(json::array, {2}), Object()}),
+		Object("key\"\n",1)("\xC5\xBE",Value(json::array,{-1.5,"\t"}))("",Object("a",nullptr)),
+	};
+	std::size_t mismatches = 0;
+	for (std::size_t bufSize: {1, 2, 3, 7, 15, 16, 17, 31, 64, 4096}) {
+		for (const Value &v: values) {
+			TestJsonWriter wr(bufSize);
+			wr.write(v);
+			std::string res = wr.finish();
+			String expected = v.stringify();
+			if (res != std::string(expected.c_str(), expected.length())) {
+				if (mismatches == 0) print << res << " != " << expected.c_str() << " ";
+				mismatches++;
+			}
+		}
+	}
+	print << values.size() << "," << mismatches;
+}
+
+void runTestCore(TestSimple &tst) {
+
+tst.test("observer.batchException","a b d e exception:c 5") >> &observerBatchException;
+tst.test("memview.batchException","exception:c a+ b+ c- d+ e+ 5") >> &memviewBatchException;
+tst.test("qserver.mapThreads","204,1") >> &qserverMapThreads;
+tst.test("qserver.fdChannel","true true 100000 true start chunks:a, chunks:b, end:end") >> &qserverFdChannel;
+tst.test("docmap.capacity","1,1,1,1,0,1000") >> &docMapCapacity;
+tst.test("docmap.ttl","4,1,1,1,2,6,5") >> &docMapTTL;
+tst.test("docmap.waiters","1,1,5,1") >> &docMapWaiters;
+tst.test("docmap.waitersException","1,8,1") >> &docMapWaitersException;
+tst.test("docmap.invalidateInFlight","5,1,2,1") >> &docMapInvalidateInFlight;
+tst.test("docmap.recursive","6,6,2") >> &docMapRecursive;
+tst.test("jsonWriter.stringify","22,0") >> &jsonWriterStringify;
+tst.test("checkpoint.journal","30,20,5") >> &checkpointJournal;
+tst.test("checkpoint.journalTorn","10,20,10,30,3") >> &checkpointJournalTorn;
+tst.test("checkpoint.journalPolicy","0,3 1 0,2") >> &checkpointJournalPolicy;
+tst.test("checkpoint.journalCompact","1,2,99,x") >> &checkpointJournalCompact;
+
+}
+
+}
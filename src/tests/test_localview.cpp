@@ -8,6 +8,7 @@
 #include "../couchit/document.h"
 #include "../couchit/localView.h"
 #include "../couchit/defaultUIDGen.h"
+#include "../couchit/queryServerIfc.h"
 
 #include "test_common.h"
 #include "testClass.h"
@@ -173,6 +174,28 @@ static void localView_couchReduceAll(std::ostream &a) {
 	}
 }
 
+class View_age_group_height_stats: public AbstractViewBuildin<1, AbstractViewBase::rmStats> {
+public:
+	virtual void map(const Document &doc, IEmitFn &emit) override {
+		emit({doc["age"].getUInt()/10 * 10 ,doc["age"]},doc["height"]);
+	}
+};
+
+static void localView_nativeStats(std::ostream &a) {
+
+	LocalView view(new View_age_group_height_stats, 0);
+	loadData(view);
+
+	Query q = view.createQuery(0);
+	Result res = q.groupLevel(1).exec();
+
+	while (res.hasItems()) {
+		Row row = res.getNext();
+		a << row.key[0].getUInt() << ":"
+				<<(row.value["sum"].getUInt()/row.value["count"].getUInt()) << " ";
+	}
+}
+
 
 void runTestLocalview(TestSimple &tst) {
 
@@ -182,6 +205,7 @@ void runTestLocalview(TestSimple &tst) {
 	tst.test("couchdb.localview.findrange","Daniel Cochran Ramona Lang Urielle Pennington ")>>&localView_FindRange;
 	tst.test("couchdb.localview.reduce","20:178 30:170 40:171 50:165 70:167 80:151 ")>>&localView_couchReduce;
 	tst.test("couchdb.localview.reduceAll","0:169 ")>>&localView_couchReduceAll;
+	tst.test("couchdb.localview.nativeStats","20:178 30:170 40:171 50:165 70:167 80:151 ")>>&localView_nativeStats;
 
 
 }
@@ -7,6 +7,7 @@
 #include "testClass.h"
 #include "../couchit/minihttp/stringstreams.h"
 #include "../couchit/minihttp/chunkstream.h"
+#include "../couchit/minihttp/compression.h"
 
 
 namespace couchit {
@@ -157,6 +158,89 @@ tst.test("couchdb.minihttp.readChunked2", "Wikipedia in\r\n\r\nchunks.") >> [](s
 
 };
 
+tst.test("couchdb.minihttp.readChunkedExt", "Wikipedia|rest") >> [](std::ostream &print){
+
+	StrViewA data = "4;name=value\r\nWiki\r\n5\r\npedia\r\n0\r\n\r\nrest";
+	StringInputStream *src = new StringInputStream(BinaryView(data));
+	InputStream raw(src);
+	std::string res;
+	{
+		InputStream stream(new ChunkedInputStream(raw));
+		BinaryView b = stream.read();
+		while (!b.empty()) {
+			res.append(reinterpret_cast<const char *>(b.data), b.length);
+			b = stream.read();
+		}
+	}
+	BinaryView rest = raw.read();
+	print << res << "|" << std::string(reinterpret_cast<const char *>(rest.data), rest.length).substr(2);
+
+};
+
+if (isCompressionSupported()) tst.test("couchdb.minihttp.compression", "ok") >> [](std::ostream &print){
+
+	std::string source;
+	for (int i = 0; i < 2000; i++) source.append("{\"key\":\"value\",\"id\":42},");
+	std::string compressed;
+
+	auto outfn = [&](BinaryView data) {
+		compressed.append(reinterpret_cast<const char *>(data.data),data.length);
+	};
+	{
+		OutputStream out (new DeflateOutputStream(new ConsumentOutputStream<decltype(outfn)>(outfn)));
+		out(BinaryView(StrViewA(source)));
+		out(nullptr);
+	}
+	std::string res;
+	{
+		InputStream stream(new InflateInputStream(new StringInputStream(BinaryView(StrViewA(compressed)))));
+		BinaryView b = stream.read();
+		while (!b.empty()) {
+			res.append(reinterpret_cast<const char *>(b.data), b.length);
+			b = stream.read();
+		}
+	}
+	print << (res == source && compressed.length() < source.length()/10?"ok":"failed");
+
+};
+
+if (isCompressionSupported()) tst.test("couchdb.minihttp.compressionEnd", "exception exception ok") >> [](std::ostream &print){
+
+	std::string source;
+	for (int i = 0; i < 200; i++) source.append("{\"key\":\"value\",\"id\":42},");
+	std::string compressed;
+
+	auto outfn = [&](BinaryView data) {
+		compressed.append(reinterpret_cast<const char *>(data.data),data.length);
+	};
+	{
+		OutputStream out (new DeflateOutputStream(new ConsumentOutputStream<decltype(outfn)>(outfn)));
+		out(BinaryView(StrViewA(source)));
+		out(nullptr);
+	}
+	auto decompress = [](const std::string &data) {
+		InputStream stream(new InflateInputStream(new StringInputStream(BinaryView(StrViewA(data)))));
+		std::string res;
+		BinaryView b = stream.read();
+		while (!b.empty()) {
+			res.append(reinterpret_cast<const char *>(b.data), b.length);
+			b = stream.read();
+		}
+		return res;
+	};
+	//truncated stream, then data after the end of the stream
+	for (std::string data: {compressed.substr(0, compressed.length()-10), compressed + "garbage"}) {
+		try {
+			decompress(data);
+			print << "accepted ";
+		} catch (const std::exception &) {
+			print << "exception ";
+		}
+	}
+	print << (decompress(compressed) == source?"ok":"failed");
+
+};
+
 tst.test("couchdb.minihttp.writeChunked",
 		"14\r\nThis is long string \r\n14\r\nwritten in chunks...\r\n2\r\n..\r\n0\r\n\r\n") >> [](std::ostream &print){
 
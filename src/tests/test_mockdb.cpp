@@ -0,0 +1,608 @@
+/*
+ * test_mockdb.cpp
+ *
+ *  Created on: 19. 10. 2026
+ *      Author: ondra
+ */
+#include <atomic>
+#include <cstdio>
+#include <fcntl.h>
+#include <unistd.h>
+#include <stdexcept>
+#include <thread>
+#include <chrono>
+#include <map>
+#include "../couchit/changes.h"
+#include "../couchit/couchDB.h"
+#include "../couchit/docmap.h"
+#include "../couchit/document.h"
+#include "../couchit/exception.h"
+#include "../couchit/lazyResult.h"
+#include "../couchit/minihttp/compression.h"
+#include "../couchit/minihttp/httpclient.h"
+#include "../couchit/query.h"
+#include "../couchit/queryCache.h"
+#include "../couchit/queryServerIfc.h"
+#include "../couchit/requestObserver.h"
+#include "../couchit/validator.h"
+#include "mockCouchDB.h"
+#include "testClass.h"
+
+namespace couchit {
+
+class MockTestView: public AbstractViewBuildin<1, AbstractViewBase::rmSum> {
+public:
+	virtual void map(const Document &doc, IEmitFn &emit) override {
+		emit(doc["group"],doc["value"]);
+	}
+};
+
+static void mockBulkAndQuery(std::ostream &print) {
+	MockCouchDB server;
+	CouchDB db(server.getConfig("mocktest"));
+	db.createDatabase();
+	db.bulkUpload(Value::fromString(
+			"[{\"_id\":\"a\",\"group\":1,\"value\":10},"
+			"{\"_id\":\"b\",\"group\":2,\"value\":20},"
+			"{\"_id\":\"c\",\"group\":1,\"value\":30}]"));
+	Result res = db.allDocs(View::includeDocs).range("a","b").exec();
+	for (Row rw : res) {
+		print << rw.id.getString() << "," << rw.doc["value"].getUInt() << " ";
+	}
+}
+
+static void mockLazyResult(std::ostream &print) {
+	MockCouchDB server;
+	server.createDB("mocktest");
+	CouchDB db(server.getConfig("mocktest"));
+	db.bulkUpload(Value::fromString(
+			"[{\"_id\":\"a\",\"value\":10,\"text\":\"x,}]\\\"\"},"
+			"{\"_id\":\"b\",\"value\":20,\"nested\":{\"a\":[1,{}]}}]"));
+	LazyResult res = db.allDocs(View::includeDocs).lazy().exec();
+	while (res.hasItems()) {
+		LazyRow rw = res.getNext();
+		print << rw.id.getString() << "," << rw.getDocField("value").getUInt() << ","
+				<< rw.getDoc()["_id"].getString() << " ";
+	}
+}
+
+static void mockLazyEscapedField(std::ostream &print) {
+	MockCouchDB server;
+	server.createDB("mocktest");
+	CouchDB db(server.getConfig("mocktest"));
+	db.bulkUpload(Value::fromString(
+			"[{\"_id\":\"a\",\"a\\\"b\":1,\"a\\\\\":2,\"\\u0161\":3}]"));
+	LazyResult res = db.allDocs(View::includeDocs).lazy().exec();
+	LazyRow rw = res.getNext();
+	print << rw.getDocField("a\"b").getUInt() << ","
+		  << rw.getDocField("a\\").getUInt() << ","
+		  << rw.getDocField("\xC5\xA1").getUInt() << ","
+		  << rw.getDocField("a").defined();
+}
+
+static void mockLazyAsResult(std::ostream &print) {
+	MockCouchDB server;
+	server.createDB("mocktest");
+	CouchDB db(server.getConfig("mocktest"));
+	db.bulkUpload(Value::fromString("[{\"_id\":\"a\",\"value\":10}]"));
+	try {
+		Result res = db.allDocs(View::includeDocs).lazy().exec();
+		print << res.size();
+	} catch (const std::runtime_error &) {
+		print << "exception";
+	}
+}
+
+static void mockLazyUpdateSeq(std::ostream &print) {
+	MockCouchDB server;
+	server.createDB("mocktest");
+	CouchDB db(server.getConfig("mocktest"));
+	db.bulkUpload(Value::fromString("[{\"_id\":\"a\"},{\"_id\":\"b\"}]"));
+	//the server reports zero sequence, which is replaced by the last sequence of the database
+	MockCouchDB::Faults f;
+	f.zeroViewSeq = true;
+	server.setFaults(f);
+	LazyResult res = db.allDocs(View::includeDocs).lazy().exec();
+	server.setFaults(MockCouchDB::Faults());
+	Value seq = res.getUpdateSeq();
+	print << res.size() << ","
+		  << (SeqNumber(seq).getRevId() != 0) << ","
+		  << (seq == db.getLastSeqNumber().toValue()) << ","
+		  << (db.getLastKnownSeqNumber().toValue() == seq);
+}
+
+static void mockViewReduce(std::ostream &print) {
+	MockCouchDB server;
+	server.createDB("mocktest");
+	server.regView("mocktest","test/sum",new MockTestView);
+	CouchDB db(server.getConfig("mocktest"));
+	db.bulkUpload(Value::fromString(
+			"[{\"group\":1,\"value\":10},{\"group\":2,\"value\":20},{\"group\":1,\"value\":30}]"));
+	View v("_design/test/_view/sum", View::groupLevel*1);
+	Result res = db.createQuery(v).exec();
+	for (Row rw : res) {
+		print << rw.key.toString() << ":" << rw.value.toString() << " ";
+	}
+}
+
+static void mockLongPoll(std::ostream &print) {
+	MockCouchDB server;
+	server.createDB("mocktest");
+	CouchDB db(server.getConfig("mocktest"));
+	ChangesFeed chsink (db.createChangesFeed());
+	chsink.exec();
+	chsink.setTimeout(10000);
+	std::thread thr([&]{
+		std::this_thread::sleep_for(std::chrono::milliseconds(200));
+		db.put(Object("_id","late"));
+	});
+	Changes chngs = chsink.exec();
+	while (chngs.hasItems()) {
+		ChangeEvent ev(chngs.getNext());
+		print << ev.id;
+	}
+	thr.join();
+}
+
+static void mockFaults(std::ostream &print) {
+	MockCouchDB server;
+	server.createDB("mocktest");
+	MockCouchDB::Faults f;
+	f.failEvery = 1;
+	server.setFaults(f);
+	CouchDB db(server.getConfig("mocktest"));
+	try {
+		db.get("anything");
+	} catch (const RequestError &e) {
+		print << e.getCode();
+	}
+}
+
+static void mockRequestStats(std::ostream &print) {
+	MockCouchDB server;
+	server.createDB("mocktest");
+	QueryCache cache;
+	RequestStats stats;
+	Config cfg = server.getConfig("mocktest");
+	cfg.cache = &cache;
+	cfg.requestObserver = &stats;
+	CouchDB db(cfg);
+	db.put(Object("_id","doc1"));
+	db.get("doc1");
+	db.get("doc1");
+	//attachment round trip and the changes feed are reported as well
+	std::string data(10000,'x');
+	db.putAttachment(Object("_id","att"), "data", AttachmentDataRef(json::BinaryView(StrViewA(data)), "text/plain"));
+	std::vector<unsigned char> loaded = db.getAttachment("att","data").load();
+	db.createChangesFeed().exec();
+	Value r = stats.dump();
+	Value g = r["GET /{db}/{docid}"];
+	Value ap = r["PUT /{db}/{docid}/{param}"];
+	Value ag = r["GET /{db}/{docid}/{param}"];
+	print << r["PUT /{db}/{docid}"]["count"].getUInt() << ","
+		  << g["count"].getUInt() << ","
+		  << g["fromCache"].getUInt() << ","
+		  << (g["bytesReceived"].getUInt() > 0) << ","
+		  << ap["count"].getUInt() << ","
+		  << (ap["bytesSent"].getUInt() > data.size()) << ","
+		  << ag["count"].getUInt() << ","
+		  << (ag["bytesReceived"].getUInt() > 0 && loaded.size() == data.size()) << ","
+		  << r["GET /{db}/_changes"]["count"].getUInt();
+}
+
+static void mockPipeline(std::ostream &print) {
+	MockCouchDB server;
+	server.createDB("mocktest");
+	CouchDB db(server.getConfig("mocktest"));
+	db.bulkUpload(Value::fromString(
+			"[{\"_id\":\"a\"},{\"_id\":\"b\"},{\"_id\":\"c\"},{\"_id\":\"d\"},{\"_id\":\"e\"}]"));
+	//the server drops the connection in the middle of the pipeline
+	MockCouchDB::Faults f;
+	f.dropEvery = 4;
+	server.setFaults(f);
+	std::vector<json::String> urls;
+	for (const char *id: {"a","b","c","d","e"}) {
+		urls.push_back(json::String({server.getUrl(),"mocktest/",id}));
+	}
+	HttpClient http;
+	auto res = http.pipelineGET(urls);
+	for (auto &&r: res) {
+		print << r.status << ":" << Value::fromString(r.body)["_id"].getString() << " ";
+	}
+}
+
+static void mockPipelineAuth(std::ostream &print) {
+	MockCouchDB server;
+	server.createDB("mocktest");
+	CouchDB db(server.getConfig("mocktest"));
+	db.bulkUpload(Value::fromString("[{\"_id\":\"a\"},{\"_id\":\"b\"},{\"_id\":\"c\"},{\"_id\":\"d\"}]"));
+	std::string url = server.getUrl();
+	std::string authUrl = "http://user:secret@" + url.substr(7);
+	//credentials must stay with own request, the lookahead must not mix them
+	std::vector<json::String> urls;
+	urls.push_back(json::String({authUrl,"mocktest/a"}));
+	urls.push_back(json::String({url,"mocktest/b"}));
+	urls.push_back(json::String({authUrl,"mocktest/c"}));
+	urls.push_back(json::String({url,"mocktest/d"}));
+	std::size_t cnt = server.getAuthorizedRequestCount();
+	HttpClient http;
+	auto res = http.pipelineGET(urls);
+	for (auto &&r: res) {
+		print << r.status << ":" << Value::fromString(r.body)["_id"].getString() << " ";
+	}
+	print << server.getAuthorizedRequestCount() - cnt;
+}
+
+static std::string readBody(HttpClient &http) {
+	std::string res;
+	InputStream in = http.getResponse();
+	BinaryView b = in.read();
+	while (!b.empty()) {
+		res.append(reinterpret_cast<const char *>(b.data), b.length);
+		b = in.read();
+	}
+	return res;
+}
+
+static void mockGzipKeepAlive(std::ostream &print) {
+	MockCouchDB server;
+	server.createDB("mocktest");
+	Config cfg = server.getConfig("mocktest");
+	cfg.compressResponses = true;
+	CouchDB db(cfg);
+	std::string text(20000, 'x');
+	db.bulkUpload(Value(json::array, {
+		Value(Object("_id","a")("text",StrViewA(text))),
+		Value(Object("_id","b")("value",1))}));
+	//two compressed responses through single keep-alive connection
+	HttpClient http;
+	http.setCompression(true);
+	for (const char *id: {"a","b","a"}) {
+		http.open(String({server.getUrl(),"mocktest/",id}), "GET", true);
+		int status = http.send();
+		Value hdrs = http.getHeaders();
+		Value doc = Value::fromString(readBody(http));
+		print << status << ":" << hdrs["Content-Encoding"].getString() << ":"
+			  << doc["_id"].getString() << ":" << doc["text"].getString().length << " ";
+	}
+	//the same through the CouchDB client
+	print << db.get("a")["text"].getString().length << "," << db.get("b")["value"].getUInt();
+}
+
+static void mockAttachmentFd(std::ostream &print) {
+	MockCouchDB server;
+	server.createDB("mocktest");
+	CouchDB db(server.getConfig("mocktest"));
+
+	std::string src(300000,' ');
+	for (std::size_t i = 0; i < src.size(); i++) src[i] = static_cast<char>(i * 7 + i / 251);
+	std::string srcName = "/tmp/couchit_test_att_src";
+	std::string dstName = "/tmp/couchit_test_att_dst";
+	int fd = ::open(srcName.c_str(), O_RDWR|O_CREAT|O_TRUNC, 0666);
+	NetworkConnection::writeToFd(fd, json::BinaryView(StrViewA(src)));
+
+	//upload part of the file, the content is sent by sendfile()
+	String rev = db.putAttachment(Object("_id","att"), "data", "application/octet-stream", fd, 1000, 200000);
+	::close(fd);
+
+	int ofd = ::open(dstName.c_str(), O_RDWR|O_CREAT|O_TRUNC, 0666);
+	std::size_t sz = db.getAttachment("att","data").readTo(ofd);
+	std::string dst(sz, 0);
+	print << sz << "," << (::pread(ofd, &dst[0], sz, 0) == (ssize_t)sz && dst == src.substr(1000, 200000));
+	::close(ofd);
+
+	//the connection is reused after the download
+	print << "," << db.get("att")["_rev"].getString().substr(0,2);
+	print << "," << (rev.substr(0,2) == "1-");
+	std::remove(srcName.c_str());
+	std::remove(dstName.c_str());
+}
+
+static void mockAttachmentFdShort(std::ostream &print) {
+	MockCouchDB server;
+	server.createDB("mocktest");
+	CouchDB db(server.getConfig("mocktest"));
+	std::string srcName = "/tmp/couchit_test_att_short";
+	int fd = ::open(srcName.c_str(), O_RDWR|O_CREAT|O_TRUNC, 0666);
+	NetworkConnection::writeToFd(fd, json::BinaryView(StrViewA(std::string(1000,'x'))));
+	//the file is shorter than the declared length, the request must fail without waiting
+	auto start = std::chrono::steady_clock::now();
+	try {
+		db.putAttachment(Object("_id","att"), "data", "application/octet-stream", fd, 0, 5000);
+		print << "stored";
+	} catch (const RequestError &e) {
+		print << (e.getCode() < 0?"error":"status");
+	}
+	auto elapsed = std::chrono::steady_clock::now() - start;
+	::close(fd);
+	std::remove(srcName.c_str());
+	print << "," << (elapsed < std::chrono::seconds(5));
+	//nothing is stored and the client still works
+	print << "," << db.get("att", CouchDB::flgNullIfMissing).isNull();
+}
+
+static Value binaryAtt(StrViewA text) {
+	return Object("content_type","text/plain")("data",Value(json::BinaryView(text), json::base64));
+}
+
+static std::string loadAtt(CouchDB &db, StrViewA id, StrViewA name) {
+	std::vector<unsigned char> data = db.getAttachment(id, name).load();
+	return std::string(data.begin(), data.end());
+}
+
+static void mockMultipart(std::ostream &print) {
+	MockCouchDB server;
+	server.createDB("mocktest");
+	for (bool multipart: {false, true}) {
+		Config cfg = server.getConfig("mocktest");
+		cfg.multipartBulkAttachments = multipart;
+		CouchDB db(cfg);
+		String prefix(multipart?"m":"b");
+		Value docs(json::array, {
+			Value(Object("_id",String({prefix,"1"}))
+				("_attachments",Object("a.txt",binaryAtt("first"))("b.txt",binaryAtt("\r\n--x\r\n")))),
+			Value(Object("_id",String({prefix,"2"}))("value",1)),
+			Value(Object("_attachments",Object("a.txt",binaryAtt(prefix))))
+		});
+		std::size_t cnt = server.getRequestCount();
+		Value res = db.bulkUpload(docs);
+		//_bulk_docs only, or _bulk_docs and two multipart PUTs
+		print << server.getRequestCount() - cnt << ":";
+		for (Value r : res) print << (r["ok"].getBool()?"ok":"err") << ",";
+		print << (loadAtt(db, String({prefix,"1"}), "b.txt") == "\r\n--x\r\n") << ","
+			  << loadAtt(db, res[2]["id"].getString(), "a.txt") << " ";
+	}
+	CouchDB db(server.getConfig("mocktest"));
+	db.put(Object("_id","single")("_attachments",Object("a.txt",binaryAtt("single"))));
+	print << loadAtt(db, "single", "a.txt");
+}
+
+static void mockKeysPlanner(std::ostream &print) {
+	MockCouchDB server;
+	server.createDB("mocktest");
+	server.regView("mocktest","test/sum",new MockTestView);
+	Config direct = server.getConfig("mocktest");
+	Config planned = direct;
+	planned.keysPlannerThreshold = 4;
+	planned.keysPlannerParallel = 3;
+	CouchDB ddb(direct);
+	CouchDB pdb(planned);
+	//long keys, so the planner needs several GET requests
+	String prefix("group-with-quite-long-name-to-fill-the-request-");
+	Array docs;
+	for (unsigned int i = 0; i < 300; i++) {
+		docs.push_back(Object("group",String({prefix,Value(i % 60).toString()}))("value",i));
+	}
+	ddb.bulkUpload(docs);
+	//unordered, duplicated and missing keys
+	Array keys;
+	for (unsigned int i = 0; i < 80; i++) {
+		keys.push_back(String({prefix,Value((i * 37) % 70).toString()}));
+	}
+	keys.push_back(keys[0]);
+	keys.push_back(keys[5]);
+	View v("_design/test/_view/sum");
+	View r("_design/test/_view/sum", View::reduce);
+	std::size_t cnt = server.getRequestCount();
+	Result d1 = ddb.createQuery(v).keys(keys).exec();
+	Result d2 = ddb.createQuery(r).keys(keys).group().exec();
+	std::size_t directReqs = server.getRequestCount() - cnt;
+	cnt = server.getRequestCount();
+	Result p1 = pdb.createQuery(v).keys(keys).exec();
+	Result p2 = pdb.createQuery(r).keys(keys).group().exec();
+	std::size_t plannedReqs = server.getRequestCount() - cnt;
+	print << d1.size() << "," << d2.size() << ","
+		  << (d1.stringify() == p1.stringify()) << ","
+		  << (d2.stringify() == p2.stringify()) << ","
+		  << (plannedReqs > directReqs);
+}
+
+static void mockDocMapObserver(std::ostream &print) {
+	MockCouchDB server;
+	server.createDB("mocktest");
+	CouchDB db(server.getConfig("mocktest"));
+	db.bulkUpload(Value::fromString("[{\"_id\":\"a\",\"v\":1},{\"_id\":\"b\",\"v\":2}]"));
+	DocMap<int> map([](Value doc) {return static_cast<int>(doc["v"].getInt());});
+	map(db.get("a"));
+	map(db.get("b"));
+	ChangesDistributor dist(db);
+	auto reg = dist.add(map.getObserver());
+	dist.runService();
+	Document da(db.get("a"));
+	da.set("v",10);
+	db.put(da);
+	for (int i = 0; i < 200 && map.find("a") != nullptr; i++) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(10));
+	}
+	print << (map.find("a") == nullptr) << "," << (map.find("b") != nullptr) << ",";
+	dist.stopService();
+	dist.remove(reg);
+	print << map(db.get("a"))->data << "," << map(db.get("b"))->data;
+}
+
+static Value makeUploadDocs(const char *prefix, unsigned int count, unsigned int padding) {
+	Array docs;
+	std::string pad(padding,'x');
+	for (unsigned int i = 0; i < count; i++) {
+		char id[30];
+		snprintf(id, sizeof(id), "%s%04u", prefix, i);
+		docs.push_back(Object("_id",id)("pad",StrViewA(pad)));
+	}
+	return docs;
+}
+
+static bool sameIds(const Value &docs, const Value &res) {
+	if (docs.size() != res.size()) return false;
+	for (std::size_t i = 0; i < docs.size(); i++) {
+		if (docs[i]["_id"] != res[i]["id"]) return false;
+	}
+	return true;
+}
+
+static void mockSplitUpload(std::ostream &print) {
+	MockCouchDB server;
+	server.createDB("mocktest");
+	Config cfg = server.getConfig("mocktest");
+	cfg.maxBulkSizeDocs = 10;
+	cfg.maxBulkSizeBytes = 0;
+	cfg.bulkUploadParallel = 3;
+	{
+		//split by count
+		CouchDB db(cfg);
+		Value docs = makeUploadDocs("a", 95, 10);
+		std::size_t cnt = server.getRequestCount();
+		Value res = db.bulkUpload(docs);
+		print << server.getRequestCount() - cnt << "," << sameIds(docs, res) << " ";
+	}
+	{
+		//split by size
+		cfg.maxBulkSizeDocs = 1000;
+		cfg.maxBulkSizeBytes = 1000;
+		CouchDB db(cfg);
+		Value docs = makeUploadDocs("b", 30, 250);
+		std::size_t cnt = server.getRequestCount();
+		Value res = db.bulkUpload(docs);
+		print << (server.getRequestCount() - cnt > 1) << "," << sameIds(docs, res) << " ";
+	}
+}
+
+static void mockSplitUploadFailure(std::ostream &print) {
+	MockCouchDB server;
+	server.createDB("mocktest");
+	Config cfg = server.getConfig("mocktest");
+	cfg.maxBulkSizeDocs = 10;
+	cfg.bulkUploadParallel = 3;
+	CouchDB db(cfg);
+	Value docs = makeUploadDocs("c", 100, 10);
+	//the fourth request of the upload fails
+	MockCouchDB::Faults f;
+	f.failEvery = 4;
+	server.setFaults(f);
+	std::size_t cnt = server.getRequestCount();
+	try {
+		db.bulkUpload(docs);
+		print << "uploaded,";
+	} catch (const RequestError &e) {
+		print << e.getCode() << ",";
+	}
+	std::size_t reqs = server.getRequestCount() - cnt;
+	server.setFaults(MockCouchDB::Faults());
+
+	//no chunk is started after the failure, finished chunks are stored
+	Array ids;
+	for (Value d : docs) ids.push_back(d["_id"]);
+	std::size_t stored = 0;
+	for (Row rw : db.allDocs(0).keys(ids).exec()) {
+		if (!rw.error.defined()) stored++;
+	}
+	print << (reqs < 10) << "," << (stored >= 30) << "," << (stored % 10 == 0) << "," << (stored < 100);
+}
+
+static void mockParallelValidation(std::ostream &print) {
+	MockCouchDB server;
+	server.createDB("mocktest");
+	std::atomic<bool> reject(true);
+	Validator validator;
+	//rejected documents are reported through an exception, so the details contain the id
+	validator.add([&](const Value &doc) {
+		unsigned int idx = doc["idx"].getUInt();
+		if (reject && (idx == 130 || idx == 131 || idx == 450 || idx == 700 || idx == 999)) {
+			StrViewA id = doc["_id"].getString();
+			throw std::runtime_error(std::string(id.data, id.length));
+		}
+		//slow down early blocks, so later failures are found first
+		if (idx < 256) std::this_thread::sleep_for(std::chrono::microseconds(200));
+		return false;
+	}, "reject");
+	Config cfg = server.getConfig("mocktest");
+	cfg.validator = &validator;
+	cfg.commitValidationThreads = 4;
+	CouchDB db(cfg);
+	std::size_t reqs = server.getRequestCount();
+	std::map<std::string, unsigned int> reported;
+	for (unsigned int run = 0; run < 10; run++) {
+		Changeset chset = db.createChangeset();
+		for (unsigned int i = 0; i < 1000; i++) {
+			char id[20];
+			snprintf(id, sizeof(id), "d%04u", i);
+			chset.update(Document(Object("_id",id)("idx",i)));
+		}
+		try {
+			chset.commit();
+			reported["none"]++;
+		} catch (const ValidationFailedException &e) {
+			String details = e.getValidationResult().details;
+			reported[std::string(details.c_str())]++;
+		}
+	}
+	for (auto &&x: reported) print << x.first << ":" << x.second << ",";
+	print << (server.getRequestCount() - reqs) << ",";
+	reject = false;
+	Changeset chset = db.createChangeset();
+	for (unsigned int i = 0; i < 300; i++) {
+		chset.update(Document(Object("_id",String({"ok",Value(i).toString()}))("idx",i)));
+	}
+	chset.commit();
+	print << db.allDocs(0).range("ok","ol").exec().size();
+}
+
+static std::string runChunkedJoin(CouchDB &db, std::size_t keysPerChunk, unsigned int maxParallel) {
+	auto q = db.allDocs(View::includeDocs).range("p","q").join(db.allDocs(View::includeDocs),
+			[](const Value &r) {return r["doc"]["friend"];},
+			[](Array &group) {return Value(group[0]["doc"]["name"]);},
+			[](const Value &r, const Value &v) {return Value({r["id"], v});});
+	q.chunks(keysPerChunk, maxParallel);
+	Result res = q.exec();
+	std::string out;
+	for (Value r : res) {
+		out.append(r[0].getString().data, r[0].getString().length).append(":")
+		   .append(r[1].getString().data, r[1].getString().length).append(" ");
+	}
+	return out;
+}
+
+static void mockChunkedJoin(std::ostream &print) {
+	MockCouchDB server;
+	server.createDB("mocktest");
+	CouchDB db(server.getConfig("mocktest"));
+	Array docs;
+	for (unsigned int i = 0; i < 10; i++) {
+		docs.push_back(Object("_id",String({"f",Value(i).toString()}))("name",String({"friend",Value(i).toString()})));
+	}
+	for (unsigned int i = 0; i < 30; i++) {
+		docs.push_back(Object("_id",String({"p",Value(100+i).toString()}))("friend",String({"f",Value((i*7)%10).toString()})));
+	}
+	db.bulkUpload(docs);
+	std::string single = runChunkedJoin(db, 1000, 1);
+	std::string chunked = runChunkedJoin(db, 3, 1);
+	std::string parallel = runChunkedJoin(db, 3, 4);
+	print << (single == chunked) << "," << (single == parallel) << "," << single.substr(0, 39);
+}
+
+void runTestMockDB(TestSimple &tst) {
+
+tst.test("mockdb.bulkAndQuery","a,10 b,20 ") >> &mockBulkAndQuery;
+tst.test("mockdb.lazyResult","a,10,a b,20,b ") >> &mockLazyResult;
+tst.test("mockdb.lazyAsResult","exception") >> &mockLazyAsResult;
+tst.test("mockdb.lazyEscapedField","1,2,3,0") >> &mockLazyEscapedField;
+tst.test("mockdb.lazyUpdateSeq","2,1,1,1") >> &mockLazyUpdateSeq;
+tst.test("mockdb.viewReduce","1:40 2:20 ") >> &mockViewReduce;
+tst.test("mockdb.longPoll","late") >> &mockLongPoll;
+tst.test("mockdb.faults","503") >> &mockFaults;
+tst.test("mockdb.requestStats","1,2,1,1,1,1,1,1,1") >> &mockRequestStats;
+tst.test("mockdb.pipeline","200:a 200:b 200:c 200:d 200:e ") >> &mockPipeline;
+tst.test("mockdb.pipelineAuth","200:a 200:b 200:c 200:d 2") >> &mockPipelineAuth;
+if (isCompressionSupported()) tst.test("mockdb.gzipKeepAlive","200:gzip:a:20000 200:gzip:b:0 200:gzip:a:20000 20000,1") >> &mockGzipKeepAlive;
+tst.test("mockdb.attachmentFdShort","error,1,1") >> &mockAttachmentFdShort;
+tst.test("mockdb.attachmentFd","200000,1,1-,1") >> &mockAttachmentFd;
+tst.test("mockdb.multipart","1:ok,ok,ok,1,b 3:ok,ok,ok,1,m single") >> &mockMultipart;
+tst.test("mockdb.keysPlanner","360,72,1,1,1") >> &mockKeysPlanner;
+tst.test("mockdb.docMapObserver","1,1,10,2") >> &mockDocMapObserver;
+tst.test("mockdb.splitUpload","10,1 1,1 ") >> &mockSplitUpload;
+tst.test("mockdb.splitUploadFailure","503,1,1,1,1") >> &mockSplitUploadFailure;
+tst.test("mockdb.parallelValidation","d0130:10,0,300") >> &mockParallelValidation;
+tst.test("mockdb.chunkedJoin","1,1,p100:friend0 p101:friend7 p102:friend4 ") >> &mockChunkedJoin;
+
+}
+
+}
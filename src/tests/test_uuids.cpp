@@ -11,6 +11,7 @@
 #include <thread>
 
 #include "../couchit/couchDB.h"
+#include "../couchit/defaultUIDGen.h"
 
 #include "test_common.h"
 #include "testClass.h"
@@ -35,8 +36,29 @@ static void genFastUUIDS(std::ostream &print) {
 	print << uuidmap.size();
 }
 
+static void genUIDsThreads(std::ostream &print) {
+
+	std::vector<std::set<std::string> > parts(4);
+	std::vector<std::thread> thrs;
+	for (auto &&p : parts) {
+		std::set<std::string> *out = &p;
+		thrs.push_back(std::thread([out]{
+			IIDGen::Buffer buffer;
+			for (std::size_t i = 0; i < 10000; i++) {
+				StrViewA id = FastUIDGen::getInstance()(buffer, "t-");
+				if (id.length == 22) out->insert(std::string(id.data, id.length));
+			}
+		}));
+	}
+	for (auto &&t : thrs) t.join();
+	std::set<std::string> all;
+	for (auto &&p : parts) all.insert(p.begin(), p.end());
+	print << all.size();
+}
+
 
 void testUUIDs(TestSimple &tst) {
 	tst.test("couchdb.genfastuid","50") >> &genFastUUIDS;
+	tst.test("couchdb.genuidthreads","40000") >> &genUIDsThreads;
 }
 }